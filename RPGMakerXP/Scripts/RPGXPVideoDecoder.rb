@@ -1,4 +1,5 @@
-class ViDec
+# Error codes and helpers shared by the scene and by videos drawn into your own bitmaps
+module ViDecCommon
     ErrorCode = {
         'Success' => 0,
         'VideoNotFinished' => 1,
@@ -11,18 +12,69 @@ class ViDec
         'FailedToFindAudioStream' => 8,
         'FailedToOpenAudioDevice' => 9,
         'InternalError' => 10,
+        'InvalidArguments' => 11,
     }
 
-    ViDecCreateContext = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCreateContext', 'pip', 'i')
-    ViDecCloseContext = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCloseContext', '', 'i')
-    ViDecStartRender = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecStartRender', '', 'i')
-    ViDecGetVideoState = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecGetVideoState', '', 'i')
-    ViDecSetVolume = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecSetVolume', 'i', 'i')
+    # Quality rungs the decoder can step down to when it falls behind, in the order they're used
+    QualityRung = {
+        'Full' => 0,
+        'SkipLoopFilter' => 1,
+        'FastScaling' => 2,
+        'LowResolution' => 3,
+    }
+
+    # How frames are placed in the bitmap, Fit keeps the videos aspect ratio with black bars
+    ViewportMode = {
+        'Stretch' => 0,
+        'Fit' => 1,
+        'Custom' => 2,
+    }
+
+    # Scaling filters from cheapest to sharpest, Bicubic is the default
+    ScalerQuality = {
+        'FastBilinear' => 0,
+        'Bilinear' => 1,
+        'Bicubic' => 2,
+    }
+
+    ViDecSetWorkerCount = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecSetWorkerCount', 'i', 'i')
+    ViDecGetWorkerCount = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecGetWorkerCount', '', 'i')
+
+    # Worker threads shared by every video that's playing, 0 goes back to one per logical core
+    # minus one
+    def set_worker_count(count)
+        return ViDecSetWorkerCount.call(count)
+    end
+
+    def worker_count
+        return ViDecGetWorkerCount.call()
+    end
+
+    ViDecShutdown = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecShutdown', '', 'i')
+
+    # Closes every video and stops the shared worker threads, call it before the game exits or
+    # the DLL is unloaded. Videos opened afterwards start the workers up again
+    def shutdown
+        return ViDecShutdown.call()
+    end
+
+    ViDecSetTraceDirectory = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecSetTraceDirectory', 'p', 'i')
+
+    # Every video opened after this records a timeline of the decoder and renderer threads, which
+    # is written to directory as videc_trace_<handle>.json once the video is closed. Open the
+    # file in Perfetto or chrome://tracing. nil turns tracing back off
+    def set_trace_directory(directory)
+        return ViDecSetTraceDirectory.call(directory == nil ? "" : directory)
+    end
+
+    ViDecBakeVideo = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecBakeVideo', 'ppiii', 'i')
+
+    # Converts a video ahead of time for a bitmap of width x height, baked videos play with no
+    # decoding at all. Takes as long as decoding the whole video, so do it while packaging the game
+    def bake_video(video_file, baked_file, width, height, compress = true)
+        return ViDecBakeVideo.call(video_file, baked_file, width, height, compress ? 1 : 0)
+    end
 
-    ViDecWasBadTermination = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecWasBadTermination', '', 'i')
-    ViDecGetInternalError = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecGetInternalError', '', 'i')
-    ViDecGetInternalErrorMessage = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecGetInternalErrorMessage', '', 'p')
-    
     def convert_error(err)
         if err == ErrorCode['Success']
             return "Successful operation"
@@ -44,19 +96,231 @@ class ViDec
             return "Failed to open an audio device"
         elsif err == ErrorCode['InternalError']
             return "An internal error has occured"
+        elsif err == ErrorCode['InvalidArguments']
+            return "Invalid arguments"
+        end
+    end
+
+    # Packs the optional settings hash in the layout of DecoderSettings, every field is 32 bits
+    def pack_settings(settings)
+        fields = [
+            settings.fetch(:audio_buffer_samples, 0),
+            settings.fetch(:low_latency_audio, false) ? 1 : 0,
+            settings.fetch(:late_discard_margin_ms, 200),
+            settings.fetch(:video_thread_count, 0),
+            settings.fetch(:video_thread_type, 0),
+            settings.fetch(:conversion_threads, 0),
+            settings.fetch(:start_buffer_ms, 0),
+            settings.fetch(:start_buffer_bytes, 0),
+            settings.fetch(:max_buffer_ms, 0),
+            settings.fetch(:max_buffer_bytes, 64 * 1024 * 1024),
+            settings.fetch(:compact_frames, false) ? 1 : 0,
+            settings.fetch(:memory_limit_bytes, 0),
+        ]
+        return [(fields.size + 1) * 4].concat(fields).pack('L*')
+    end
+
+    # Pipeline stages timed in PlaybackStats, in the order they're laid out
+    StatsStages = [:demux, :decode, :rescale, :blit]
+
+    # Empty buffer in the layout of PlaybackStats for ViDecGetStats to fill in
+    def stats_buffer
+        return [37 * 4].concat([0] * 36).pack('L*')
+    end
+
+    # Turns a filled in PlaybackStats into a hash. Stage timings and drift are in microseconds and
+    # a positive drift means frames are shown late
+    def unpack_stats(buffer)
+        fields = buffer.unpack('L32l2L3')
+        stages = {}
+        StatsStages.each_with_index do |stage, i|
+            timing = fields[6 + i * 5, 5]
+            stages[stage] = {
+                :samples => timing[0],
+                :mean_us => timing[1],
+                :p95_us => timing[2],
+                :p99_us => timing[3],
+                :max_us => timing[4],
+            }
+        end
+        return {
+            :frames_decoded => fields[1],
+            :frames_presented => fields[2],
+            :frames_dropped => fields[3],
+            :frames_skipped => fields[4],
+            :frames_discarded => fields[5],
+            :stages => stages,
+            :video_queued_frames => fields[26],
+            :video_queued_ms => fields[27],
+            :video_queued_packets => fields[28],
+            :audio_queued_packets => fields[29],
+            :audio_queued_ms => fields[30],
+            :audio_underruns => fields[31],
+            :current_drift_us => fields[32],
+            :average_drift_us => fields[33],
+            :buffered_bytes => fields[34],
+            :peak_buffered_bytes => fields[35],
+            :decode_errors => fields[36],
+        }
+    end
+end
+
+class ViDec
+    include ViDecCommon
+
+    ViDecCreateContext = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCreateContext', 'pip', 'i')
+    ViDecCreateContextEx = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCreateContextEx', 'pipp', 'i')
+    ViDecCloseContext = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCloseContext', '', 'i')
+    ViDecStartRender = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecStartRender', '', 'i')
+    ViDecGetVideoState = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecGetVideoState', '', 'i')
+    ViDecSetVolume = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecSetVolume', 'i', 'i')
+
+    ViDecWasBadTermination = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecWasBadTermination', '', 'i')
+    ViDecGetInternalError = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecGetInternalError', '', 'i')
+    ViDecGetInternalErrorMessage = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecGetInternalErrorMessage', '', 'p')
+    ViDecGetPlaybackAllocations = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecGetPlaybackAllocations', '', 'i')
+    ViDecGetFrameDropCounts = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecGetFrameDropCounts', 'ppp', 'i')
+    ViDecSetQualityLadder = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecSetQualityLadder', 'i', 'i')
+    ViDecGetQualityRung = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecGetQualityRung', '', 'i')
+    ViDecGetVideoThreading = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecGetVideoThreading', 'pp', 'i')
+    ViDecGetMemoryStats = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecGetMemoryStats', 'pp', 'i')
+    ViDecGetSyncStats = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecGetSyncStats', 'p', 'i')
+    ViDecGetStats = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecGetStats', 'p', 'i')
+    ViDecSetViewport = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecSetViewport', 'iiiii', 'i')
+    ViDecSetScaler = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecSetScaler', 'i', 'i')
+    ViDecSeek = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecSeek', 'i', 'i')
+    ViDecSetLoop = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecSetLoop', 'iii', 'i')
+    ViDecGetPosition = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecGetPosition', '', 'i')
+
+    # Returns how many frames were dropped by the renderer, skipped by the decoder and discarded
+    # by the codec, or nil if there's no context
+    def frame_drop_counts
+        dropped = [0].pack('L')
+        skipped = [0].pack('L')
+        discarded = [0].pack('L')
+        if ViDecGetFrameDropCounts.call(dropped, skipped, discarded) != ErrorCode['Success']
+            return nil
+        end
+        return {
+            :dropped => dropped.unpack('L')[0],
+            :skipped => skipped.unpack('L')[0],
+            :discarded => discarded.unpack('L')[0],
+        }
+    end
+
+    # Takes a list of rung names from QualityRung which the decoder is allowed to use
+    def set_quality_ladder(rungs)
+        mask = 0
+        rungs.each { |rung| mask |= 1 << QualityRung[rung] }
+        return ViDecSetQualityLadder.call(mask)
+    end
+
+    def quality_rung
+        return QualityRung.key(ViDecGetQualityRung.call())
+    end
+
+    # Returns the thread count and threading mode (1 for frame, 2 for slice) the video codec
+    # accepted, or nil if there's no context
+    def video_threading
+        thread_count = [0].pack('L')
+        thread_type = [0].pack('L')
+        if ViDecGetVideoThreading.call(thread_count, thread_type) != ErrorCode['Success']
+            return nil
         end
+        return {
+            :thread_count => thread_count.unpack('L')[0],
+            :thread_type => thread_type.unpack('L')[0],
+        }
     end
 
-    def initialize(video_file, volume=0.1)
+    # Returns the peak working set of the process and the most the context had buffered at once,
+    # both in bytes, or nil if there's no context
+    def memory_stats
+        working_set = [0].pack('L')
+        buffered = [0].pack('L')
+        if ViDecGetMemoryStats.call(working_set, buffered) != ErrorCode['Success']
+            return nil
+        end
+        return {
+            :peak_working_set => working_set.unpack('L')[0],
+            :peak_buffered_bytes => buffered.unpack('L')[0],
+        }
+    end
+
+    # Returns how closely presented frames followed the clock, drift and jitter are in microseconds
+    # and a positive drift means frames were shown late, or nil if there's no context
+    def sync_stats
+        stats = [6 * 4, 0, 0, 0, 0, 0].pack('L*')
+        if ViDecGetSyncStats.call(stats) != ErrorCode['Success']
+            return nil
+        end
+        fields = stats.unpack('LLlLLL')
+        return {
+            :audio_master => fields[1] != 0,
+            :average_drift_us => fields[2],
+            :max_drift_us => fields[3],
+            :frame_jitter_us => fields[4],
+            :presented_frames => fields[5],
+        }
+    end
+
+    # Returns frame counts, stage timings, queue depths and buffer usage (see unpack_stats), or nil
+    # if there's no context. Cheap enough to call every frame for an on screen overlay
+    def stats
+        buffer = stats_buffer
+        if ViDecGetStats.call(buffer) != ErrorCode['Success']
+            return nil
+        end
+        return unpack_stats(buffer)
+    end
+
+    # Takes a mode name from ViewportMode, the rectangle is in bitmap pixels and only used by
+    # Custom
+    def set_viewport(mode, x=0, y=0, width=0, height=0)
+        return ViDecSetViewport.call(ViewportMode[mode], x, y, width, height)
+    end
+
+    # Takes a scaler name from ScalerQuality
+    def set_scaler(quality)
+        return ViDecSetScaler.call(ScalerQuality[quality])
+    end
+
+    # Jumps to a position in seconds, playback carries on from there once it has buffered again
+    def seek(seconds)
+        return ViDecSeek.call((seconds * 1000.0).floor.to_i)
+    end
+
+    # Loops between two positions in seconds, an end of nil loops at the end of the video
+    def set_loop(enabled, start_seconds=0.0, end_seconds=nil)
+        start_ms = (start_seconds * 1000.0).floor.to_i
+        end_ms = end_seconds == nil ? 0 : (end_seconds * 1000.0).floor.to_i
+        return ViDecSetLoop.call(enabled ? 1 : 0, start_ms, end_ms)
+    end
+
+    # Position of the frame on screen in seconds
+    def position
+        return ViDecGetPosition.call() / 1000.0
+    end
+
+    def create_context(video_file, volume, settings)
+        volume = (volume * 128.0).floor.to_i
+        bitmap = @video_plane.bitmap.object_id << 1
+        if settings == nil
+            return ViDecCreateContext.call(video_file, volume, bitmap)
+        end
+        return ViDecCreateContextEx.call(video_file, volume, bitmap, pack_settings(settings))
+    end
+
+    def initialize(video_file, volume=0.1, settings=nil)
         video_file = video_file.delete!("\n")
         # print(video_file)
         @video_plane = Sprite.new
         @video_plane.bitmap = Bitmap.new(640, 480)
-        err = ViDecCreateContext.call(video_file, (volume * 128.0).floor.to_i, @video_plane.bitmap.object_id << 1)
+        err = create_context(video_file, volume, settings)
         # If a user presses F12, another instance can exist. We'll just clean it up and recreate
         if err == ErrorCode['DecoderInstanceAlreadyCreated']
             ViDecCloseContext.call()
-            err = ViDecCreateContext.call(video_file, (volume * 128.0).floor.to_i, @video_plane.bitmap.object_id << 1)
+            err = create_context(video_file, volume, settings)
         end
 
         if err != ErrorCode['Success']
@@ -98,3 +362,111 @@ class ViDec
         @video_plane.dispose
     end
 end
+
+# A video drawn into a bitmap of your own, such as a looping background on the map or a portrait
+# in a message window. Any number of these can play at the same time as each other and as the
+# ViDec scene. Check finished? every frame and dispose once you're done with it
+class ViDecVideo
+    include ViDecCommon
+
+    ViDecCtxCreate = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCtxCreate', 'pippp', 'i')
+    ViDecCtxCreateFromArchive = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCtxCreateFromArchive', 'ppippp', 'i')
+    ViDecCtxClose = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCtxClose', 'i', 'i')
+    ViDecCtxStartRender = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCtxStartRender', 'i', 'i')
+    ViDecCtxGetVideoState = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCtxGetVideoState', 'i', 'i')
+    ViDecCtxSetVolume = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCtxSetVolume', 'ii', 'i')
+    ViDecCtxWasBadTermination = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCtxWasBadTermination', 'i', 'i')
+    ViDecCtxGetInternalErrorMessage = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCtxGetInternalErrorMessage', 'i', 'p')
+    ViDecCtxSeek = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCtxSeek', 'ii', 'i')
+    ViDecCtxSetLoop = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCtxSetLoop', 'iiii', 'i')
+    ViDecCtxGetPosition = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCtxGetPosition', 'i', 'i')
+    ViDecCtxGetStats = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCtxGetStats', 'ip', 'i')
+    ViDecCtxSetViewport = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCtxSetViewport', 'iiiiii', 'i')
+    ViDecCtxSetScaler = Win32API.new('RPGXPVideoDecoder.dll', 'ViDecCtxSetScaler', 'ii', 'i')
+
+    attr_reader :error
+
+    # Encrypted games keep their files in here
+    Archive = 'Game.rgssad'
+
+    # Opens the video and starts buffering it, nothing is drawn until start is called so the next
+    # video can be loaded ahead of time. Videos that aren't on disk are read straight out of the
+    # game archive. error holds the reason if opening failed
+    def initialize(video_file, bitmap, volume=0.1, settings=nil)
+        handle = [0].pack('L')
+        volume = (volume * 128.0).floor.to_i
+        packed_settings = settings == nil ? nil : pack_settings(settings)
+        if !FileTest.exist?(video_file) && FileTest.exist?(Archive)
+            @error = ViDecCtxCreateFromArchive.call(Archive, video_file, volume,
+                                                    bitmap.object_id << 1, packed_settings, handle)
+        else
+            @error = ViDecCtxCreate.call(video_file, volume, bitmap.object_id << 1,
+                                         packed_settings, handle)
+        end
+        @handle = handle.unpack('L')[0]
+    end
+
+    def ok?
+        return @error == ErrorCode['Success']
+    end
+
+    def start
+        return ViDecCtxStartRender.call(@handle)
+    end
+
+    # True once the video played out, failed or was never opened
+    def finished?
+        return ViDecCtxGetVideoState.call(@handle) != ErrorCode['VideoNotFinished']
+    end
+
+    # Message from the decoder if playback stopped because of an error, nil otherwise
+    def failure_message
+        if ViDecCtxWasBadTermination.call(@handle) != 1
+            return nil
+        end
+        return ViDecCtxGetInternalErrorMessage.call(@handle)
+    end
+
+    def volume=(volume)
+        ViDecCtxSetVolume.call(@handle, (volume * 128.0).floor.to_i)
+    end
+
+    def seek(seconds)
+        return ViDecCtxSeek.call(@handle, (seconds * 1000.0).floor.to_i)
+    end
+
+    def set_loop(enabled, start_seconds=0.0, end_seconds=nil)
+        start_ms = (start_seconds * 1000.0).floor.to_i
+        end_ms = end_seconds == nil ? 0 : (end_seconds * 1000.0).floor.to_i
+        return ViDecCtxSetLoop.call(@handle, enabled ? 1 : 0, start_ms, end_ms)
+    end
+
+    def position
+        return ViDecCtxGetPosition.call(@handle) / 1000.0
+    end
+
+    def set_viewport(mode, x=0, y=0, width=0, height=0)
+        return ViDecCtxSetViewport.call(@handle, ViewportMode[mode], x, y, width, height)
+    end
+
+    def set_scaler(quality)
+        return ViDecCtxSetScaler.call(@handle, ScalerQuality[quality])
+    end
+
+    # Same as ViDec#stats, nil if the video was never opened
+    def stats
+        buffer = stats_buffer
+        if ViDecCtxGetStats.call(@handle, buffer) != ErrorCode['Success']
+            return nil
+        end
+        return unpack_stats(buffer)
+    end
+
+    # Stops playback and frees the decoder, the bitmap is left for you to dispose
+    def dispose
+        if @handle != 0
+            ViDecCtxClose.call(@handle)
+            @handle = 0
+        end
+    end
+end
@@ -0,0 +1,144 @@
+#include <cstring>
+
+extern "C" {
+#include <libavutil/channel_layout.h>
+#include <libavutil/samplefmt.h>
+#include <libswresample/swresample.h>
+}
+
+#include "audio_converter.h"
+#include "sample_kernels.h"
+
+namespace {
+
+AVSampleFormat GetSampleFormat(SDL_AudioFormat format) {
+    switch (format) {
+    case AUDIO_U8:
+        return AV_SAMPLE_FMT_U8;
+    case AUDIO_S16:
+        return AV_SAMPLE_FMT_S16;
+    case AUDIO_S32:
+        return AV_SAMPLE_FMT_S32;
+    case AUDIO_F32:
+        return AV_SAMPLE_FMT_FLT;
+    default:
+        return AV_SAMPLE_FMT_NONE;
+    }
+}
+
+u64 GetChannelLayout(const AVFrame& raw) {
+    // Streams without a layout get the usual one for their channel count, like swresample does
+    if (raw.channel_layout != 0) {
+        return raw.channel_layout;
+    }
+    return static_cast<u64>(av_get_default_channel_layout(raw.channels));
+}
+
+} // Anonymous namespace
+
+AudioConverter::~AudioConverter() {
+    swr_free(&context);
+}
+
+void AudioConverter::SetOutput(const SDL_AudioSpec& spec) {
+    out_rate = spec.freq;
+    out_channels = spec.channels;
+    out_format = GetSampleFormat(spec.format);
+    sample_bytes = out_format != AV_SAMPLE_FMT_NONE
+                       ? static_cast<std::size_t>(av_get_bytes_per_sample(out_format))
+                       : 0;
+    swr_free(&context);
+}
+
+std::size_t AudioConverter::GetFrameBytes() const {
+    return sample_bytes * static_cast<std::size_t>(out_channels);
+}
+
+std::size_t AudioConverter::GetOutputSize(const av::AudioSamples& samples) {
+    const auto* raw = samples.raw();
+    if (raw == nullptr || raw->nb_samples <= 0 || GetFrameBytes() == 0) {
+        return 0;
+    }
+    if (!NeedsResampler(*raw)) {
+        return static_cast<std::size_t>(raw->nb_samples) * GetFrameBytes();
+    }
+    if (!EnsureResampler(*raw)) {
+        return 0;
+    }
+    const int frames = swr_get_out_samples(context, raw->nb_samples);
+    return frames > 0 ? static_cast<std::size_t>(frames) * GetFrameBytes() : 0;
+}
+
+std::size_t AudioConverter::Convert(const av::AudioSamples& samples, u8* dst,
+                                    std::size_t capacity) {
+    const auto* raw = samples.raw();
+    const auto frame_bytes = GetFrameBytes();
+    if (raw == nullptr || dst == nullptr || raw->nb_samples <= 0 || frame_bytes == 0) {
+        return 0;
+    }
+
+    if (!NeedsResampler(*raw)) {
+        const auto frames = static_cast<std::size_t>(raw->nb_samples);
+        if (frames * frame_bytes > capacity) {
+            return 0;
+        }
+        if (av_sample_fmt_is_planar(static_cast<AVSampleFormat>(raw->format))) {
+            Samples::Interleave(dst, raw->extended_data, static_cast<std::size_t>(out_channels),
+                                frames, sample_bytes);
+        } else {
+            std::memcpy(dst, raw->data[0], frames * frame_bytes);
+        }
+        return frames * frame_bytes;
+    }
+
+    if (!EnsureResampler(*raw)) {
+        return 0;
+    }
+    // A single call takes the whole packet, anything that doesn't fit stays buffered in the
+    // resampler until the next one
+    u8* out[1] = {dst};
+    const int converted =
+        swr_convert(context, out, static_cast<int>(capacity / frame_bytes),
+                    const_cast<const u8**>(raw->extended_data), raw->nb_samples);
+    return converted > 0 ? static_cast<std::size_t>(converted) * frame_bytes : 0;
+}
+
+void AudioConverter::Reset() {
+    // Initializing again clears the resamplers history and anything it was holding back
+    if (context != nullptr && swr_init(context) < 0) {
+        swr_free(&context);
+    }
+}
+
+u64 AudioConverter::GetAllocations() const {
+    return allocations.load();
+}
+
+bool AudioConverter::NeedsResampler(const AVFrame& raw) const {
+    const auto format = static_cast<AVSampleFormat>(raw.format);
+    return raw.sample_rate != out_rate || raw.channels != out_channels ||
+           av_get_packed_sample_fmt(format) != out_format;
+}
+
+bool AudioConverter::EnsureResampler(const AVFrame& raw) {
+    const auto format = static_cast<AVSampleFormat>(raw.format);
+    const auto layout = GetChannelLayout(raw);
+    if (context != nullptr && raw.sample_rate == in_rate && format == in_format &&
+        layout == in_layout) {
+        return true;
+    }
+
+    swr_free(&context);
+    allocations++;
+    context = swr_alloc_set_opts(nullptr, av_get_default_channel_layout(out_channels), out_format,
+                                 out_rate, static_cast<s64>(layout), format, raw.sample_rate, 0,
+                                 nullptr);
+    if (context == nullptr || swr_init(context) < 0) {
+        swr_free(&context);
+        return false;
+    }
+    in_rate = raw.sample_rate;
+    in_format = format;
+    in_layout = layout;
+    return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+#include <SDL_audio.h>
+#include <frame.h>
+
+#include "common_types.h"
+
+struct SwrContext;
+
+/// Converts decoded audio into the spec the device was opened with. Audio that only differs from
+/// the device in being planar, which is what most codecs decode to, is interleaved with the SIMD
+/// sample kernels. Anything with a different rate, sample format or channel count goes through
+/// swresample, which also up or down mixes to the device's channels. The caller owns the output
+/// buffer so it can be sized once and reused for every packet.
+class AudioConverter {
+public:
+    AudioConverter() = default;
+    ~AudioConverter();
+
+    AudioConverter(const AudioConverter&) = delete;
+    AudioConverter& operator=(const AudioConverter&) = delete;
+
+    /// Converts into spec from now on, only U8, S16, S32 and F32 are supported
+    void SetOutput(const SDL_AudioSpec& spec);
+
+    /// Bytes of interleaved audio in the output spec for a single frame of every channel
+    std::size_t GetFrameBytes() const;
+
+    /// Most Convert can write for samples, 0 if they can't be converted
+    std::size_t GetOutputSize(const av::AudioSamples& samples);
+
+    /// Writes samples to dst in the output spec and returns how many bytes it wrote, always whole
+    /// frames. swresample may hold some samples back and return them with the next packet
+    std::size_t Convert(const av::AudioSamples& samples, u8* dst, std::size_t capacity);
+
+    /// Drops anything swresample is still holding on to, after a seek
+    void Reset();
+
+    /// Resamplers set up so far, one per input format the stream switches to. Safe to call from
+    /// any thread
+    u64 GetAllocations() const;
+
+private:
+    bool NeedsResampler(const AVFrame& raw) const;
+    bool EnsureResampler(const AVFrame& raw);
+
+    int out_rate{};
+    int out_channels{};
+    AVSampleFormat out_format{AV_SAMPLE_FMT_NONE};
+    std::size_t sample_bytes{};
+
+    // Input swresample was set up for, it's rebuilt if the stream changes format mid way
+    SwrContext* context{nullptr};
+    int in_rate{};
+    u64 in_layout{};
+    AVSampleFormat in_format{AV_SAMPLE_FMT_NONE};
+    std::atomic<u64> allocations{0};
+};
@@ -0,0 +1,242 @@
+#include <cmath>
+#include <cstring>
+#include "audio_gain.h"
+#include "cpu_features.h"
+
+#if VIDEC_ARCH_X86
+#include <emmintrin.h>
+#endif
+
+namespace AudioGain {
+
+namespace {
+
+// Largest float below 2^31, anything above it would wrap when converted back to s32
+constexpr f32 S32_MAX_AS_FLOAT = 2147483520.0f;
+
+// Rounds to nearest even in the default rounding mode, the same as cvtps2dq, so every path gives
+// the same samples
+s32 RoundToInt(f32 value) {
+    return static_cast<s32>(std::lrint(value));
+}
+
+// Gains are always worked out from the sample index rather than accumulated, so the vector paths
+// and their tails agree with the scalar one however the buffer is split up
+f32 GainAt(f32 start, f32 step, std::size_t i) {
+    return start + step * static_cast<f32>(i);
+}
+
+template <typename T>
+T ClampSample(f32 value, f32 min, f32 max) {
+    value = value < min ? min : value;
+    value = value > max ? max : value;
+    return static_cast<T>(RoundToInt(value));
+}
+
+// The scalar paths handle whole buffers on CPUs without SSE2 and the tails of the vector paths,
+// starting from sample first
+void ApplyU8Scalar(u8* samples, std::size_t first, std::size_t count, f32 start, f32 step) {
+    for (std::size_t i = first; i < count; i++) {
+        const auto gain = GainAt(start, step, i);
+        const auto centered = static_cast<f32>(static_cast<s32>(samples[i]) - 128) * gain;
+        samples[i] = static_cast<u8>(ClampSample<s32>(centered, -128.0f, 127.0f) + 128);
+    }
+}
+
+void ApplyS16Scalar(s16* samples, std::size_t first, std::size_t count, f32 start, f32 step) {
+    for (std::size_t i = first; i < count; i++) {
+        const auto gain = GainAt(start, step, i);
+        samples[i] = ClampSample<s16>(static_cast<f32>(samples[i]) * gain, -32768.0f, 32767.0f);
+    }
+}
+
+void ApplyS32Scalar(s32* samples, std::size_t first, std::size_t count, f32 start, f32 step) {
+    for (std::size_t i = first; i < count; i++) {
+        const auto gain = GainAt(start, step, i);
+        samples[i] = ClampSample<s32>(static_cast<f32>(samples[i]) * gain, -2147483648.0f,
+                                      S32_MAX_AS_FLOAT);
+    }
+}
+
+void ApplyF32Scalar(f32* samples, std::size_t first, std::size_t count, f32 start, f32 step) {
+    for (std::size_t i = first; i < count; i++) {
+        samples[i] *= GainAt(start, step, i);
+    }
+}
+
+#if VIDEC_ARCH_X86
+/// Gains for the next 4 samples, worked out from their indices exactly like GainAt
+struct GainVector {
+    GainVector(f32 start, f32 step)
+        : start(_mm_set1_ps(start)), step(_mm_set1_ps(step)), index(_mm_set_epi32(3, 2, 1, 0)) {}
+
+    __m128 Next() {
+        const auto gains = _mm_add_ps(start, _mm_mul_ps(step, _mm_cvtepi32_ps(index)));
+        index = _mm_add_epi32(index, _mm_set1_epi32(4));
+        return gains;
+    }
+
+    __m128 start;
+    __m128 step;
+    __m128i index;
+};
+
+void ApplyU8SSE2(u8* samples, std::size_t count, f32 gain, f32 step) {
+    GainVector gains(gain, step);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+        const __m128i lo16 = _mm_sub_epi16(_mm_unpacklo_epi8(packed, zero), bias);
+        const __m128i hi16 = _mm_sub_epi16(_mm_unpackhi_epi8(packed, zero), bias);
+
+        // Sign extend the centered samples up to 32 bits so they can be scaled as floats
+        __m128i words[4] = {
+            _mm_srai_epi32(_mm_unpacklo_epi16(lo16, lo16), 16),
+            _mm_srai_epi32(_mm_unpackhi_epi16(lo16, lo16), 16),
+            _mm_srai_epi32(_mm_unpacklo_epi16(hi16, hi16), 16),
+            _mm_srai_epi32(_mm_unpackhi_epi16(hi16, hi16), 16),
+        };
+        for (auto& word : words) {
+            word = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(word), gains.Next()));
+        }
+
+        // Saturating packs clamp back into range before the bias is added back
+        const __m128i out_lo = _mm_add_epi16(_mm_packs_epi32(words[0], words[1]), bias);
+        const __m128i out_hi = _mm_add_epi16(_mm_packs_epi32(words[2], words[3]), bias);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(samples + i),
+                         _mm_packus_epi16(out_lo, out_hi));
+    }
+    ApplyU8Scalar(samples, i, count, gain, step);
+}
+
+void ApplyS16SSE2(s16* samples, std::size_t count, f32 gain, f32 step) {
+    GainVector gains(gain, step);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(packed, packed), 16);
+        const __m128i scaled_lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(lo), gains.Next()));
+        const __m128i scaled_hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(hi), gains.Next()));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(samples + i),
+                         _mm_packs_epi32(scaled_lo, scaled_hi));
+    }
+    ApplyS16Scalar(samples, i, count, gain, step);
+}
+
+void ApplyS32SSE2(s32* samples, std::size_t count, f32 gain, f32 step) {
+    GainVector gains(gain, step);
+    const __m128 max = _mm_set1_ps(S32_MAX_AS_FLOAT);
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        auto* ptr = reinterpret_cast<__m128i*>(samples + i);
+        const __m128 scaled = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(ptr)), gains.Next());
+        _mm_storeu_si128(ptr, _mm_cvtps_epi32(_mm_min_ps(scaled, max)));
+    }
+    ApplyS32Scalar(samples, i, count, gain, step);
+}
+
+void ApplyF32SSE2(f32* samples, std::size_t count, f32 gain, f32 step) {
+    GainVector gains(gain, step);
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), gains.Next()));
+    }
+    ApplyF32Scalar(samples, i, count, gain, step);
+}
+#endif
+
+// Kernels all take the raw bytes and cast them to the sample type themselves
+template <typename T, void (*Func)(T*, std::size_t, std::size_t, f32, f32)>
+void ScalarKernel(u8* samples, std::size_t count, f32 start, f32 step) {
+    Func(reinterpret_cast<T*>(samples), 0, count, start, step);
+}
+
+constexpr Kernels SCALAR_KERNELS{
+    Blit::Isa::Scalar,
+    "scalar",
+    ScalarKernel<u8, ApplyU8Scalar>,
+    ScalarKernel<s16, ApplyS16Scalar>,
+    ScalarKernel<s32, ApplyS32Scalar>,
+    ScalarKernel<f32, ApplyF32Scalar>,
+};
+#if VIDEC_ARCH_X86
+template <typename T, void (*Func)(T*, std::size_t, f32, f32)>
+void VectorKernel(u8* samples, std::size_t count, f32 start, f32 step) {
+    Func(reinterpret_cast<T*>(samples), count, start, step);
+}
+
+constexpr Kernels SSE2_KERNELS{
+    Blit::Isa::SSE2,
+    "sse2",
+    VectorKernel<u8, ApplyU8SSE2>,
+    VectorKernel<s16, ApplyS16SSE2>,
+    VectorKernel<s32, ApplyS32SSE2>,
+    VectorKernel<f32, ApplyF32SSE2>,
+};
+#endif
+
+const Kernels& SelectKernels() {
+    if (const auto* kernels = AudioGain::GetKernels(Blit::Isa::SSE2)) {
+        return *kernels;
+    }
+    return SCALAR_KERNELS;
+}
+
+} // Anonymous namespace
+
+const Kernels& GetKernels() {
+    static const Kernels& kernels = SelectKernels();
+    return kernels;
+}
+
+const Kernels* GetKernels(Blit::Isa isa) {
+    switch (isa) {
+    case Blit::Isa::Scalar:
+        return &SCALAR_KERNELS;
+#if VIDEC_ARCH_X86
+    case Blit::Isa::SSE2:
+        return GetCpuFeatures().sse2 ? &SSE2_KERNELS : nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+void Apply(u8* data, std::size_t size, SDL_AudioFormat format, f32 start_gain, f32 end_gain,
+           const Kernels& kernels) {
+    const auto sample_size = static_cast<std::size_t>(SDL_AUDIO_BITSIZE(format) / 8);
+    if (data == nullptr || sample_size == 0 || size < sample_size) {
+        return;
+    }
+
+    const auto count = size / sample_size;
+    if (start_gain == 1.0f && end_gain == 1.0f) {
+        return;
+    }
+
+    // The ramp is spread over every sample rather than every sample frame, the gain difference
+    // between the channels of a frame is far too small to hear
+    const auto step = count > 1 ? (end_gain - start_gain) / static_cast<f32>(count - 1) : 0.0f;
+
+    switch (format) {
+    case AUDIO_U8:
+        kernels.apply_u8(data, count, start_gain, step);
+        break;
+    case AUDIO_S16:
+        kernels.apply_s16(data, count, start_gain, step);
+        break;
+    case AUDIO_S32:
+        kernels.apply_s32(data, count, start_gain, step);
+        break;
+    case AUDIO_F32:
+        kernels.apply_f32(data, count, start_gain, step);
+        break;
+    default:
+        break;
+    }
+}
+
+} // namespace AudioGain
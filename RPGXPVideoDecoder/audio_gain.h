@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+
+#include <SDL_audio.h>
+#include "blit_kernels.h"
+#include "common_types.h"
+
+namespace AudioGain {
+
+/// Scales count samples in place, the gain of sample i being start + step * i
+using ApplyFunc = void (*)(u8* samples, std::size_t count, f32 start, f32 step);
+
+/// Kernels for each sample format. Every set rounds and clamps the same way, so they all give
+/// exactly the same output
+struct Kernels {
+    Blit::Isa isa{};
+    const char* name{};
+    ApplyFunc apply_u8{};
+    ApplyFunc apply_s16{};
+    ApplyFunc apply_s32{};
+    ApplyFunc apply_f32{};
+};
+
+/// Best kernels for the running CPU, picked once on first use
+const Kernels& GetKernels();
+
+/// Kernels for a specific instruction set or nullptr if the CPU doesn't support it, there's no
+/// AVX2 set as SSE2 already keeps up with the device
+const Kernels* GetKernels(Blit::Isa isa);
+
+/// Scales interleaved PCM in place, ramping linearly from start_gain on the first sample to
+/// end_gain on the last one so volume changes don't click. Gains are expected to be in [0, 1].
+/// Supports AUDIO_U8, AUDIO_S16, AUDIO_S32 and AUDIO_F32, other formats are left untouched.
+void Apply(u8* data, std::size_t size, SDL_AudioFormat format, f32 start_gain, f32 end_gain,
+           const Kernels& kernels = GetKernels());
+
+} // namespace AudioGain
@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <cstring>
+#include "audio_gain.h"
+#include "audio_output.h"
+#include "media_clock.h"
+
+PcmRing::PcmRing(std::size_t min_capacity) {
+    // Round up to a power of two so the indices can wrap with a mask
+    capacity = 1;
+    while (capacity < min_capacity) {
+        capacity <<= 1;
+    }
+    mask = capacity - 1;
+    buffer = std::make_unique<u8[]>(capacity);
+}
+
+std::size_t PcmRing::Write(const u8* data, std::size_t size) {
+    const auto head = write_index.load(std::memory_order_relaxed);
+    const auto tail = read_index.load(std::memory_order_acquire);
+    const auto to_write = std::min<std::size_t>(size, capacity - (head - tail));
+
+    // The write can straddle the end of the buffer, so it might need to be split in two
+    const auto offset = head & mask;
+    const auto first = std::min<std::size_t>(to_write, capacity - offset);
+    std::memcpy(buffer.get() + offset, data, first);
+    std::memcpy(buffer.get(), data + first, to_write - first);
+
+    write_index.store(head + to_write, std::memory_order_release);
+    return to_write;
+}
+
+std::size_t PcmRing::Read(u8* data, std::size_t size) {
+    const auto tail = read_index.load(std::memory_order_relaxed);
+    const auto head = write_index.load(std::memory_order_acquire);
+    const auto to_read = std::min<std::size_t>(size, head - tail);
+
+    const auto offset = tail & mask;
+    const auto first = std::min<std::size_t>(to_read, capacity - offset);
+    std::memcpy(data, buffer.get() + offset, first);
+    std::memcpy(data + first, buffer.get(), to_read - first);
+
+    read_index.store(tail + to_read, std::memory_order_release);
+    return to_read;
+}
+
+void PcmRing::Clear() {
+    read_index.store(write_index.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+std::size_t PcmRing::GetBuffered() const {
+    const auto tail = read_index.load(std::memory_order_acquire);
+    return write_index.load(std::memory_order_acquire) - tail;
+}
+
+std::size_t PcmRing::GetFree() const {
+    return capacity - GetBuffered();
+}
+
+std::size_t PcmRing::GetCapacity() const {
+    return capacity;
+}
+
+AudioOutput::AudioOutput() = default;
+
+AudioOutput::~AudioOutput() {
+    Close();
+}
+
+bool AudioOutput::Open(s32 frequency, SDL_AudioFormat format, u8 channels, u16 buffer_samples,
+                       std::size_t ring_size) {
+    Close();
+
+    SDL_AudioSpec desired{};
+    desired.freq = frequency;
+    desired.format = format;
+    desired.channels = channels;
+    desired.samples = buffer_samples;
+    desired.callback = DeviceCallback;
+    desired.userdata = this;
+
+    // We don't allow any changes so SDL converts for us if the device wants something else, that
+    // way the ring is always in the format we decode to
+    device = SDL_OpenAudioDevice(NULL, 0, &desired, &spec, 0);
+    if (device == 0) {
+        return false;
+    }
+
+    // Start at the requested volume rather than fading in from wherever the last stream ended
+    current_gain = target_gain.load();
+
+    bytes_per_second = static_cast<std::size_t>(spec.freq) * spec.channels *
+                       (SDL_AUDIO_BITSIZE(spec.format) / 8);
+    ring = std::make_unique<PcmRing>(ring_size);
+    buffer_seconds = static_cast<double>(spec.samples) / static_cast<double>(spec.freq);
+    consumed_bytes.store(0);
+    last_fill_complete.store(false);
+    paused.store(true);
+    ended.store(false);
+    refilling.store(true);
+    return true;
+}
+
+void AudioOutput::Close() {
+    if (device != 0) {
+        // Closing waits for any running callback, so the ring is safe to release afterwards
+        SDL_CloseAudioDevice(device);
+        device = 0;
+    }
+    ring.reset();
+}
+
+void AudioOutput::Pause(bool paused) {
+    this->paused.store(paused);
+    if (device != 0) {
+        SDL_PauseAudioDevice(device, paused ? 1 : 0);
+    }
+}
+
+void AudioOutput::SetVolume(f32 volume) {
+    volume = volume < 0.0f ? 0.0f : volume;
+    volume = volume > 1.0f ? 1.0f : volume;
+    target_gain.store(volume);
+}
+
+std::size_t AudioOutput::Write(const u8* data, std::size_t size) {
+    if (size != 0) {
+        ended.store(false);
+    }
+    return ring ? ring->Write(data, size) : 0;
+}
+
+void AudioOutput::MarkEnded() {
+    ended.store(true);
+}
+
+std::size_t AudioOutput::GetBuffered() const {
+    return ring ? ring->GetBuffered() : 0;
+}
+
+std::size_t AudioOutput::GetFree() const {
+    return ring ? ring->GetFree() : 0;
+}
+
+std::size_t AudioOutput::GetCapacity() const {
+    return ring ? ring->GetCapacity() : 0;
+}
+
+std::size_t AudioOutput::GetBytesPerSecond() const {
+    return bytes_per_second;
+}
+
+const SDL_AudioSpec& AudioOutput::GetSpec() const {
+    return spec;
+}
+
+u64 AudioOutput::GetUnderruns() const {
+    return underruns.load();
+}
+
+bool AudioOutput::GetPlayedSeconds(double now, double& seconds) const {
+    if (bytes_per_second == 0 || !last_fill_complete.load()) {
+        return false;
+    }
+
+    u32 sequence{};
+    u64 consumed_count{};
+    double fill_time{};
+    do {
+        sequence = fill_sequence.load(std::memory_order_acquire);
+        consumed_count = consumed_bytes.load(std::memory_order_acquire);
+        fill_time = last_fill_time.load(std::memory_order_acquire);
+    } while ((sequence & 1) != 0 || sequence != fill_sequence.load(std::memory_order_acquire));
+
+    // Callbacks stop while the device is paused, so a stale one means we can't extrapolate
+    const double since_fill = now - fill_time;
+    if (since_fill < 0.0 || since_fill > buffer_seconds * 2.0 + STALE_CALLBACK_SLACK) {
+        return false;
+    }
+
+    const double consumed =
+        static_cast<double>(consumed_count) / static_cast<double>(bytes_per_second);
+    const double playing = since_fill < buffer_seconds ? since_fill : buffer_seconds;
+    seconds = consumed - buffer_seconds + playing;
+    if (seconds < 0.0) {
+        seconds = 0.0;
+    }
+    return true;
+}
+
+void AudioOutput::Flush() {
+    if (device == 0) {
+        return;
+    }
+
+    // Locking keeps the callback out, and the producer is the one flushing, so nobody else can
+    // be touching the ring while we clear it
+    SDL_LockAudioDevice(device);
+    ring->Clear();
+    fill_sequence.fetch_add(1, std::memory_order_acq_rel);
+    consumed_bytes.store(0, std::memory_order_release);
+    fill_sequence.fetch_add(1, std::memory_order_acq_rel);
+    last_fill_complete.store(false);
+    ended.store(false);
+    refilling.store(true);
+    SDL_UnlockAudioDevice(device);
+}
+
+void AudioOutput::WaitForDrain() {
+    drained_event.Wait();
+}
+
+void AudioOutput::Wake() {
+    drained_event.Set();
+}
+
+void SDLCALL AudioOutput::DeviceCallback(void* userdata, Uint8* stream, int len) {
+    static_cast<AudioOutput*>(userdata)->Fill(stream, static_cast<std::size_t>(len));
+}
+
+void AudioOutput::Fill(u8* stream, std::size_t size) {
+    const auto read = ring->Read(stream, size);
+    fill_sequence.fetch_add(1, std::memory_order_acq_rel);
+    consumed_bytes.fetch_add(read, std::memory_order_release);
+    last_fill_time.store(Platform::GetMonotonicSeconds(), std::memory_order_release);
+    fill_sequence.fetch_add(1, std::memory_order_acq_rel);
+    last_fill_complete.store(read == size);
+    if (read != 0) {
+        drained_event.Set();
+    }
+
+    // Ramp across the whole buffer so volume changes don't click
+    const auto gain = target_gain.load();
+    AudioGain::Apply(stream, read, spec.format, current_gain, gain);
+    current_gain = gain;
+
+    if (read == size) {
+        refilling.store(false);
+        return;
+    }
+
+    // Play silence rather than whatever was left in the buffer, it's only an underrun if the
+    // decoder fell behind on audio that is still to come
+    std::memset(stream + read, spec.silence, size - read);
+    if (!paused.load() && !ended.load() && !refilling.load()) {
+        underruns++;
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <atomic>
+#include <memory>
+
+#include <SDL_audio.h>
+#include "common_types.h"
+#include "platform.h"
+
+/// Lock-free single producer, single consumer ring of raw PCM bytes. The storage is allocated
+/// once up front, the decoder writes into it and the SDL audio thread reads from it.
+class PcmRing {
+public:
+    explicit PcmRing(std::size_t min_capacity = 0);
+
+    /// Producer: copies as much of data as fits, returns the number of bytes written
+    std::size_t Write(const u8* data, std::size_t size);
+
+    /// Consumer: copies up to size bytes out of the ring, returns the number of bytes read
+    std::size_t Read(u8* data, std::size_t size);
+
+    /// Consumer: drops everything that has been written so far
+    void Clear();
+
+    std::size_t GetBuffered() const;
+    std::size_t GetFree() const;
+    std::size_t GetCapacity() const;
+
+private:
+    std::unique_ptr<u8[]> buffer;
+    std::size_t capacity{};
+    std::size_t mask{};
+
+    alignas(64) std::atomic<std::size_t> write_index{0};
+    alignas(64) std::atomic<std::size_t> read_index{0};
+};
+
+/// SDL audio device running in pull mode, the device callback drains a PcmRing that the decoder
+/// keeps topped up so audio delivery doesn't depend on when video frames get presented.
+class AudioOutput {
+public:
+    AudioOutput();
+    ~AudioOutput();
+
+    AudioOutput(const AudioOutput&) = delete;
+    AudioOutput& operator=(const AudioOutput&) = delete;
+
+    /// Opens the default device paused with a PCM ring of at least ring_size bytes
+    bool Open(s32 frequency, SDL_AudioFormat format, u8 channels, u16 buffer_samples,
+              std::size_t ring_size);
+    void Close();
+
+    void Pause(bool paused);
+
+    /// Volume in [0, 1], applied by the device callback so changes are heard within one buffer
+    void SetVolume(f32 volume);
+
+    /// Producer side of the PCM ring
+    std::size_t Write(const u8* data, std::size_t size);
+    std::size_t GetBuffered() const;
+    std::size_t GetFree() const;
+    std::size_t GetCapacity() const;
+
+    /// Bytes of audio per second in the devices format
+    std::size_t GetBytesPerSecond() const;
+    const SDL_AudioSpec& GetSpec() const;
+    u64 GetUnderruns() const;
+
+    /// Seconds of ring audio the device has played by the time now (from GetMonotonicSeconds),
+    /// interpolated between callbacks. Returns false if the device isn't currently playing from
+    /// the ring, such as while paused, before the first callback or after an underrun
+    bool GetPlayedSeconds(double now, double& seconds) const;
+
+    /// Blocks the producer until the device has taken something out of the ring or Wake is
+    /// called, nothing is taken out while the device is paused
+    void WaitForDrain();
+    void Wake();
+
+    /// Producer: throws away everything in the ring and restarts the played count, for seeking.
+    /// The ring running dry doesn't count as an underrun again until the device has been handed a
+    /// full buffer
+    void Flush();
+
+    /// Producer: nothing more is coming until the next Write or Flush, so the ring running dry
+    /// from here on is the end of the audio rather than an underrun
+    void MarkEnded();
+
+private:
+    static void SDLCALL DeviceCallback(void* userdata, Uint8* stream, int len);
+    void Fill(u8* stream, std::size_t size);
+
+    SDL_AudioDeviceID device{};
+    SDL_AudioSpec spec{};
+    std::size_t bytes_per_second{};
+    std::unique_ptr<PcmRing> ring;
+    std::atomic<u64> underruns{0};
+
+    // The callback only counts an underrun while more audio is expected, not while paused, after
+    // the producer has written the last of it, or while refilling after a flush
+    std::atomic<bool> paused{true};
+    std::atomic<bool> ended{false};
+    std::atomic<bool> refilling{true};
+    Platform::Event drained_event{};
+
+    // Updated by every callback, the device is assumed to play the buffer it was just handed
+    // after the one it's currently playing. The sequence is odd while an update is in progress so
+    // readers can retry instead of pairing a new count with an old time
+    std::atomic<u32> fill_sequence{0};
+    std::atomic<u64> consumed_bytes{0};
+    std::atomic<double> last_fill_time{};
+    std::atomic<bool> last_fill_complete{false};
+    double buffer_seconds{};
+
+    // The target is set from any thread, the callback ramps its current gain towards it over the
+    // course of one device buffer
+    std::atomic<f32> target_gain{1.0f};
+    f32 current_gain{1.0f};
+
+    // Allowance for scheduling delays before a late callback counts as the device having stopped
+    static constexpr double STALE_CALLBACK_SLACK = 0.05;
+};
@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "baked_video.h"
+#include "lz4_block.h"
+
+bool BakedVideo::IsBaked(const char* path) {
+    const auto file = Platform::File::OpenRead(path);
+    u32 magic{};
+    return file && file->Read(&magic, sizeof(magic)) == static_cast<s64>(sizeof(magic)) &&
+           magic == BAKED_MAGIC;
+}
+
+std::unique_ptr<BakedVideo> BakedVideo::Open(const char* path) {
+    std::unique_ptr<BakedVideo> video(new BakedVideo());
+    video->file = Platform::MappedFile::Open(path, true);
+    if (!video->file || video->file->GetSize() < sizeof(BakedHeader)) {
+        return nullptr;
+    }
+
+    const u8* data = video->file->GetData();
+    const u64 size = video->file->GetSize();
+    auto& header = video->header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != BAKED_MAGIC || header.version != BAKED_VERSION ||
+        header.header_size < sizeof(BakedHeader) || header.width == 0 || header.height == 0) {
+        return nullptr;
+    }
+
+    // Everything has to lie inside the file, so playback never has to check again beyond the
+    // frame being asked for
+    const auto fits = [size](u64 offset, u64 length) {
+        return offset <= size && length <= size - offset;
+    };
+    const u64 index_size = static_cast<u64>(header.frame_count) * sizeof(BakedFrameEntry);
+    if (header.frame_count == 0 || !fits(header.index_offset, index_size) ||
+        !fits(header.audio_offset, header.audio_size) ||
+        header.index_offset % alignof(BakedFrameEntry) != 0) {
+        return nullptr;
+    }
+
+    video->frames = reinterpret_cast<const BakedFrameEntry*>(data + header.index_offset);
+    const u64 frame_bytes = static_cast<u64>(header.width) * header.height * 4;
+    for (u32 i = 0; i < header.frame_count; i++) {
+        const auto& entry = video->frames[i];
+        if (!fits(entry.offset, entry.size) ||
+            ((entry.flags & BAKED_FRAME_COMPRESSED) == 0 && entry.size != frame_bytes)) {
+            return nullptr;
+        }
+    }
+    return video;
+}
+
+const BakedHeader& BakedVideo::GetHeader() const {
+    return header;
+}
+
+std::size_t BakedVideo::GetFrameCount() const {
+    return header.frame_count;
+}
+
+double BakedVideo::GetFrameTimestamp(std::size_t frame) const {
+    return static_cast<double>(frames[frame].timestamp_us) / 1000000.0;
+}
+
+double BakedVideo::GetDuration() const {
+    return static_cast<double>(header.duration_us) / 1000000.0;
+}
+
+std::size_t BakedVideo::FindFrame(double timestamp) const {
+    const auto target = static_cast<s64>(std::ceil(timestamp * 1000000.0));
+    const auto* end = frames + header.frame_count;
+    const auto* it = std::lower_bound(
+        frames, end, target,
+        [](const BakedFrameEntry& entry, s64 value) { return entry.timestamp_us < value; });
+    return static_cast<std::size_t>(it - frames);
+}
+
+bool BakedVideo::CopyFrame(std::size_t frame, const Blit::Surface& dst) const {
+    if (frame >= header.frame_count || dst.top_line == nullptr || dst.width != header.width ||
+        dst.height != header.height) {
+        return false;
+    }
+
+    const auto& entry = frames[frame];
+    const u8* src = file->GetData() + entry.offset;
+    const auto row_bytes = static_cast<std::ptrdiff_t>(header.width) * 4;
+    const auto frame_bytes = static_cast<std::size_t>(row_bytes) * header.height;
+
+    if ((entry.flags & BAKED_FRAME_COMPRESSED) == 0) {
+        // Stored bottom-up, so the top line is the last one in the file
+        Blit::CopyImage(dst, src + (header.height - 1) * row_bytes, -row_bytes);
+        return true;
+    }
+
+    // Compressed frames are laid out exactly like the bitmaps memory, which starts at its bottom
+    // line, so they can be decompressed into it in one go. Any other layout is written a row at a
+    // time, still starting from the bottom line
+    u8* bitmap_start = dst.top_line + static_cast<std::ptrdiff_t>(header.height - 1) * dst.pitch;
+    if (dst.pitch == -row_bytes) {
+        return Lz4::Decompress(src, entry.size, bitmap_start, frame_bytes);
+    }
+    return Lz4::DecompressRows(src, entry.size, bitmap_start, -dst.pitch,
+                               static_cast<std::size_t>(row_bytes), header.height);
+}
+
+bool BakedVideo::HasAudio() const {
+    return header.audio_frequency != 0 && header.audio_size != 0;
+}
+
+const u8* BakedVideo::GetAudio() const {
+    return file->GetData() + header.audio_offset;
+}
+
+std::size_t BakedVideo::GetAudioSize() const {
+    return static_cast<std::size_t>(header.audio_size);
+}
+
+BakedVideoWriter::~BakedVideoWriter() {
+    // Anything left open never made it to Finish, so don't leave half a video behind
+    if (file) {
+        file.reset();
+        std::remove(path.c_str());
+    }
+}
+
+bool BakedVideoWriter::Open(const char* file_path, u32 width, u32 height, bool compress_frames) {
+    file = Platform::File::OpenWrite(file_path);
+    if (!file) {
+        return false;
+    }
+    path = file_path;
+    header.width = width;
+    header.height = height;
+    compress = compress_frames;
+
+    // The real header goes in once we know where everything ended up
+    return Write(&header, sizeof(header));
+}
+
+bool BakedVideoWriter::AddFrame(const u8* frame, double timestamp) {
+    const std::size_t frame_bytes = static_cast<std::size_t>(header.width) * header.height * 4;
+
+    BakedFrameEntry entry{};
+    entry.offset = offset;
+    entry.timestamp_us = static_cast<s64>(std::llround(timestamp * 1000000.0));
+
+    // Frames that don't get any smaller are stored as they are
+    std::size_t compressed_size = 0;
+    if (compress) {
+        compressed.resize(Lz4::CompressBound(frame_bytes));
+        compressed_size =
+            Lz4::Compress(frame, frame_bytes, compressed.data(), compressed.size());
+    }
+    if (compressed_size != 0 && compressed_size < frame_bytes) {
+        entry.size = static_cast<u32>(compressed_size);
+        entry.flags = BAKED_FRAME_COMPRESSED;
+        header.flags |= BAKED_FLAG_COMPRESSED;
+        if (!Write(compressed.data(), compressed_size)) {
+            return false;
+        }
+    } else {
+        entry.size = static_cast<u32>(frame_bytes);
+        if (!Write(frame, frame_bytes)) {
+            return false;
+        }
+    }
+    entries.push_back(entry);
+    return true;
+}
+
+void BakedVideoWriter::SetAudioFormat(u32 frequency, u32 format, u32 channels) {
+    header.audio_frequency = frequency;
+    header.audio_format = format;
+    header.audio_channels = channels;
+}
+
+void BakedVideoWriter::AddAudio(const u8* data, std::size_t size) {
+    audio.insert(audio.end(), data, data + size);
+}
+
+bool BakedVideoWriter::Finish(double duration, double frame_duration) {
+    if (entries.empty()) {
+        return false;
+    }
+
+    header.audio_offset = offset;
+    header.audio_size = audio.size();
+    if (!audio.empty() && !Write(audio.data(), audio.size())) {
+        return false;
+    }
+
+    // Keep the index aligned so it can be used straight out of the mapping
+    static constexpr u8 PADDING[alignof(BakedFrameEntry)]{};
+    const auto padding = static_cast<std::size_t>(-offset % alignof(BakedFrameEntry));
+    if (padding != 0 && !Write(PADDING, padding)) {
+        return false;
+    }
+    header.index_offset = offset;
+    header.frame_count = static_cast<u32>(entries.size());
+    if (!Write(entries.data(), entries.size() * sizeof(BakedFrameEntry))) {
+        return false;
+    }
+
+    header.duration_us =
+        static_cast<u64>(std::llround(std::max<double>(duration, 0.0) * 1000000.0));
+    header.frame_duration_us = static_cast<u32>(std::llround(frame_duration * 1000000.0));
+
+    if (!file->SetPosition(0) || !file->Write(&header, sizeof(header))) {
+        return false;
+    }
+    file.reset();
+    return true;
+}
+
+bool BakedVideoWriter::Write(const void* data, std::size_t size) {
+    if (!file->Write(data, size)) {
+        return false;
+    }
+    offset += size;
+    return true;
+}
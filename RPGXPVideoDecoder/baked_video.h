@@ -0,0 +1,121 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "blit_kernels.h"
+#include "common_types.h"
+#include "platform.h"
+
+/// Baked videos hold frames already converted for one bitmap size, so playing them back is a copy
+/// straight into the bitmap with no codec work at all. The file starts with a BakedHeader, frames
+/// are BGRA in the bitmaps own bottom-up memory order, each optionally LZ4 compressed, followed by
+/// the PCM in the format the audio device is opened with and finally a BakedFrameEntry per frame.
+constexpr u32 BAKED_MAGIC = 0x4b425852; // "RXBK"
+constexpr u32 BAKED_VERSION = 1;
+
+/// BakedHeader::flags, set when at least one frame is compressed
+constexpr u32 BAKED_FLAG_COMPRESSED = 1;
+/// BakedFrameEntry::flags
+constexpr u32 BAKED_FRAME_COMPRESSED = 1;
+
+struct BakedHeader {
+    u32 magic{BAKED_MAGIC};
+    u32 version{BAKED_VERSION};
+    u32 header_size{sizeof(BakedHeader)};
+    u32 flags{};
+    // Bitmap size the frames were converted for
+    u32 width{};
+    u32 height{};
+    u32 frame_count{};
+    // Nominal time each frame is on screen for, frames carry their own timestamps
+    u32 frame_duration_us{};
+    u64 duration_us{};
+    // SDL_AudioSpec the PCM was written for, frequency is 0 for videos without sound
+    u32 audio_frequency{};
+    u32 audio_format{};
+    u32 audio_channels{};
+    u32 reserved{};
+    u64 audio_offset{};
+    u64 audio_size{};
+    u64 index_offset{};
+};
+static_assert(sizeof(BakedHeader) == 80, "BakedHeader is an invalid size");
+
+struct BakedFrameEntry {
+    u64 offset{};
+    u32 size{};
+    u32 flags{};
+    s64 timestamp_us{};
+};
+static_assert(sizeof(BakedFrameEntry) == 24, "BakedFrameEntry is an invalid size");
+
+/// A baked video mapped into memory for playback. Frames are read straight out of the mapping,
+/// nothing is loaded up front.
+class BakedVideo {
+public:
+    /// Checks the magic at the start of the file, which is all that sets baked videos apart
+    static bool IsBaked(const char* path);
+
+    /// Returns nullptr if the file isn't a baked video this version can play
+    static std::unique_ptr<BakedVideo> Open(const char* path);
+
+    const BakedHeader& GetHeader() const;
+    std::size_t GetFrameCount() const;
+    double GetFrameTimestamp(std::size_t frame) const;
+    double GetDuration() const;
+
+    /// First frame at or after timestamp, GetFrameCount if there's none
+    std::size_t FindFrame(double timestamp) const;
+
+    /// Writes a frame into dst, which has to be the size the video was baked for but can have any
+    /// pitch. Compressed frames are decompressed straight into the bitmap, the rest are copied
+    /// with the blit kernels
+    bool CopyFrame(std::size_t frame, const Blit::Surface& dst) const;
+
+    bool HasAudio() const;
+    const u8* GetAudio() const;
+    std::size_t GetAudioSize() const;
+
+private:
+    BakedVideo() = default;
+
+    std::unique_ptr<Platform::MappedFile> file{};
+    BakedHeader header{};
+    const BakedFrameEntry* frames{nullptr};
+};
+
+/// Writes a baked video one frame at a time. Frames go straight to disk, the audio is held until
+/// Finish as it has to follow the frames.
+class BakedVideoWriter {
+public:
+    BakedVideoWriter() = default;
+    ~BakedVideoWriter();
+
+    BakedVideoWriter(const BakedVideoWriter&) = delete;
+    BakedVideoWriter& operator=(const BakedVideoWriter&) = delete;
+
+    bool Open(const char* path, u32 width, u32 height, bool compress);
+
+    /// frame is width * height BGRA pixels in bottom-up order
+    bool AddFrame(const u8* frame, double timestamp);
+    void SetAudioFormat(u32 frequency, u32 format, u32 channels);
+    void AddAudio(const u8* data, std::size_t size);
+
+    /// Writes out the audio, frame index and header. A writer destroyed before finishing deletes
+    /// its file
+    bool Finish(double duration, double frame_duration);
+
+private:
+    bool Write(const void* data, std::size_t size);
+
+    std::unique_ptr<Platform::File> file{};
+    std::string path{};
+    BakedHeader header{};
+    bool compress{false};
+    u64 offset{};
+    std::vector<BakedFrameEntry> entries{};
+    std::vector<u8> compressed{};
+    std::vector<u8> audio{};
+};
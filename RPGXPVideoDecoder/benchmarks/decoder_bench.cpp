@@ -0,0 +1,307 @@
+// Headless benchmark for the decoder core. Plays a clip into a heap allocated bitmap instead of
+// the engine's, so it runs anywhere the core builds, Linux included. Two passes are made:
+//
+//   decode    every frame is demuxed, decoded and converted as fast as possible, timing each
+//             stage and counting heap allocations per frame
+//   playback  the clip plays through a regular Decoder in real time, with audio going to
+//             whichever SDL driver is picked (dummy unless SDL_AUDIODRIVER says otherwise),
+//             reporting dropped frames, sync and memory the same way the game would see them
+//
+//   decoder_bench <clip> [width] [height] [--decode-only]
+//
+// Clips can be checked in or generated with lavfi, for example
+//   ffmpeg -f lavfi -i testsrc2=size=1280x720:rate=30 -f lavfi -i sine=frequency=440
+//          -t 10 -c:v libx264 -pix_fmt yuv420p -c:a aac clip.mp4
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <SDL.h>
+#include <av.h>
+#include <codeccontext.h>
+#include <formatcontext.h>
+
+#include "decoder.h"
+#include "frame_converter.h"
+#include "frame_sink.h"
+#include "platform.h"
+#include "task_scheduler.h"
+
+namespace {
+
+std::atomic<u64> heap_allocations{0};
+
+// Bottom-up like an RGSS bitmap, so frames take the same path they would in the game
+class FakeBitmap : public FrameSink {
+public:
+    FakeBitmap(std::size_t width, std::size_t height)
+        : width(width), height(height), memory(width * height * 4) {}
+
+    std::size_t GetWidth() const override {
+        return width;
+    }
+
+    std::size_t GetHeight() const override {
+        return height;
+    }
+
+    Blit::Surface GetSurface() const override {
+        const auto stride = static_cast<std::ptrdiff_t>(width * 4);
+        auto* top_line = const_cast<u8*>(memory.data()) + (height - 1) * stride;
+        return Blit::Surface{top_line, -stride, width, height};
+    }
+
+private:
+    std::size_t width;
+    std::size_t height;
+    std::vector<u8> memory;
+};
+
+class StageTimes {
+public:
+    explicit StageTimes(const char* name) : name(name) {}
+
+    void Add(double seconds) {
+        samples.push_back(seconds);
+    }
+
+    void Report() {
+        if (samples.empty()) {
+            std::printf("  %-8s no samples\n", name);
+            return;
+        }
+        std::sort(samples.begin(), samples.end());
+        double total = 0.0;
+        for (const auto sample : samples) {
+            total += sample;
+        }
+        const auto percentile = [this](double p) {
+            const auto last = static_cast<double>(samples.size() - 1);
+            return samples[static_cast<std::size_t>(p * last)] * 1000.0;
+        };
+        std::printf("  %-8s mean %7.3f ms  p50 %7.3f  p95 %7.3f  p99 %7.3f  max %7.3f\n", name,
+                    total / static_cast<double>(samples.size()) * 1000.0, percentile(0.50),
+                    percentile(0.95), percentile(0.99), samples.back() * 1000.0);
+    }
+
+private:
+    const char* name;
+    std::vector<double> samples{};
+};
+
+template <typename Func>
+auto Timed(StageTimes& times, Func&& func) {
+    const double start = Platform::GetMonotonicSeconds();
+    auto result = func();
+    times.Add(Platform::GetMonotonicSeconds() - start);
+    return result;
+}
+
+bool RunDecodePass(const char* path, std::size_t width, std::size_t height) {
+    std::error_code err{};
+    av::FormatContext format_ctx{};
+    format_ctx.openInput(path, err);
+    if (!err) {
+        format_ctx.findStreamInfo(err);
+    }
+    if (err) {
+        std::printf("failed to open %s: %s\n", path, err.message().c_str());
+        return false;
+    }
+
+    av::Stream video_stream{};
+    std::size_t video_index{};
+    for (std::size_t i = 0; i < format_ctx.streamsCount(); i++) {
+        if (format_ctx.stream(i).isVideo()) {
+            video_stream = format_ctx.stream(i);
+            video_index = i;
+            break;
+        }
+    }
+    if (video_stream.isNull()) {
+        std::printf("%s has no video stream\n", path);
+        return false;
+    }
+
+    // Same codec threading the decoder picks for a single video
+    auto& scheduler = TaskScheduler::Get();
+    av::VideoDecoderContext vdec(video_stream);
+    vdec.setCodec(av::findDecodingCodec(vdec.raw()->codec_id));
+    vdec.setRefCountedFrames(true);
+    vdec.raw()->thread_count =
+        static_cast<int>(std::min<std::size_t>(scheduler.GetWorkerCount() + 1, 16));
+    vdec.raw()->thread_type = static_cast<int>(VIDEO_THREAD_FRAME | VIDEO_THREAD_SLICE);
+    vdec.open(av::Codec(), err);
+    if (err) {
+        std::printf("failed to open the video codec: %s\n", err.message().c_str());
+        return false;
+    }
+
+    const auto cores = std::max<u32>(std::thread::hardware_concurrency(), 1);
+    FrameConverter converter(width, height, &scheduler, std::min<u32>(cores / 2, 4) + 1);
+    FakeBitmap bitmap(width, height);
+    const auto surface = bitmap.GetSurface();
+
+    StageTimes demux_times{"demux"};
+    StageTimes decode_times{"decode"};
+    StageTimes convert_times{"convert"};
+    std::size_t frames = 0;
+    std::size_t failed_conversions = 0;
+    const auto convert = [&](const av::VideoFrame& frame) {
+        const bool converted = Timed(convert_times, [&] {
+            return converter.Convert(frame, surface.top_line, surface.pitch);
+        });
+        failed_conversions += converted ? 0 : 1;
+        frames++;
+    };
+
+    const u64 allocations_before = heap_allocations.load();
+    const double start = Platform::GetMonotonicSeconds();
+    while (true) {
+        auto pkt = Timed(demux_times, [&] { return format_ctx.readPacket(err); });
+        if (err || !pkt) {
+            break;
+        }
+        if (pkt.streamIndex() != video_index) {
+            continue;
+        }
+        auto frame = Timed(decode_times, [&] { return vdec.decode(pkt, err); });
+        if (!err && frame) {
+            convert(frame);
+        }
+    }
+    // Threaded codecs hold on to a few frames until they're drained
+    while (true) {
+        auto frame = Timed(decode_times, [&] { return vdec.decode(av::Packet{}, err); });
+        if (err || !frame) {
+            break;
+        }
+        convert(frame);
+    }
+    const double elapsed = Platform::GetMonotonicSeconds() - start;
+    const u64 allocations = heap_allocations.load() - allocations_before;
+
+    std::printf("decode pass: %zu frames in %.3f s, %.1f fps\n", frames, elapsed,
+                elapsed > 0.0 ? static_cast<double>(frames) / elapsed : 0.0);
+    demux_times.Report();
+    decode_times.Report();
+    convert_times.Report();
+    std::printf("  heap allocations %llu (%.1f per frame), failed conversions %zu\n",
+                static_cast<unsigned long long>(allocations),
+                frames != 0 ? static_cast<double>(allocations) / static_cast<double>(frames) : 0.0,
+                failed_conversions);
+    return frames != 0 && failed_conversions == 0;
+}
+
+bool RunPlaybackPass(const char* path, std::size_t width, std::size_t height) {
+    Decoder decoder(std::make_unique<FakeBitmap>(width, height), DecoderSettings{});
+    std::string video_path{path};
+    const auto result = decoder.Setup(video_path.data());
+    if (result != ErrorCode::Success) {
+        std::printf("playback setup failed with error %d\n", static_cast<int>(result));
+        return false;
+    }
+
+    const u64 allocations_before = heap_allocations.load();
+    const double start = Platform::GetMonotonicSeconds();
+    decoder.StartRender();
+    while (!decoder.IsCompleted()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    const double elapsed = Platform::GetMonotonicSeconds() - start;
+    const u64 allocations = heap_allocations.load() - allocations_before;
+
+    SyncStats sync{};
+    decoder.GetSyncStats(sync);
+    std::printf("playback pass: %.3f s, %u frames presented, %s clock\n", elapsed,
+                sync.presented_frames, sync.audio_master != 0 ? "audio" : "monotonic");
+    std::printf("  dropped %llu, skipped %llu, discarded %llu\n",
+                static_cast<unsigned long long>(decoder.GetDroppedFrames()),
+                static_cast<unsigned long long>(decoder.GetSkippedFrames()),
+                static_cast<unsigned long long>(decoder.GetDiscardedFrames()));
+    std::printf("  drift average %d us, max %u us, jitter %u us\n", sync.average_drift_us,
+                sync.max_drift_us, sync.frame_jitter_us);
+    std::printf("  heap allocations %llu, pooled buffer growth %llu\n",
+                static_cast<unsigned long long>(allocations),
+                static_cast<unsigned long long>(decoder.GetPlaybackAllocations()));
+    std::printf("  peak working set %.1f MiB, peak buffered %.1f MiB\n",
+                static_cast<double>(decoder.GetPeakWorkingSet()) / (1024.0 * 1024.0),
+                static_cast<double>(decoder.GetPeakBufferedBytes()) / (1024.0 * 1024.0));
+
+    PlaybackStats stats{};
+    decoder.GetStats(stats);
+    const auto report_stage = [](const char* name, const StageTimings& timings) {
+        if (timings.samples != 0) {
+            std::printf("  %-8s mean %7u us  p95 %7u  p99 %7u  max %7u\n", name, timings.mean_us,
+                        timings.p95_us, timings.p99_us, timings.max_us);
+        }
+    };
+    report_stage("demux", stats.demux);
+    report_stage("decode", stats.decode);
+    report_stage("rescale", stats.rescale);
+    report_stage("blit", stats.blit);
+    std::printf("  audio underruns %u, video decode errors %u\n", stats.audio_underruns,
+                stats.decode_errors);
+    return !decoder.WasBadTermination();
+}
+
+} // Anonymous namespace
+
+// Counts every heap allocation in the process, the passes report the difference
+void* operator new(std::size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size != 0 ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::printf("usage: %s <clip> [width] [height] [--decode-only]\n", argv[0]);
+        return 2;
+    }
+    const char* path = argv[1];
+    const std::size_t width = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 640;
+    const std::size_t height = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 480;
+    const bool decode_only = argc > 4 && std::strcmp(argv[4], "--decode-only") == 0;
+    if (width == 0 || height == 0) {
+        std::printf("width and height have to be non zero\n");
+        return 2;
+    }
+
+    av::init();
+
+    // No sound card is needed unless one is asked for
+    if (SDL_getenv("SDL_AUDIODRIVER") == nullptr) {
+        SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+    }
+    SDL_Init(SDL_INIT_AUDIO);
+
+    std::printf("%s into %zux%zu, %zu workers\n", path, width, height,
+                TaskScheduler::Get().GetWorkerCount());
+    bool ok = RunDecodePass(path, width, height);
+    if (ok && !decode_only) {
+        ok = RunPlaybackPass(path, width, height);
+    }
+
+    TaskScheduler::Shutdown();
+    SDL_Quit();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,215 @@
+// Microbenchmark for the built-in YUV to BGRA kernels. Converts a synthetic 4:2:0 frame at the
+// bitmap size and at twice the bitmap size into the same bottom-up layout as an RGSS bitmap with
+// every kernel set the CPU supports, and checks they all match the scalar output. When built with
+// VIDEC_HAVE_SWSCALE it also times swscale on the same conversions and reports how far its output
+// is from ours.
+//
+//   g++ -O2 -std=c++17 -I.. yuv_bench.cpp ../yuv_kernels.cpp ../cpu_features.cpp -o yuv_bench
+//   ./yuv_bench [width] [height] [iterations]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+#include "yuv_kernels.h"
+
+#ifdef VIDEC_HAVE_SWSCALE
+extern "C" {
+#include <libswscale/swscale.h>
+}
+#endif
+
+namespace {
+
+struct FakeBitmap {
+    FakeBitmap(std::size_t width, std::size_t height)
+        : width(width), height(height), memory(width * height * 4) {}
+
+    // The engine hands us a pointer to the top line with every following line at a lower address
+    Blit::Surface GetSurface() {
+        const auto stride = static_cast<std::ptrdiff_t>(width * 4);
+        return Blit::Surface{memory.data() + (height - 1) * stride, -stride, width, height};
+    }
+
+    std::size_t width;
+    std::size_t height;
+    std::vector<u8> memory;
+};
+
+/// Decoded frame with both chroma layouts of the same picture, rows are padded like FFmpeg pads
+/// them so they don't all start on the same alignment as the bitmap
+struct SourceFrame {
+    SourceFrame(std::size_t width, std::size_t height)
+        : width(width), height(height), chroma_width((width + 1) / 2),
+          chroma_height((height + 1) / 2), luma_pitch(Pad(width)), chroma_pitch(Pad(chroma_width)),
+          uv_pitch(Pad(chroma_width * 2)), luma(luma_pitch * height),
+          u(chroma_pitch * chroma_height), v(chroma_pitch * chroma_height),
+          uv(uv_pitch * chroma_height) {
+        // Smooth gradients with some noise on top, roughly what a real frame looks like and
+        // enough to push a few pixels past the edges of the RGB range
+        for (std::size_t y = 0; y < height; y++) {
+            for (std::size_t x = 0; x < width; x++) {
+                luma[y * luma_pitch + x] = static_cast<u8>((x + y) / 4 + std::rand() % 16);
+            }
+        }
+        for (std::size_t y = 0; y < chroma_height; y++) {
+            for (std::size_t x = 0; x < chroma_width; x++) {
+                const auto cb = static_cast<u8>(x * 255 / chroma_width + std::rand() % 8);
+                const auto cr = static_cast<u8>(y * 255 / chroma_height + std::rand() % 8);
+                u[y * chroma_pitch + x] = cb;
+                v[y * chroma_pitch + x] = cr;
+                uv[y * uv_pitch + x * 2] = cb;
+                uv[y * uv_pitch + x * 2 + 1] = cr;
+            }
+        }
+    }
+
+    static std::size_t Pad(std::size_t bytes) {
+        return (bytes + 63) / 64 * 64 + 16;
+    }
+
+    Yuv::Image GetImage(Yuv::Layout layout) const {
+        Yuv::Image image{};
+        image.layout = layout;
+        image.width = width;
+        image.height = height;
+        image.planes[0] = luma.data();
+        image.pitches[0] = static_cast<std::ptrdiff_t>(luma_pitch);
+        if (layout == Yuv::Layout::NV12) {
+            image.planes[1] = uv.data();
+            image.pitches[1] = static_cast<std::ptrdiff_t>(uv_pitch);
+        } else {
+            image.planes[1] = u.data();
+            image.planes[2] = v.data();
+            image.pitches[1] = static_cast<std::ptrdiff_t>(chroma_pitch);
+            image.pitches[2] = static_cast<std::ptrdiff_t>(chroma_pitch);
+        }
+        return image;
+    }
+
+    std::size_t width;
+    std::size_t height;
+    std::size_t chroma_width;
+    std::size_t chroma_height;
+    std::size_t luma_pitch;
+    std::size_t chroma_pitch;
+    std::size_t uv_pitch;
+    std::vector<u8> luma;
+    std::vector<u8> u;
+    std::vector<u8> v;
+    std::vector<u8> uv;
+};
+
+template <typename Func>
+double TimeIterations(std::size_t iterations, Func&& func) {
+    using namespace std::chrono;
+    // Warm up caches and page in the destination before timing anything
+    func();
+    const auto start = steady_clock::now();
+    for (std::size_t i = 0; i < iterations; i++) {
+        func();
+    }
+    return duration<double>(steady_clock::now() - start).count() / static_cast<double>(iterations);
+}
+
+void Report(const char* converter, const char* op, std::size_t pixels, double seconds) {
+    std::printf("%-12s %-10s %9.3f us %8.1f Mpx/s", converter, op, seconds * 1e6,
+                static_cast<double>(pixels) / seconds / 1e6);
+}
+
+#ifdef VIDEC_HAVE_SWSCALE
+void ReportDifference(const std::vector<u8>& output, const std::vector<u8>& reference) {
+    int max_difference = 0;
+    double total = 0.0;
+    for (std::size_t i = 0; i < output.size(); i++) {
+        const int difference = std::abs(output[i] - reference[i]);
+        max_difference = difference > max_difference ? difference : max_difference;
+        total += difference;
+    }
+    std::printf("   max diff %3d, mean %.3f\n", max_difference,
+                total / static_cast<double>(output.size()));
+}
+#endif
+
+} // Anonymous namespace
+
+int main(int argc, char** argv) {
+    const std::size_t width = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 640;
+    const std::size_t height = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 480;
+    const std::size_t iterations = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 500;
+    const auto coefficients = Yuv::MakeCoefficients(Yuv::Matrix::BT601, Yuv::Range::Limited);
+
+    std::printf("%zux%zu bitmap, %zu iterations, dispatch picked %s\n", width, height, iterations,
+                Yuv::GetKernels().name);
+
+    int result = 0;
+    for (const std::size_t scale : {1, 2}) {
+        const SourceFrame source(width * scale, height * scale);
+        for (const auto layout : {Yuv::Layout::I420, Yuv::Layout::NV12}) {
+            const bool nv12 = layout == Yuv::Layout::NV12;
+            const char* op = nv12 ? "nv12" : "i420";
+            if (scale == 2) {
+                op = nv12 ? "nv12 half" : "i420 half";
+            }
+            const auto image = source.GetImage(layout);
+            std::printf("%s from %zux%zu\n", op, source.width, source.height);
+
+            FakeBitmap reference(width, height);
+            Yuv::ConvertRows(reference.GetSurface(), image, coefficients, 0, height,
+                             *Yuv::GetKernels(Blit::Isa::Scalar));
+
+            for (const auto isa : {Blit::Isa::Scalar, Blit::Isa::SSE2, Blit::Isa::AVX2}) {
+                const auto* kernels = Yuv::GetKernels(isa);
+                if (kernels == nullptr) {
+                    continue;
+                }
+
+                FakeBitmap bitmap(width, height);
+                const auto surface = bitmap.GetSurface();
+                Report(kernels->name, op, width * height, TimeIterations(iterations, [&] {
+                           Yuv::ConvertRows(surface, image, coefficients, 0, height, *kernels);
+                       }));
+                std::printf("\n");
+                if (bitmap.memory != reference.memory) {
+                    std::printf("%s %s doesn't match the scalar output\n", kernels->name, op);
+                    result = 1;
+                }
+            }
+
+#ifdef VIDEC_HAVE_SWSCALE
+            // swscale defaults to limited range BT.601, the same as the coefficients above
+            const auto format = nv12 ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P;
+            const int src_strides[4] = {static_cast<int>(image.pitches[0]),
+                                        static_cast<int>(image.pitches[1]),
+                                        static_cast<int>(image.pitches[2]), 0};
+            const u8* const src_planes[4] = {image.planes[0], image.planes[1], image.planes[2],
+                                             nullptr};
+            for (const auto& [flags, name] : {std::pair{SWS_FAST_BILINEAR, "sws fast"},
+                                              std::pair{SWS_BICUBIC, "sws bicubic"}}) {
+                auto* context = sws_getContext(
+                    static_cast<int>(source.width), static_cast<int>(source.height), format,
+                    static_cast<int>(width), static_cast<int>(height), AV_PIX_FMT_BGRA, flags,
+                    nullptr, nullptr, nullptr);
+                if (context == nullptr) {
+                    continue;
+                }
+
+                FakeBitmap bitmap(width, height);
+                const auto surface = bitmap.GetSurface();
+                u8* const dst_planes[4] = {surface.top_line, nullptr, nullptr, nullptr};
+                const int dst_strides[4] = {static_cast<int>(surface.pitch), 0, 0, 0};
+                Report(name, op, width * height, TimeIterations(iterations, [&] {
+                           sws_scale(context, src_planes, src_strides, 0,
+                                     static_cast<int>(source.height), dst_planes, dst_strides);
+                       }));
+                ReportDifference(bitmap.memory, reference.memory);
+                sws_freeContext(context);
+            }
+#endif
+        }
+    }
+
+    return result;
+}
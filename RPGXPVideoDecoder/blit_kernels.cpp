@@ -0,0 +1,303 @@
+#include <cstring>
+#include "blit_kernels.h"
+#include "cpu_features.h"
+
+#if VIDEC_ARCH_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+namespace Blit {
+
+namespace {
+
+constexpr std::size_t BYTES_PER_PIXEL = 4;
+constexpr u32 ALPHA_MASK = 0xFF000000;
+
+// Rows shorter than this aren't worth the alignment prologue, a plain copy wins
+constexpr std::size_t MIN_STREAMING_PIXELS = 64;
+
+void CopyRowScalar(u8* dst, const u8* src, std::size_t pixels) {
+    std::memcpy(dst, src, pixels * BYTES_PER_PIXEL);
+}
+
+void CopyRowOpaqueScalar(u8* dst, const u8* src, std::size_t pixels) {
+    for (std::size_t i = 0; i < pixels; i++) {
+        u32 pixel{};
+        std::memcpy(&pixel, src + i * BYTES_PER_PIXEL, sizeof(pixel));
+        pixel |= ALPHA_MASK;
+        std::memcpy(dst + i * BYTES_PER_PIXEL, &pixel, sizeof(pixel));
+    }
+}
+
+void FinishScalar() {}
+
+/// Number of pixels to handle one by one before dst is aligned to the given boundary
+std::size_t PixelsUntilAligned(const u8* dst, std::size_t alignment) {
+    const auto misalignment = reinterpret_cast<std::uintptr_t>(dst) & (alignment - 1);
+    if (misalignment == 0) {
+        return 0;
+    }
+    return (alignment - misalignment) / BYTES_PER_PIXEL;
+}
+
+#if VIDEC_ARCH_X86
+template <bool Stream>
+void Store128(__m128i* dst, __m128i value) {
+    if constexpr (Stream) {
+        _mm_stream_si128(dst, value);
+    } else {
+        _mm_store_si128(dst, value);
+    }
+}
+
+template <bool Stream>
+VIDEC_TARGET_AVX2 void Store256(__m256i* dst, __m256i value) {
+    if constexpr (Stream) {
+        _mm256_stream_si256(dst, value);
+    } else {
+        _mm256_store_si256(dst, value);
+    }
+}
+
+template <bool Stream>
+void CopyRowSSE2(u8* dst, const u8* src, std::size_t pixels) {
+    // Pixels are 4 byte aligned inside the bitmap so we can always reach a 16 byte boundary
+    if (pixels < MIN_STREAMING_PIXELS || (reinterpret_cast<std::uintptr_t>(dst) & 3) != 0) {
+        CopyRowScalar(dst, src, pixels);
+        return;
+    }
+
+    const auto head = PixelsUntilAligned(dst, 16);
+    CopyRowScalar(dst, src, head);
+    std::size_t i = head;
+    for (; i + 16 <= pixels; i += 16) {
+        const auto* s = reinterpret_cast<const __m128i*>(src + i * BYTES_PER_PIXEL);
+        auto* d = reinterpret_cast<__m128i*>(dst + i * BYTES_PER_PIXEL);
+        const __m128i a = _mm_loadu_si128(s + 0);
+        const __m128i b = _mm_loadu_si128(s + 1);
+        const __m128i c = _mm_loadu_si128(s + 2);
+        const __m128i e = _mm_loadu_si128(s + 3);
+        Store128<Stream>(d + 0, a);
+        Store128<Stream>(d + 1, b);
+        Store128<Stream>(d + 2, c);
+        Store128<Stream>(d + 3, e);
+    }
+    for (; i + 4 <= pixels; i += 4) {
+        const __m128i a =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * BYTES_PER_PIXEL));
+        Store128<Stream>(reinterpret_cast<__m128i*>(dst + i * BYTES_PER_PIXEL), a);
+    }
+    CopyRowScalar(dst + i * BYTES_PER_PIXEL, src + i * BYTES_PER_PIXEL, pixels - i);
+}
+
+template <bool Stream>
+void CopyRowOpaqueSSE2(u8* dst, const u8* src, std::size_t pixels) {
+    if (pixels < MIN_STREAMING_PIXELS || (reinterpret_cast<std::uintptr_t>(dst) & 3) != 0) {
+        CopyRowOpaqueScalar(dst, src, pixels);
+        return;
+    }
+
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(ALPHA_MASK));
+    const auto head = PixelsUntilAligned(dst, 16);
+    CopyRowOpaqueScalar(dst, src, head);
+    std::size_t i = head;
+    for (; i + 8 <= pixels; i += 8) {
+        const auto* s = reinterpret_cast<const __m128i*>(src + i * BYTES_PER_PIXEL);
+        auto* d = reinterpret_cast<__m128i*>(dst + i * BYTES_PER_PIXEL);
+        const __m128i a = _mm_or_si128(_mm_loadu_si128(s + 0), alpha);
+        const __m128i b = _mm_or_si128(_mm_loadu_si128(s + 1), alpha);
+        Store128<Stream>(d + 0, a);
+        Store128<Stream>(d + 1, b);
+    }
+    for (; i + 4 <= pixels; i += 4) {
+        const __m128i a = _mm_or_si128(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * BYTES_PER_PIXEL)), alpha);
+        Store128<Stream>(reinterpret_cast<__m128i*>(dst + i * BYTES_PER_PIXEL), a);
+    }
+    CopyRowOpaqueScalar(dst + i * BYTES_PER_PIXEL, src + i * BYTES_PER_PIXEL, pixels - i);
+}
+
+void FinishSSE2() {
+    _mm_sfence();
+}
+
+template <bool Stream>
+VIDEC_TARGET_AVX2 void CopyRowAVX2(u8* dst, const u8* src, std::size_t pixels) {
+    if (pixels < MIN_STREAMING_PIXELS || (reinterpret_cast<std::uintptr_t>(dst) & 3) != 0) {
+        CopyRowScalar(dst, src, pixels);
+        return;
+    }
+
+    const auto head = PixelsUntilAligned(dst, 32);
+    CopyRowScalar(dst, src, head);
+    std::size_t i = head;
+    for (; i + 32 <= pixels; i += 32) {
+        const auto* s = reinterpret_cast<const __m256i*>(src + i * BYTES_PER_PIXEL);
+        auto* d = reinterpret_cast<__m256i*>(dst + i * BYTES_PER_PIXEL);
+        const __m256i a = _mm256_loadu_si256(s + 0);
+        const __m256i b = _mm256_loadu_si256(s + 1);
+        const __m256i c = _mm256_loadu_si256(s + 2);
+        const __m256i e = _mm256_loadu_si256(s + 3);
+        Store256<Stream>(d + 0, a);
+        Store256<Stream>(d + 1, b);
+        Store256<Stream>(d + 2, c);
+        Store256<Stream>(d + 3, e);
+    }
+    for (; i + 8 <= pixels; i += 8) {
+        const __m256i a =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * BYTES_PER_PIXEL));
+        Store256<Stream>(reinterpret_cast<__m256i*>(dst + i * BYTES_PER_PIXEL), a);
+    }
+    CopyRowScalar(dst + i * BYTES_PER_PIXEL, src + i * BYTES_PER_PIXEL, pixels - i);
+}
+
+template <bool Stream>
+VIDEC_TARGET_AVX2 void CopyRowOpaqueAVX2(u8* dst, const u8* src, std::size_t pixels) {
+    if (pixels < MIN_STREAMING_PIXELS || (reinterpret_cast<std::uintptr_t>(dst) & 3) != 0) {
+        CopyRowOpaqueScalar(dst, src, pixels);
+        return;
+    }
+
+    const __m256i alpha = _mm256_set1_epi32(static_cast<int>(ALPHA_MASK));
+    const auto head = PixelsUntilAligned(dst, 32);
+    CopyRowOpaqueScalar(dst, src, head);
+    std::size_t i = head;
+    for (; i + 16 <= pixels; i += 16) {
+        const auto* s = reinterpret_cast<const __m256i*>(src + i * BYTES_PER_PIXEL);
+        auto* d = reinterpret_cast<__m256i*>(dst + i * BYTES_PER_PIXEL);
+        const __m256i a = _mm256_or_si256(_mm256_loadu_si256(s + 0), alpha);
+        const __m256i b = _mm256_or_si256(_mm256_loadu_si256(s + 1), alpha);
+        Store256<Stream>(d + 0, a);
+        Store256<Stream>(d + 1, b);
+    }
+    for (; i + 8 <= pixels; i += 8) {
+        const __m256i a = _mm256_or_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * BYTES_PER_PIXEL)),
+            alpha);
+        Store256<Stream>(reinterpret_cast<__m256i*>(dst + i * BYTES_PER_PIXEL), a);
+    }
+    CopyRowOpaqueScalar(dst + i * BYTES_PER_PIXEL, src + i * BYTES_PER_PIXEL, pixels - i);
+}
+#endif
+
+constexpr Kernels SCALAR_KERNELS{
+    Isa::Scalar,   "scalar",           CopyRowScalar, CopyRowOpaqueScalar, CopyRowScalar,
+    CopyRowOpaqueScalar, FinishScalar,
+};
+#if VIDEC_ARCH_X86
+// The CRT memcpy is already vectorized and beats a hand rolled loop for plain copies that stay in
+// the cache, so the SIMD kernels only take over when streaming or forcing alpha
+constexpr Kernels SSE2_KERNELS{
+    Isa::SSE2,           "sse2",
+    CopyRowScalar,       CopyRowOpaqueSSE2<false>,
+    CopyRowSSE2<true>,   CopyRowOpaqueSSE2<true>,
+    FinishSSE2,
+};
+constexpr Kernels AVX2_KERNELS{
+    Isa::AVX2,           "avx2",
+    CopyRowScalar,       CopyRowOpaqueAVX2<false>,
+    CopyRowAVX2<true>,   CopyRowOpaqueAVX2<true>,
+    FinishSSE2,
+};
+#endif
+
+const Kernels& SelectKernels() {
+    if (const auto* kernels = GetKernels(Isa::AVX2)) {
+        return *kernels;
+    }
+    if (const auto* kernels = GetKernels(Isa::SSE2)) {
+        return *kernels;
+    }
+    return SCALAR_KERNELS;
+}
+
+using RowFunc = void (*)(u8* dst, const u8* src, std::size_t pixels);
+
+void CopyRows(const Surface& dst, std::size_t x, std::size_t y, std::size_t width,
+              std::size_t height, const u8* src, std::ptrdiff_t src_pitch, RowFunc row_func,
+              RowFunc stream_row_func, void (*finish)()) {
+    if (dst.top_line == nullptr || src == nullptr || x >= dst.width || y >= dst.height) {
+        return;
+    }
+
+    const auto copy_width = width < dst.width - x ? width : dst.width - x;
+    const auto copy_height = height < dst.height - y ? height : dst.height - y;
+    const bool stream = copy_width * copy_height * BYTES_PER_PIXEL >= STREAMING_THRESHOLD;
+    if (stream) {
+        row_func = stream_row_func;
+    }
+
+    // Work out the first row once instead of chasing pointers for every line
+    u8* dst_row = dst.top_line + static_cast<std::ptrdiff_t>(y) * dst.pitch +
+                  static_cast<std::ptrdiff_t>(x * BYTES_PER_PIXEL);
+    for (std::size_t row = 0; row < copy_height; row++) {
+        row_func(dst_row, src, copy_width);
+        dst_row += dst.pitch;
+        src += src_pitch;
+    }
+    if (stream) {
+        finish();
+    }
+}
+
+} // Anonymous namespace
+
+const Kernels& GetKernels() {
+    static const Kernels& kernels = SelectKernels();
+    return kernels;
+}
+
+const Kernels* GetKernels(Isa isa) {
+    switch (isa) {
+    case Isa::Scalar:
+        return &SCALAR_KERNELS;
+#if VIDEC_ARCH_X86
+    case Isa::SSE2:
+        return GetCpuFeatures().sse2 ? &SSE2_KERNELS : nullptr;
+    case Isa::AVX2:
+        return GetCpuFeatures().avx2 ? &AVX2_KERNELS : nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+void CopyImage(const Surface& dst, const u8* src, std::ptrdiff_t src_pitch,
+               const Kernels& kernels) {
+    CopyRows(dst, 0, 0, dst.width, dst.height, src, src_pitch, kernels.copy_row,
+             kernels.copy_row_stream, kernels.finish);
+}
+
+void CopyImageOpaque(const Surface& dst, const u8* src, std::ptrdiff_t src_pitch,
+                     const Kernels& kernels) {
+    CopyRows(dst, 0, 0, dst.width, dst.height, src, src_pitch, kernels.copy_row_opaque,
+             kernels.copy_row_opaque_stream, kernels.finish);
+}
+
+void CopyRect(const Surface& dst, std::size_t x, std::size_t y, std::size_t width,
+              std::size_t height, const u8* src, std::ptrdiff_t src_pitch,
+              const Kernels& kernels) {
+    CopyRows(dst, x, y, width, height, src, src_pitch, kernels.copy_row, kernels.copy_row_stream,
+             kernels.finish);
+}
+
+void FillRect(const Surface& dst, std::size_t x, std::size_t y, std::size_t width,
+              std::size_t height, u32 pixel) {
+    if (dst.top_line == nullptr || x >= dst.width || y >= dst.height) {
+        return;
+    }
+
+    const auto fill_width = width < dst.width - x ? width : dst.width - x;
+    const auto fill_height = height < dst.height - y ? height : dst.height - y;
+    u8* dst_row = dst.top_line + static_cast<std::ptrdiff_t>(y) * dst.pitch +
+                  static_cast<std::ptrdiff_t>(x * BYTES_PER_PIXEL);
+    for (std::size_t row = 0; row < fill_height; row++) {
+        for (std::size_t i = 0; i < fill_width; i++) {
+            std::memcpy(dst_row + i * BYTES_PER_PIXEL, &pixel, BYTES_PER_PIXEL);
+        }
+        dst_row += dst.pitch;
+    }
+}
+
+} // namespace Blit
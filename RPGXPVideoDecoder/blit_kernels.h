@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include "common_types.h"
+
+namespace Blit {
+
+enum class Isa : u32 {
+    Scalar = 0,
+    SSE2 = 1,
+    AVX2 = 2,
+};
+
+/// Row kernels for 32-bit BGRA pixels. The streaming variants use non-temporal stores for the
+/// bulk of the row so large frames don't flush everything else out of the cache, finish() has to
+/// be called once a blit using them is done to order those stores.
+struct Kernels {
+    Isa isa{};
+    const char* name{};
+    void (*copy_row)(u8* dst, const u8* src, std::size_t pixels){};
+    void (*copy_row_opaque)(u8* dst, const u8* src, std::size_t pixels){};
+    void (*copy_row_stream)(u8* dst, const u8* src, std::size_t pixels){};
+    void (*copy_row_opaque_stream)(u8* dst, const u8* src, std::size_t pixels){};
+    void (*finish)(){};
+};
+
+/// Blits touching at least this many bytes use the streaming kernels, anything smaller is likely
+/// to still be in the cache when the engine reads the bitmap back
+constexpr std::size_t STREAMING_THRESHOLD = 4 * 1024 * 1024;
+
+/// Destination image, pitch is negative for bottom-up images such as the RGSS bitmap
+struct Surface {
+    u8* top_line{};
+    std::ptrdiff_t pitch{};
+    std::size_t width{};
+    std::size_t height{};
+};
+
+/// Best kernels for the running CPU, picked once on first use
+const Kernels& GetKernels();
+
+/// Kernels for a specific instruction set or nullptr if the CPU doesn't support it
+const Kernels* GetKernels(Isa isa);
+
+/// Copies a top-down image with the same dimensions as dst, flipping it if dst is bottom-up
+void CopyImage(const Surface& dst, const u8* src, std::ptrdiff_t src_pitch,
+               const Kernels& kernels = GetKernels());
+
+/// Same as CopyImage but forces the alpha channel of every pixel to 255
+void CopyImageOpaque(const Surface& dst, const u8* src, std::ptrdiff_t src_pitch,
+                     const Kernels& kernels = GetKernels());
+
+/// Copies a top-down image into the rectangle at x, y of dst, clipped to the destination
+void CopyRect(const Surface& dst, std::size_t x, std::size_t y, std::size_t width,
+              std::size_t height, const u8* src, std::ptrdiff_t src_pitch,
+              const Kernels& kernels = GetKernels());
+
+/// Sets every pixel in the rectangle at x, y of dst to pixel, clipped to the destination. Meant
+/// for one off fills such as clearing borders, so it doesn't bother with the kernels
+void FillRect(const Surface& dst, std::size_t x, std::size_t y, std::size_t width,
+              std::size_t height, u32 pixel);
+
+} // namespace Blit
@@ -17,7 +17,14 @@ using f64 = double;
 
 using EngineAddr = void*;
 
+#ifdef _WIN32
 #define API_CALL extern "C" __declspec(dllexport)
+// Calling convention of callbacks the game hands to us, the same one Win32API calls with
+#define USER_CALLBACK __stdcall
+#else
+#define API_CALL extern "C" __attribute__((visibility("default")))
+#define USER_CALLBACK
+#endif
 
 enum class ErrorCode : s32 {
     Success = 0,
@@ -31,4 +38,5 @@ enum class ErrorCode : s32 {
     FailedToFindAudioStream = 8,
     FailedToOpenAudioDevice = 9,
     InternalError = 10,
+    InvalidArguments = 11,
 };
@@ -0,0 +1,49 @@
+#include "context_registry.h"
+#include "decoder.h"
+
+u32 ContextRegistry::Add(std::shared_ptr<Decoder> decoder) {
+    std::scoped_lock lock{mutex};
+
+    // 0 is never handed out so the game can use it to mean no context
+    u32 handle = next_handle++;
+    while (handle == 0 || contexts.count(handle) != 0) {
+        handle = next_handle++;
+    }
+    contexts.emplace(handle, std::move(decoder));
+    return handle;
+}
+
+std::shared_ptr<Decoder> ContextRegistry::Get(u32 handle) const {
+    std::scoped_lock lock{mutex};
+    const auto it = contexts.find(handle);
+    if (it == contexts.end()) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+bool ContextRegistry::Remove(u32 handle) {
+    std::shared_ptr<Decoder> decoder{};
+    {
+        std::scoped_lock lock{mutex};
+        const auto it = contexts.find(handle);
+        if (it == contexts.end()) {
+            return false;
+        }
+        decoder = std::move(it->second);
+        contexts.erase(it);
+    }
+
+    // Stopping the decoder joins its threads, don't hold up every other context while it does
+    decoder.reset();
+    return true;
+}
+
+void ContextRegistry::Clear() {
+    std::unordered_map<u32, std::shared_ptr<Decoder>> closing{};
+    {
+        std::scoped_lock lock{mutex};
+        closing.swap(contexts);
+    }
+    closing.clear();
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "common_types.h"
+
+class Decoder;
+
+/// Every decoder context the game currently has open, handed out as opaque non-zero handles so
+/// several videos can play at once. Lookups return shared ownership, so closing a context while
+/// another call is still using it only frees the decoder once that call is done. Safe to use from
+/// any thread.
+class ContextRegistry {
+public:
+    /// Takes ownership of decoder and returns the handle it can be looked up by
+    u32 Add(std::shared_ptr<Decoder> decoder);
+
+    /// Returns nullptr if handle doesn't name an open context
+    std::shared_ptr<Decoder> Get(u32 handle) const;
+
+    /// Removes the context, returns false if handle doesn't name an open context
+    bool Remove(u32 handle);
+
+    /// Closes every context
+    void Clear();
+
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<u32, std::shared_ptr<Decoder>> contexts;
+    u32 next_handle{1};
+};
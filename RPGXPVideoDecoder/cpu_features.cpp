@@ -0,0 +1,65 @@
+#include "cpu_features.h"
+
+#if VIDEC_ARCH_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+
+#if VIDEC_ARCH_X86
+void CpuId(int regs[4], int leaf, int subleaf) {
+#if defined(_MSC_VER)
+    __cpuidex(regs, leaf, subleaf);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+u64 ReadXcr0() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    u32 eax{};
+    u32 edx{};
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<u64>(edx) << 32) | eax;
+#endif
+}
+#endif
+
+CpuFeatures DetectCpuFeatures() {
+    CpuFeatures features{};
+#if VIDEC_ARCH_X86
+    int regs[4]{};
+    CpuId(regs, 0, 0);
+    const auto max_leaf = regs[0];
+    if (max_leaf < 1) {
+        return features;
+    }
+
+    CpuId(regs, 1, 0);
+    features.sse2 = (regs[3] & (1 << 26)) != 0;
+    features.ssse3 = (regs[2] & (1 << 9)) != 0;
+    features.sse41 = (regs[2] & (1 << 19)) != 0;
+
+    // AVX state has to be enabled by the OS before we can touch the upper halves of the registers
+    const bool os_saves_avx = (regs[2] & (1 << 27)) != 0 && (regs[2] & (1 << 28)) != 0 &&
+                              (ReadXcr0() & 0x6) == 0x6;
+    if (os_saves_avx && max_leaf >= 7) {
+        CpuId(regs, 7, 0);
+        features.avx2 = (regs[1] & (1 << 5)) != 0;
+    }
+#endif
+    return features;
+}
+
+} // Anonymous namespace
+
+const CpuFeatures& GetCpuFeatures() {
+    static const CpuFeatures features = DetectCpuFeatures();
+    return features;
+}
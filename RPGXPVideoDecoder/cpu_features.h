@@ -0,0 +1,25 @@
+#pragma once
+#include "common_types.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define VIDEC_ARCH_X86 1
+#else
+#define VIDEC_ARCH_X86 0
+#endif
+
+// MSVC allows any intrinsic in any function, GCC and Clang need the target enabled per function
+#if defined(_MSC_VER) || !VIDEC_ARCH_X86
+#define VIDEC_TARGET_AVX2
+#else
+#define VIDEC_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+struct CpuFeatures {
+    bool sse2{};
+    bool ssse3{};
+    bool sse41{};
+    bool avx2{};
+};
+
+/// Queries the CPU once and caches the result for the lifetime of the process
+const CpuFeatures& GetCpuFeatures();
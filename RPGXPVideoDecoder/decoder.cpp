@@ -1,59 +1,130 @@
-#include <audioresampler.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
 #include <av.h>
 #include <avutils.h>
-#include <videorescaler.h>
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+}
 
 #include "decoder.h"
-#include "rgssad_bitmap.h"
 
-DWORD WINAPI DecoderBootstrap(LPVOID lpParam);
-DWORD WINAPI RenderBootstrap(LPVOID lpParam);
+void DemuxBootstrap(void* param);
+void VideoDecoderBootstrap(void* param);
+void AudioDecoderBootstrap(void* param);
+void RenderBootstrap(void* param);
+void BakedFeedBootstrap(void* param);
 
-Decoder::Decoder(EngineAddr target) : bitmap(std::make_unique<RPGMaker::Bitmap>(target)) {
-    frame_width = bitmap->GetWidth();
-    frame_height = bitmap->GetHeight();
+Decoder::Decoder(std::unique_ptr<FrameSink> target, const DecoderSettings& settings)
+    : sink(std::move(target)), settings(settings) {
+    frame_width = sink->GetWidth();
+    frame_height = sink->GetHeight();
 
     av::init();
     av::setFFmpegLoggingLevel(AV_LOG_PANIC);
+
+    scheduler = &TaskScheduler::Get();
+    scheduler->AddStream();
 }
 
 Decoder::~Decoder() {
-    if (render_thread != NULL) {
-        CloseHandle(render_thread);
-        render_thread = NULL;
+    StopThreads();
+    scheduler->ReleaseStreamThreads(claimed_video_threads);
+    scheduler->RemoveStream();
+
+    // Every thread has stopped recording by now
+    if (trace) {
+        trace->Write();
     }
+}
+
+void Decoder::EnableTracing(const char* path) {
+    trace = std::make_unique<TraceRecorder>(path);
+}
+
+TraceThread Decoder::GetFeedThread(TraceThread decoded) const {
+    return baked ? TraceThread::Demux : decoded;
+}
 
-    if (decoder_thread != NULL) {
-        CloseHandle(decoder_thread);
-        decoder_thread = NULL;
+void Decoder::StopThreads() {
+    // Every thread checks kill_threads before it waits, so waking everything up afterwards is
+    // enough for them all to notice
+    kill_threads.store(true);
+    video_packets.Abort();
+    audio_packets.Abort();
+    audio_output.Wake();
+    video_space.Set();
+    demux_wake.Set();
+    WakeRenderer();
+
+    for (auto* thread : {&render_thread, &demux_thread, &video_thread, &audio_thread}) {
+        thread->Join();
     }
 }
 
 s32 Decoder::GetInternalError() const {
+    std::scoped_lock lock{internal_error_mutex};
     return internal_error.value();
 }
 
 const char* Decoder::GetInternalErrorMessage() const {
-    return internal_error.message().c_str();
+    // Not the member's own empty string, that storage is reused when the message is set
+    std::scoped_lock lock{internal_error_mutex};
+    return internal_error ? internal_error_message.c_str() : "";
+}
+
+void Decoder::SetInternalError(const std::error_code& err) {
+    // Callers may still hold the message we handed out, so it's never replaced once set
+    std::scoped_lock lock{internal_error_mutex};
+    if (!internal_error) {
+        internal_error = err;
+        internal_error_message = err.message();
+    }
 }
 
 bool Decoder::IsCompleted() const {
+    // A renderer that failed stops everything, so that counts as finished too
+    if (kill_threads.load()) {
+        return true;
+    }
     return is_decoder_complete.load() && is_render_complete.load();
 }
 
 ErrorCode Decoder::Setup(char* video_path) {
+    if (BakedVideo::IsBaked(video_path)) {
+        return SetupBaked(video_path);
+    }
+
     // Open video file
     std::error_code err{};
     format_ctx.openInput(video_path, err);
     if (err) {
-        internal_error = err;
+        SetInternalError(err);
+        return ErrorCode::InternalError;
+    }
+    return SetupStreams();
+}
+
+ErrorCode Decoder::Setup(std::unique_ptr<MediaInput> input) {
+    media_input = std::move(input);
+    std::error_code err{};
+    format_ctx.openInput(media_input.get(), err, media_input->GetBufferSize());
+    if (err) {
+        SetInternalError(err);
         return ErrorCode::InternalError;
     }
+    return SetupStreams();
+}
+
+ErrorCode Decoder::SetupStreams() {
+    std::error_code err{};
 
     // Find all streams
     format_ctx.findStreamInfo(err);
     if (err) {
-        internal_error = err;
+        SetInternalError(err);
         return ErrorCode::InternalError;
     }
 
@@ -75,53 +146,182 @@ ErrorCode Decoder::Setup(char* video_path) {
         return ErrorCode::FailedToFindVideoStream;
     }
 
-    if (audio_stream.stream.isNull()) {
-        return ErrorCode::FailedToFindAudioStream;
-    }
+    // Videos without sound are played off the monotonic clock alone
+    has_audio = !audio_stream.stream.isNull();
 
     // Setup the video decoder
-    vdec = av::VideoDecoderContext(video_stream.stream);
-    av::Codec codec = av::findDecodingCodec(vdec.raw()->codec_id);
-
-    vdec.setCodec(codec);
-    vdec.setRefCountedFrames(true);
-    vdec.open(av::Codec(), err);
-    if (err) {
-        internal_error = err;
+    if (!OpenVideoDecoder(0, err)) {
+        SetInternalError(err);
         return ErrorCode::InternalError;
     }
 
+    // The quality ladder tries to keep each frame within the time it's on screen for
+    auto frame_rate = video_stream.stream.averageFrameRate();
+    if (frame_rate.getNumerator() <= 0 || frame_rate.getDenominator() <= 0) {
+        frame_rate = video_stream.stream.frameRate();
+    }
+    if (frame_rate.getNumerator() > 0 && frame_rate.getDenominator() > 0) {
+        video_frame_duration = 1.0 / frame_rate.getDouble();
+    }
+    quality_ladder.SetBudget(video_frame_duration);
+
+    // Seed the keyframe index from the container, the demuxer adds anything missing as it reads
+    const auto start_time = video_stream.stream.startTime();
+    video_start_time = start_time.isValid() ? start_time.seconds() : 0.0;
+    std::size_t keyframe_capacity = MIN_KEYFRAME_CAPACITY;
+    const auto duration = format_ctx.raw()->duration;
+    if (duration > 0) {
+        const double frames =
+            static_cast<double>(duration) / AV_TIME_BASE / video_frame_duration + 1.0;
+        keyframe_capacity = std::clamp<std::size_t>(static_cast<std::size_t>(frames),
+                                                    MIN_KEYFRAME_CAPACITY, MAX_KEYFRAME_CAPACITY);
+    }
+    keyframe_index.Reserve(keyframe_capacity);
+    LoadContainerIndex();
+
+    format_ctx.substractStartTime(true);
+
+    // Setup the frame converter to match our bitmaps resolution, splitting frames into a few bands
+    // on the shared scheduler so conversion isn't bound to the render thread alone
+    u32 conversion_threads = settings.conversion_threads;
+    if (conversion_threads == 0) {
+        const auto cores = std::max<u32>(std::thread::hardware_concurrency(), 1);
+        conversion_threads = std::min<u32>(cores / 2, MAX_AUTO_CONVERSION_THREADS + 1);
+    }
+    converter = std::make_unique<FrameConverter>(frame_width, frame_height, scheduler,
+                                                 std::max<u32>(conversion_threads, 1));
+    converter->SetScaler(scaler_quality.load());
+
+    u32 start_buffer_ms{};
+    u32 max_buffer_ms{};
+    SetupBuffering(start_buffer_ms, max_buffer_ms);
+    if (has_audio) {
+        const auto result = SetupAudio(start_buffer_ms, max_buffer_ms);
+        if (result != ErrorCode::Success) {
+            return result;
+        }
+    } else {
+        ApplyMemoryLimit();
+    }
+
+    // We start the decoder before we want to start rendering to pre-prepare frames to be shown to
+    // prevent choppy videos
+    SampleWorkingSet();
+    running_decoders = has_audio ? 2 : 1;
+    video_thread.Start(VideoDecoderBootstrap, this);
+    if (has_audio) {
+        audio_thread.Start(AudioDecoderBootstrap, this);
+    }
+    demux_thread.Start(DemuxBootstrap, this);
+
+    return ErrorCode::Success;
+}
+
+ErrorCode Decoder::SetupBaked(const char* video_path) {
+    baked = BakedVideo::Open(video_path);
+    if (!baked) {
+        return ErrorCode::InvalidFile;
+    }
+
+    // Frames were converted for one bitmap size and are copied in as they are
+    const auto& header = baked->GetHeader();
+    if (header.width != frame_width || header.height != frame_height) {
+        return ErrorCode::InvalidFile;
+    }
+    has_audio = baked->HasAudio();
+    if (has_audio && header.audio_channels != 2) {
+        return ErrorCode::InvalidFile;
+    }
+    if (header.frame_duration_us != 0) {
+        video_frame_duration = static_cast<double>(header.frame_duration_us) / 1000000.0;
+    }
+
+    // Any frame can be shown on its own, so seeking can land on every one of them
+    keyframe_index.Reserve(baked->GetFrameCount());
+    for (std::size_t i = 0; i < baked->GetFrameCount(); i++) {
+        keyframe_index.Add(baked->GetFrameTimestamp(i));
+    }
+
+    u32 start_buffer_ms{};
+    u32 max_buffer_ms{};
+    SetupBuffering(start_buffer_ms, max_buffer_ms);
+    if (has_audio) {
+        const auto result =
+            OpenAudioDevice(static_cast<int>(header.audio_frequency),
+                            static_cast<SDL_AudioFormat>(header.audio_format),
+                            static_cast<u8>(header.audio_channels), 0, start_buffer_ms,
+                            max_buffer_ms);
+        if (result != ErrorCode::Success) {
+            return result;
+        }
+    } else {
+        ApplyMemoryLimit();
+    }
+
+    // A single thread feeds both the frame history and the audio ring straight from the file
+    SampleWorkingSet();
+    running_decoders = 1;
+    demux_thread.Start(BakedFeedBootstrap, this);
+    return ErrorCode::Success;
+}
+
+void Decoder::SetupBuffering(u32& start_buffer_ms, u32& max_buffer_ms) {
+    // Work out the buffering watermarks, by default playback starts as soon as there's anything
+    // to play and the decoders stay a couple of seconds ahead of it
+    const bool low_latency = settings.low_latency_audio != 0;
+    max_buffer_ms = settings.max_buffer_ms;
+    if (max_buffer_ms == 0) {
+        max_buffer_ms =
+            low_latency ? LOW_LATENCY_MAX_BUFFER_MILLISECONDS : DEFAULT_MAX_BUFFER_MILLISECONDS;
+    }
+    start_buffer_ms = std::min<u32>(settings.start_buffer_ms, max_buffer_ms);
+    start_buffer_seconds = static_cast<double>(start_buffer_ms) / 1000.0;
+    max_buffer_seconds = static_cast<double>(max_buffer_ms) / 1000.0;
+    start_buffer_bytes = settings.start_buffer_bytes;
+    max_buffer_bytes = settings.max_buffer_bytes != 0 ? settings.max_buffer_bytes
+                                                       : std::numeric_limits<std::size_t>::max();
+}
+
+ErrorCode Decoder::SetupAudio(u32 start_buffer_ms, u32 max_buffer_ms) {
     // Setup the audio decoder
+    std::error_code err{};
     adec = av::AudioDecoderContext(audio_stream.stream);
-    codec = av::findDecodingCodec(adec.raw()->codec_id);
+    av::Codec codec = av::findDecodingCodec(adec.raw()->codec_id);
 
     adec.setCodec(codec);
     adec.setRefCountedFrames(true);
     adec.open(av::Codec(), err);
     if (err) {
-        internal_error = err;
+        SetInternalError(err);
         return ErrorCode::InternalError;
     }
-    format_ctx.substractStartTime(true);
 
-    // Setup the video rescaler to match our bitmaps resolution
-    rescaler = std::make_unique<av::VideoRescaler>(
-        frame_width, frame_height, AV_PIX_FMT_BGRA); // RGB maker stores buffers in BGRA
+    // Whatever the stream's layout, it's mixed to stereo on its way to the device
+    const auto result =
+        OpenAudioDevice(adec.sampleRate(), DecideBestFormat(adec.sampleFormat()), 2,
+                        adec.raw()->frame_size, start_buffer_ms, max_buffer_ms);
+    if (result != ErrorCode::Success) {
+        return result;
+    }
 
-    // Setup the resampler to match our SDL setup
-    resampler = std::make_unique<av::AudioResampler>(
-        adec.channelLayout(), adec.sampleRate(), DecideBestTarget(adec.sampleFormat()),
-        adec.channelLayout(), adec.sampleRate(), adec.sampleFormat());
+    // Convert into the spec the device actually ended up with rather than the one we asked for
+    audio_converter.SetOutput(audio_output.GetSpec());
+    return ErrorCode::Success;
+}
 
+ErrorCode Decoder::OpenAudioDevice(int frequency, SDL_AudioFormat format, u8 channels,
+                                   int frame_size, u32 start_buffer_ms, u32 max_buffer_ms) {
     // Open an audio device for SDL
     SDL_AudioSpec spec{};
-    SDL_AudioSpec recv{};
-    spec.freq = adec.sampleRate();
-    spec.format = DecideBestFormat(adec.sampleFormat());
-    spec.channels = 2;
-    spec.samples = 1024;
-    spec.callback = nullptr; // TODO(ogniK): Setup callback
-    spec.userdata = nullptr;
+    spec.freq = frequency;
+    spec.format = format;
+    spec.channels = channels;
+
+    const bool low_latency = settings.low_latency_audio != 0;
+    spec.samples = low_latency ? LOW_LATENCY_AUDIO_BUFFER_SAMPLES : AUDIO_BUFFER_SAMPLES;
+    if (settings.audio_buffer_samples != 0) {
+        spec.samples = static_cast<u16>(std::min<u32>(settings.audio_buffer_samples, 0x8000));
+    }
 
     switch (spec.format) {
     case AUDIO_U8:
@@ -137,28 +337,37 @@ ErrorCode Decoder::Setup(char* video_path) {
     default:
         sample_width = 2;
     }
-
-    audio_device = SDL_OpenAudioDevice(NULL, 0, &spec, &recv, 0);
-
-    if (audio_device == 0) {
+    audio_frame_bytes = sample_width * spec.channels;
+
+    // Size our buffers for the largest packet we expect to see, the codec frame size isn't always
+    // known up front so fall back to something generous
+    const auto max_packet_samples =
+        static_cast<std::size_t>(std::max<int>(frame_size, 8192));
+    audio_buffer_size = max_packet_samples * audio_frame_bytes;
+    PreallocateBuffers();
+
+    // A packet always has to fit under the audio high watermark or the decoder could wait forever
+    // for space, so never go below a couple of packets worth no matter the sample rate
+    const auto bytes_per_second = static_cast<std::size_t>(spec.freq) * audio_frame_bytes;
+    const auto device_buffer_size = static_cast<std::size_t>(spec.samples) * audio_frame_bytes;
+    audio_high_watermark = std::max<std::size_t>(bytes_per_second * max_buffer_ms / 1000,
+                                                 audio_buffer_size * 2);
+    audio_start_size = std::max<std::size_t>(bytes_per_second * start_buffer_ms / 1000,
+                                             device_buffer_size);
+    audio_start_size = std::min<std::size_t>(audio_start_size, audio_high_watermark);
+    ApplyMemoryLimit();
+
+    // The device stays paused until rendering starts so the ring can fill up in the meantime
+    if (!audio_output.Open(spec.freq, spec.format, spec.channels, spec.samples,
+                           audio_high_watermark)) {
         return ErrorCode::FailedToOpenAudioDevice;
     }
-
-    // Set the device state as playing so we don't need to worry about this later
-    SDL_PauseAudioDevice(audio_device, 0);
-
-    if (decoder_thread != NULL) {
-        CloseHandle(decoder_thread);
-        decoder_thread = NULL;
-    }
-    // We start the decoder before we want to start rendering to pre-prepare frames to be shown to
-    // prevent choppy videos
-    decoder_thread = CreateThread(NULL, NULL, DecoderBootstrap, this, NULL, NULL);
+    audio_silence.assign(audio_buffer_size, audio_output.GetSpec().silence);
 
     return ErrorCode::Success;
 }
 
-SDL_AudioFormat Decoder::DecideBestFormat(av::SampleFormat format) const {
+SDL_AudioFormat Decoder::DecideBestFormat(av::SampleFormat format) {
     switch (format) {
     case AV_SAMPLE_FMT_U8:
     case AV_SAMPLE_FMT_U8P:
@@ -177,7 +386,7 @@ SDL_AudioFormat Decoder::DecideBestFormat(av::SampleFormat format) const {
     }
 }
 
-av::SampleFormat Decoder::DecideBestTarget(av::SampleFormat format) const {
+av::SampleFormat Decoder::DecideBestTarget(av::SampleFormat format) {
     switch (format) {
     case AV_SAMPLE_FMT_U8:
     case AV_SAMPLE_FMT_U8P:
@@ -197,110 +406,757 @@ av::SampleFormat Decoder::DecideBestTarget(av::SampleFormat format) const {
 }
 
 void Decoder::StartRender() {
-    if (render_thread != NULL) {
-        CloseHandle(render_thread);
-        render_thread = NULL;
+    if (render_thread.IsStarted()) {
+        // Only one renderer at a time, a finished one is restarted after a seek
+        if (!render_thread.HasFinished()) {
+            return;
+        }
+        render_thread.Join();
     }
 
-    render_thread = CreateThread(NULL, NULL, RenderBootstrap, this, NULL, NULL);
+    render_thread.Start(RenderBootstrap, this);
 }
 
-void Decoder::AheadOfTimeDecoder() {
-    while (true) {
+void Decoder::DemuxPackets() {
+    PlaybackSegment segment{};
+    double stream_end = 0.0;
+    bool video_ended = false;
+    bool audio_ended = !has_audio;
+    bool at_end = false;
+
+    while (!kill_threads.load()) {
+        double position{};
+        u32 serial{};
+        if (TakeSeekRequest(position, serial)) {
+            segment = PlaybackSegment{};
+            segment.serial = serial;
+            segment.start = position;
+            video_ended = false;
+            audio_ended = !has_audio;
+            at_end = !SeekInput(position);
+            if (at_end) {
+                video_packets.PushEnd(segment);
+                audio_packets.PushEnd(segment);
+            }
+            continue;
+        }
+
+        // Nothing left to read until the game seeks
+        if (at_end) {
+            demux_wake.Wait();
+            continue;
+        }
+
+        std::error_code err{};
+        const double read_start = Platform::GetMonotonicSeconds();
+        auto pkt = format_ctx.readPacket(err);
+        const double read_end = Platform::GetMonotonicSeconds();
+        demux_times.Record(read_end - read_start);
+        if (trace) {
+            const double pts = pkt && pkt.pts().isValid() ? pkt.pts().seconds() + segment.offset
+                                                          : TraceRecorder::NO_PTS;
+            trace->Record(TraceThread::Demux, "readPacket", read_start, read_end, pts);
+        }
+        if (!pkt || err) {
+            if (err) {
+                SetInternalError(err);
+                is_bad_terimination.store(true);
+            } else if (StartNextLoop(segment, stream_end)) {
+                video_ended = false;
+                audio_ended = !has_audio;
+                continue;
+            }
+
+            // Let the decoders finish off whatever is still queued
+            video_packets.PushEnd(segment);
+            audio_packets.PushEnd(segment);
+            at_end = true;
+            continue;
+        }
+
+        const bool is_video = pkt.streamIndex() == video_stream.index;
+        const bool is_audio = has_audio && pkt.streamIndex() == audio_stream.index;
+        if (!is_video && !is_audio) {
+            continue;
+        }
+
+        // Keyframes are indexed by decode time the same way the container does it, as that's
+        // what seeking goes by
+        const auto pts = pkt.pts();
+        const auto dts = pkt.dts();
+        if (is_video && pkt.isKeyPacket() && dts.isValid()) {
+            if (keyframe_index.Add(dts.seconds())) {
+                playback_allocations++;
+            }
+        }
+        if (pts.isValid()) {
+            const double duration =
+                static_cast<double>(pkt.raw()->duration) * pkt.timeBase().getDouble();
+            stream_end = std::max<double>(stream_end, pts.seconds() + duration);
+        }
+
+        // Once both streams are past the loop end we go back round. Video goes by decode time as
+        // packets after the end can still hold frames from before it
+        segment.end = GetLoopEnd();
+        const auto& order = is_video && dts.isValid() ? dts : pts;
+        if (order.isValid() && order.seconds() >= segment.end) {
+            (is_video ? video_ended : audio_ended) = true;
+            if (video_ended && audio_ended && StartNextLoop(segment, stream_end)) {
+                video_ended = false;
+                audio_ended = !has_audio;
+            }
+            continue;
+        }
+
+        // Pushing blocks while the decoder for that stream is behind, which in turn keeps the
+        // demuxer from running too far ahead of either decoder
+        auto& queue = is_video ? video_packets : audio_packets;
+        if (!queue.Push(std::move(pkt), segment)) {
+            break;
+        }
+    }
+}
+
+void Decoder::FeedBaked() {
+    PlaybackSegment segment{};
+    std::size_t frame = 0;
+    std::size_t audio_position = 0;
+    bool segment_empty = true;
+    bool at_end = false;
+
+    // Audio positions are in bytes of the baked PCM, always whole sample frames
+    const std::size_t frame_bytes = audio_frame_bytes;
+    const double rate = has_audio ? static_cast<double>(audio_output.GetSpec().freq) : 1.0;
+    const std::size_t audio_size =
+        has_audio ? baked->GetAudioSize() / frame_bytes * frame_bytes : 0;
+    const auto audio_bytes_at = [&](double seconds) {
+        const auto frames = static_cast<std::size_t>(std::max<double>(seconds, 0.0) * rate);
+        return std::min<std::size_t>(frames * frame_bytes, audio_size);
+    };
+    const auto start_segment = [&](double start) {
+        frame = baked->FindFrame(start);
+        audio_position = audio_bytes_at(start);
+        video_segment = segment;
+        audio_segment = segment;
+        audio_segment_started = false;
+        segment_empty = true;
+    };
+    start_segment(0.0);
+
+    while (!kill_threads.load()) {
+        double position{};
+        u32 serial{};
+        if (TakeSeekRequest(position, serial)) {
+            segment = PlaybackSegment{};
+            segment.serial = serial;
+            segment.start = position;
+            has_queued_video.store(false);
+            if (has_audio) {
+                has_audio_base.store(false);
+                audio_output.Flush();
+                audio_serial.store(serial);
+            }
+            start_segment(position);
+            at_end = false;
+            continue;
+        }
+
+        // Nothing left to play until the game seeks
+        if (at_end) {
+            demux_wake.Wait();
+            continue;
+        }
+
+        // Whichever of the next frame and the next audio chunk plays first goes in first, so
+        // neither side can starve the other while the renderer waits to prebuffer
+        const double end = std::min<double>(GetLoopEnd(), baked->GetDuration());
+        const std::size_t audio_end = audio_bytes_at(end);
+        const double never = std::numeric_limits<double>::infinity();
+        double video_ts = never;
+        if (frame < baked->GetFrameCount() && baked->GetFrameTimestamp(frame) < end) {
+            video_ts = baked->GetFrameTimestamp(frame);
+        }
+        double audio_ts = never;
+        if (audio_position < audio_end) {
+            audio_ts = static_cast<double>(audio_position / frame_bytes) / rate;
+        } else if (has_audio) {
+            // The rest of the frames play out to silence, next loop's audio clears this again
+            audio_output.MarkEnded();
+        }
+
+        if (video_ts == never && audio_ts == never) {
+            // A loop with nothing in it would only spin, so that finishes playback as well
+            const double start = loop_start.load();
+            if (loop_enabled.load() && end > start && !segment_empty) {
+                segment.offset += end - start;
+                segment.start = start;
+                segment.end = end;
+                segment.id++;
+                start_segment(start);
+                continue;
+            }
+            MarkDecoderCompleted(segment.serial);
+            at_end = true;
+            continue;
+        }
+
+        segment_empty = false;
+        const bool fed = video_ts <= audio_ts ? QueueBakedFrame(frame++)
+                                              : WriteBakedAudio(audio_position, audio_end);
+        if (!fed) {
+            MarkDecoderCompleted(segment.serial);
+            return;
+        }
+    }
+}
+
+bool Decoder::TakeSeekRequest(double& position, u32& serial) {
+    std::scoped_lock lock{seek_mutex};
+    if (!seek_pending) {
+        return false;
+    }
+    seek_pending = false;
+    position = seek_target;
+    serial = seek_serial.load();
+    return true;
+}
+
+bool Decoder::SeekInput(double position) {
+    // Aim straight for the closest keyframe we know of, otherwise FFmpeg searches backwards from
+    // the position itself
+    double keyframe = position;
+    keyframe_index.FindAtOrBefore(position, keyframe);
+
+    auto* stream = video_stream.stream.raw();
+    const auto timestamp = static_cast<int64_t>(
+        std::llround((keyframe + video_start_time) / av_q2d(stream->time_base)));
+    return av_seek_frame(format_ctx.raw(), static_cast<int>(video_stream.index), timestamp,
+                         AVSEEK_FLAG_BACKWARD) >= 0;
+}
+
+bool Decoder::StartNextLoop(PlaybackSegment& segment, double stream_end) {
+    if (!loop_enabled.load()) {
+        return false;
+    }
+
+    const double start = loop_start.load();
+    const double end = std::min<double>(segment.end, stream_end);
+    if (end <= start || !SeekInput(start)) {
+        return false;
+    }
+
+    // The next segment carries on from exactly where this one stops on the timeline
+    segment.offset += end - start;
+    segment.start = start;
+    segment.id++;
+    return true;
+}
+
+double Decoder::GetLoopEnd() const {
+    const double end = loop_end.load();
+    if (!loop_enabled.load() || end <= 0.0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return end;
+}
+
+void Decoder::LoadContainerIndex() {
+    auto* stream = video_stream.stream.raw();
+    const double time_base = av_q2d(stream->time_base);
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+    const int count = avformat_index_get_entries_count(stream);
+#else
+    const int count = stream->nb_index_entries;
+#endif
+    for (int i = 0; i < count; i++) {
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+        const AVIndexEntry* entry = avformat_index_get_entry(stream, i);
+#else
+        const AVIndexEntry* entry = &stream->index_entries[i];
+#endif
+        if (entry != nullptr && (entry->flags & AVINDEX_KEYFRAME) != 0) {
+            keyframe_index.Add(static_cast<double>(entry->timestamp) * time_base -
+                               video_start_time);
+        }
+    }
+}
+
+bool Decoder::Seek(double position) {
+    if (kill_threads.load() || is_bad_terimination.load()) {
+        return false;
+    }
+
+    bool restart_render = false;
+    {
+        std::scoped_lock lock{seek_mutex};
+        const u32 serial = seek_serial.load() + 1;
+        seek_target = std::max<double>(position, 0.0);
+        seek_pending = true;
+
+        // Stop the clock first so nothing decoded for the new position counts as late, then
+        // throw away every packet from before the seek
+        clock.Stop();
+        video_packets.Flush(serial);
+        audio_packets.Flush(serial);
+        seek_serial.store(serial);
+
+        running_decoders = has_audio && !baked ? 2 : 1;
+        is_decoder_complete.store(false);
+        restart_render = render_thread.IsStarted() && is_render_complete.load();
+        is_render_complete.store(false);
+        presented_position.store(seek_target);
+    }
+
+    // Wake every stage that could be waiting on something from before the seek
+    demux_wake.Set();
+    video_space.Set();
+    audio_output.Wake();
+    WakeRenderer();
+    if (restart_render) {
+        // The renderer has already finished or is just about to
+        render_thread.Join();
+        StartRender();
+    }
+    return true;
+}
+
+void Decoder::SetLoop(bool enabled, double start, double end) {
+    start = std::max<double>(start, 0.0);
+    loop_start.store(start);
+    loop_end.store(end > start ? end : 0.0);
+    loop_enabled.store(enabled);
+}
+
+double Decoder::GetPosition() const {
+    return presented_position.load();
+}
+
+std::size_t Decoder::GetKeyframeCount() const {
+    return keyframe_index.GetCount();
+}
+
+void Decoder::DecodeVideo() {
+    QueuedPacket entry{};
+    while (video_packets.Pop(entry)) {
         if (kill_threads.load()) {
             return;
         }
 
-        // Whilst we need to keep decoding. If we have not fulfilled either of our decoder sizes,
-        // we'll keep decoding. This means we'll actually decode more than our maximum at some
-        // points. The history sizes should be considered as the LEAST amount of elements instead of
-        // the maximum.
-        while (VIDEO_FRAME_HISTORY.size() < VIDEO_FRAME_HISTORY_SIZE ||
-               AUDIO_FRAME_HISTORY.size() < AUDIO_FRAME_HISTORY_SIZE) {
-            // If we happen to be decoding, we should kill right away
-            if (kill_threads.load()) {
-                return;
-            }
+        if (entry.segment.serial != video_segment.serial) {
+            // Whatever the codec is still holding on to is from before the seek
+            avcodec_flush_buffers(vdec.raw());
+            has_queued_video.store(false);
+            pending_decode_seconds = 0.0;
+        } else if (entry.segment.id != video_segment.id) {
+            // Looping, the end of the previous segment still has to be played out
+            DrainVideoDecoder();
+            avcodec_flush_buffers(vdec.raw());
+        }
+        video_segment = entry.segment;
+
+        if (entry.end_of_stream) {
+            // Threaded codecs hold on to a few frames, so get them back before finishing
+            DrainVideoDecoder();
+            avcodec_flush_buffers(vdec.raw());
+            MarkDecoderCompleted(video_segment.serial);
+            continue;
+        }
 
-            // Decode the packet from the stream
-            std::error_code err{};
-            const auto pkt = format_ctx.readPacket(err);
-            if (!pkt || err) {
-                if (err) {
-                    internal_error = err;
-                    is_bad_terimination.store(true);
-                }
-                return;
+        if (!DecodeVideoPacket(entry.packet)) {
+            MarkDecoderCompleted(video_segment.serial);
+            return;
+        }
+    }
+}
+
+void Decoder::DecodeAudio() {
+    QueuedPacket entry{};
+    while (audio_packets.Pop(entry)) {
+        if (kill_threads.load()) {
+            return;
+        }
+
+        if (entry.segment.serial != audio_segment.serial) {
+            FlushAudio(entry.segment.serial);
+        }
+        if (entry.segment.serial != audio_segment.serial || entry.segment.id != audio_segment.id) {
+            audio_segment_started = false;
+        }
+        audio_segment = entry.segment;
+
+        if (entry.end_of_stream) {
+            audio_output.MarkEnded();
+            MarkDecoderCompleted(audio_segment.serial);
+            continue;
+        }
+
+        if (!DecodeAudioPacket(entry.packet)) {
+            audio_output.MarkEnded();
+            MarkDecoderCompleted(audio_segment.serial);
+            return;
+        }
+    }
+}
+
+void Decoder::FlushAudio(u32 serial) {
+    // Drop everything from before the seek, in the codec, the resampler and the device alike
+    avcodec_flush_buffers(adec.raw());
+    audio_converter.Reset();
+    has_audio_base.store(false);
+    audio_output.Flush();
+    audio_serial.store(serial);
+}
+
+bool Decoder::DecodeVideoPacket(const av::Packet& pkt) {
+    // After reopening the codec nothing can be decoded until the next keyframe
+    if (awaiting_keyframe) {
+        if (!pkt.isKeyPacket()) {
+            return true;
+        }
+        awaiting_keyframe = false;
+    }
+    if (pkt.isKeyPacket() && !RebalanceVideoThreads()) {
+        is_bad_terimination.store(true);
+        return false;
+    }
+
+    // Decode video stream
+    std::error_code err{};
+    const double decode_start = Platform::GetMonotonicSeconds();
+    av::VideoFrame frame = vdec.decode(pkt, err);
+    const double decode_end = Platform::GetMonotonicSeconds();
+    pending_decode_seconds += decode_end - decode_start;
+    if (trace) {
+        const double pts = pkt.pts().isValid() ? pkt.pts().seconds() + video_segment.offset
+                                               : TraceRecorder::NO_PTS;
+        trace->Record(TraceThread::VideoDecoder, "video decode", decode_start, decode_end, pts);
+    }
+
+    // A broken packet only costs the frames that depend on it, decoding carries on with the next
+    if (err) {
+        video_decode_errors++;
+        return true;
+    }
+
+    // The codec might need more packets before it can give us a frame, or it threw the frame
+    // away as we asked it to while catching up. Only non-reference frames are thrown away, so
+    // keyframes giving nothing are just the codec's delay
+    if (!frame) {
+        if (discarding_frames && !pkt.isKeyPacket()) {
+            frames_discarded++;
+        }
+        return true;
+    }
+
+    // Step the quality up or down depending on how long this frame took
+    const double frame_decode_seconds = pending_decode_seconds;
+    pending_decode_seconds = 0.0;
+    decode_times.Record(frame_decode_seconds);
+    if (!UpdateQuality(frame_decode_seconds)) {
+        is_bad_terimination.store(true);
+        return false;
+    }
+
+    if (settings.compact_frames != 0) {
+        frame = compactor.Compact(std::move(frame));
+    }
+    return QueueVideoFrame(std::move(frame), pkt.ts());
+}
+
+bool Decoder::DecodeAudioPacket(const av::Packet& pkt) {
+    // Decode audio stream
+    std::error_code err{};
+    TraceScope decode_scope{trace.get(), TraceThread::AudioDecoder, "audio decode"};
+    const auto samples = adec.decode(pkt, err);
+    if (samples.pts().isValid()) {
+        decode_scope.SetPts(samples.pts().seconds() + audio_segment.offset);
+    }
+    if (err || !samples) {
+        return true;
+    }
+
+    // Convert the whole packet into the device's format in one go, the scratch buffer only grows
+    // if a packet is larger than any before it
+    auto& pcm = audio_scratch;
+    ResizePooled(pcm, audio_converter.GetOutputSize(samples));
+    const auto converted = audio_converter.Convert(samples, pcm.data(), pcm.size());
+    if (converted == 0) {
+        return true;
+    }
+
+    // Work out where the packet sits in its segment, anything outside of it only had to be
+    // decoded to get to the start
+    const std::size_t frame_bytes = audio_frame_bytes;
+    const double rate = static_cast<double>(audio_output.GetSpec().freq);
+    const auto pts = samples.pts();
+    double media_start = audio_segment.start;
+    if (pts.isValid()) {
+        media_start = pts.seconds();
+    } else if (audio_segment_started) {
+        media_start = audio_written_end - audio_segment.offset;
+    }
+    const std::size_t total_frames = converted / frame_bytes;
+    const auto frames_in = [&](double seconds) {
+        const auto frames = static_cast<std::size_t>(std::max<double>(seconds, 0.0) * rate);
+        return std::min<std::size_t>(frames, total_frames);
+    };
+    std::size_t first = frames_in(audio_segment.start - media_start);
+    std::size_t last = total_frames;
+    if (audio_segment.end != std::numeric_limits<double>::infinity()) {
+        last = frames_in(audio_segment.end - media_start);
+    }
+    if (first >= last) {
+        return true;
+    }
+    double timeline_start = media_start + audio_segment.offset + first / rate;
+
+    // Line the first samples of a loop up with where the last one stopped, padding with silence
+    // if it ended early or trimming if it ran on
+    if (has_audio_base.load() && !audio_segment_started) {
+        const double gap = timeline_start - audio_written_end;
+        if (gap > 0.0) {
+            if (!WriteSilence(gap)) {
+                return false;
             }
+        } else {
+            first = std::min<std::size_t>(first + frames_in(-gap), last);
+        }
+        timeline_start = audio_written_end;
+    }
+    audio_segment_started = true;
+    if (first >= last) {
+        return true;
+    }
 
-            if (pkt.streamIndex() == video_stream.index) {
-                // Decode video stream
-                av::VideoFrame frame = vdec.decode(pkt, err);
+    // Everything the device plays is measured from the first samples we hand it
+    if (!has_audio_base.load(std::memory_order_acquire)) {
+        audio_base_pts.store(timeline_start);
+        audio_written_end = timeline_start;
+        has_audio_base.store(true, std::memory_order_release);
+    }
+    if (!WriteAudio(pcm.data() + first * frame_bytes, (last - first) * frame_bytes)) {
+        return false;
+    }
+    audio_written_end += static_cast<double>(last - first) / rate;
+    return true;
+}
 
-                // Rescale to our target resolution
-                const auto out_frame = rescaler->rescale(frame, err);
+bool Decoder::WriteSilence(double seconds) {
+    const std::size_t frame_bytes = audio_frame_bytes;
+    const double rate = static_cast<double>(audio_output.GetSpec().freq);
+    const auto silence_frames = static_cast<std::size_t>(seconds * rate);
+    auto silence = silence_frames * frame_bytes;
+    while (silence != 0) {
+        const auto chunk = std::min<std::size_t>(silence, audio_silence.size());
+        if (!WriteAudio(audio_silence.data(), chunk)) {
+            return false;
+        }
+        silence -= chunk;
+    }
+    audio_written_end += static_cast<double>(silence_frames) / rate;
+    return true;
+}
 
-                // Setup our container
-                HistoryContainer container{};
+bool Decoder::WriteAudio(const u8* data, std::size_t size) {
+    const TraceScope scope{trace.get(), GetFeedThread(TraceThread::AudioDecoder), "audio queue",
+                           audio_written_end};
 
-                // Width * Height * sizeof(RPGMaker Color)
-                container.data.resize(frame_width * frame_height * 4);
+    // Wait for the device to drain enough for the whole packet to fit under the high watermark.
+    // Volume is applied by the device as it plays so the samples go in untouched
+    while (IsAudioAboveHighWatermark(size)) {
+        if (kill_threads.load()) {
+            return false;
+        }
+        // Audio from before a seek is simply dropped, the ring gets flushed anyway
+        if (audio_segment.serial != seek_serial.load()) {
+            return true;
+        }
+        // The renderer may be waiting on us to prebuffer, let it see how far we got first
+        if (!clock.IsStarted()) {
+            WakeRenderer();
+        }
+        audio_output.WaitForDrain();
+    }
 
-                // The timestamp of where the video is
-                container.timestamp = pkt.ts();
+    audio_output.Write(data, size);
+    if (!clock.IsStarted()) {
+        WakeRenderer();
+    }
+    return true;
+}
 
-                // Write to our histroy buffer
-                std::memcpy(container.data.data(), out_frame.data(), container.data.size());
-                {
-                    std::lock_guard<std::shared_mutex> mutex(video_history_mutex);
-                    VIDEO_FRAME_HISTORY.push_back(container);
-                }
-            } else if (pkt.streamIndex() == audio_stream.index) {
-                // Decode audio stream
-                const auto samples = adec.decode(pkt, err);
-                // MessageBoxA(NULL, std::to_string(samples.size()).c_str(), NULL, NULL);
-                // Push samples to be resampled into our new format
-                resampler->push(samples, err);
-                if (err) {
-                    continue;
-                }
+void Decoder::DrainVideoDecoder() {
+    // An empty packet puts the codec into draining mode, every call hands back one of the frames
+    // it was still holding until there's none left
+    for (;;) {
+        std::error_code err{};
+        av::VideoFrame frame = vdec.decode(av::Packet{}, err);
+        if (err || !frame) {
+            return;
+        }
+        if (!QueueVideoFrame(std::move(frame), av::Timestamp{})) {
+            return;
+        }
+    }
+}
 
-                HistoryContainer container{};
-                // Our sample format is s16 with 2 channel audio
-                std::vector<u8> tmp(samples.samplesCount() * sample_width * 2);
+bool Decoder::QueueVideoFrame(av::VideoFrame frame, const av::Timestamp& packet_ts) {
+    frames_decoded++;
 
-                // Resample our audio for SDL
-                auto ouSamples = av::AudioSamples::null();
-                while ((ouSamples = resampler->pop(samples.samplesCount(), err))) {
-                    const auto idx = ouSamples.samplesCount() * sample_width * 2;
-                    std::memcpy(tmp.data() + tmp.size() - idx, ouSamples.data(), idx);
-                }
-                container.data.resize(tmp.size());
+    // The timestamp of where the video is, codecs with frame reordering hand frames back in a
+    // different order to the packets so prefer the frames own timestamp
+    const auto frame_ts = frame.pts();
+    const auto timestamp = frame_ts.isNoPts() ? packet_ts : frame_ts;
+    if (timestamp.isNoPts() || video_segment.serial != seek_serial.load()) {
+        return true;
+    }
+
+    // Frames before the start of the segment were only decoded to get there
+    const double media_ts = timestamp.seconds();
+    if (media_ts < video_segment.start || media_ts >= video_segment.end) {
+        return true;
+    }
+    const double timeline_ts = media_ts + video_segment.offset;
+
+    // Frames that are already late would only be thrown away by the renderer, so don't bother
+    // queuing them and let the codec cut corners if we're far behind
+    const auto lateness = GetPlaybackPosition() - timeline_ts;
+    UpdateFrameDiscarding(lateness);
+    if (lateness > 0.0) {
+        frames_skipped++;
+        return true;
+    }
 
-                // SDL requires the container buffer to be zero'd out before queuing otherwise we
-                // get junk noise
-                SDL_memset(container.data.data(), 0, container.data.size());
+    // Wait for the renderer to play through enough of the history to get under the high watermark
+    const TraceScope scope{trace.get(), TraceThread::VideoDecoder, "history push", timeline_ts};
+    VideoHistoryContainer* container = nullptr;
+    WaitForVideoSpace(container);
+    if (container == nullptr) {
+        return !kill_threads.load();
+    }
 
-                // Mix the audio just to bring down the volume so our ears don't bleed
-                SDL_MixAudioFormat(container.data.data(), tmp.data(), AUDIO_F32, tmp.size(),
-                                   static_cast<s32>(static_cast<float>(SDL_MIX_MAXVOLUME) *
-                                                    volume_percentage.load()));
+    const auto* raw = frame.raw();
+    const int frame_bytes = av_image_get_buffer_size(static_cast<AVPixelFormat>(raw->format),
+                                                     raw->width, raw->height, 1);
+    container->bytes = frame_bytes > 0 ? static_cast<std::size_t>(frame_bytes) : 0;
 
-                // Current audio timestamp
-                container.timestamp = samples.pts();
+    // Hand the reference counted frame over to our history, no pixels are copied here
+    container->frame = std::move(frame);
+    CommitVideoFrame(container, timeline_ts);
+    return true;
+}
 
-                // Write to the histroy buffer
-                {
-                    std::lock_guard<std::shared_mutex> mutex(audio_history_mutex);
-                    AUDIO_FRAME_HISTORY.push_back(container);
-                }
+void Decoder::CommitVideoFrame(VideoHistoryContainer* container, double timeline_ts) {
+    container->timestamp = timeline_ts;
+    container->offset = video_segment.offset;
+    container->serial = video_segment.serial;
+    video_history_bytes += container->bytes;
+    newest_video_ts.store(timeline_ts);
+    if (!has_queued_video.load()) {
+        first_video_ts.store(timeline_ts);
+        has_queued_video.store(true);
+    }
+    const bool was_empty = VIDEO_FRAME_HISTORY.Empty();
+    VIDEO_FRAME_HISTORY.CommitWrite();
+    UpdatePeakBufferedBytes();
+
+    // Once playing the renderer only waits on frames when it has run out of them
+    if (was_empty || !clock.IsStarted()) {
+        WakeRenderer();
+    }
+}
+
+bool Decoder::QueueBakedFrame(std::size_t frame) {
+    frames_decoded++;
+
+    // Late frames are skipped the same as decoded ones, there's no codec to let catch up though
+    const double timeline_ts = baked->GetFrameTimestamp(frame) + video_segment.offset;
+    if (GetPlaybackPosition() > timeline_ts) {
+        frames_skipped++;
+        return true;
+    }
+
+    const TraceScope scope{trace.get(), TraceThread::Demux, "history push", timeline_ts};
+    VideoHistoryContainer* container = nullptr;
+    WaitForVideoSpace(container);
+    if (container == nullptr) {
+        return !kill_threads.load();
+    }
+
+    // The pixels stay in the mapped file until the frame is presented
+    container->baked_frame = frame;
+    container->bytes = 0;
+    CommitVideoFrame(container, timeline_ts);
+    return true;
+}
+
+bool Decoder::WriteBakedAudio(std::size_t& position, std::size_t end) {
+    const std::size_t frame_bytes = audio_frame_bytes;
+    const double rate = static_cast<double>(audio_output.GetSpec().freq);
+    double timeline_start =
+        static_cast<double>(position / frame_bytes) / rate + audio_segment.offset;
+
+    // Loops are lined up with the end of the previous one the same way decoded audio is
+    if (has_audio_base.load() && !audio_segment_started) {
+        const double gap = timeline_start - audio_written_end;
+        if (gap > 0.0) {
+            if (!WriteSilence(gap)) {
+                return false;
             }
+        } else {
+            const auto skip = static_cast<std::size_t>(-gap * rate) * frame_bytes;
+            position = std::min<std::size_t>(position + skip, end);
+        }
+        timeline_start = audio_written_end;
+    }
+    audio_segment_started = true;
+
+    const auto size = std::min<std::size_t>(end - position, audio_buffer_size);
+    if (size == 0) {
+        return true;
+    }
+    if (!has_audio_base.load(std::memory_order_acquire)) {
+        audio_base_pts.store(timeline_start);
+        audio_written_end = timeline_start;
+        has_audio_base.store(true, std::memory_order_release);
+    }
+    if (!WriteAudio(baked->GetAudio() + position, size)) {
+        return false;
+    }
+    position += size;
+    audio_written_end += static_cast<double>(size / frame_bytes) / rate;
+    return true;
+}
+
+void Decoder::WaitForVideoSpace(VideoHistoryContainer*& container) {
+    while (IsVideoAboveHighWatermark() ||
+           (container = VIDEO_FRAME_HISTORY.AcquireWrite()) == nullptr) {
+        // A seek makes the frame we're holding stale, so there's no point waiting to queue it
+        if (kill_threads.load() || video_segment.serial != seek_serial.load()) {
+            container = nullptr;
+            return;
         }
+        if (!clock.IsStarted()) {
+            WakeRenderer();
+        }
+        video_space.Wait();
     }
 }
 
-void Decoder::MarkDecoderCompleted() {
-    is_decoder_complete.store(true);
+void Decoder::WakeRenderer() {
+    render_wake.Set();
+}
+
+void Decoder::MarkDecoderCompleted(u32 serial) {
+    // Finishing what was queued before a seek doesn't count
+    std::scoped_lock lock{seek_mutex};
+    if (serial != seek_serial.load() || running_decoders == 0) {
+        return;
+    }
+    if (--running_decoders == 0) {
+        is_decoder_complete.store(true);
+        WakeRenderer();
+    }
 }
 
 void Decoder::MarkRenderCompleted() {
@@ -308,7 +1164,543 @@ void Decoder::MarkRenderCompleted() {
 }
 
 void Decoder::SetVolume(float _volume_percentage) {
-    volume_percentage.store(_volume_percentage);
+    audio_output.SetVolume(_volume_percentage);
+}
+
+u64 Decoder::GetPlaybackAllocations() const {
+    // The converters count their own, the frame converter is made in Setup before any frame can
+    // be presented
+    u64 allocations = playback_allocations.load() + compactor.GetAllocations() +
+                      audio_converter.GetAllocations();
+    if (converter) {
+        allocations += converter->GetAllocations();
+    }
+    return allocations;
+}
+
+void Decoder::PreallocateBuffers() {
+    // Size our scratch buffers once up front so steady state playback never has to touch the
+    // heap. Video slots only hold references to the codecs pooled frames and the PCM ring is
+    // allocated when the device opens, so they need nothing here
+    audio_scratch.reserve(audio_buffer_size);
+}
+
+void Decoder::ResizePooled(std::vector<u8>& buffer, std::size_t size) {
+    if (size > buffer.capacity()) {
+        playback_allocations++;
+    }
+    buffer.resize(size);
+}
+
+bool Decoder::PresentFrame(const av::VideoFrame& frame, double timestamp) {
+    // Convert straight into the bitmaps memory, starting from the top line with a negative pitch
+    // as the engine stores its bitmaps bottom-up
+    const auto bitmap = sink->GetSurface();
+    if (bitmap.top_line == nullptr || frame.raw() == nullptr) {
+        return false;
+    }
+
+    // Only the rows and columns inside the viewport are ever written
+    UpdateViewport(*frame.raw(), bitmap);
+    const auto surface = GetViewportSurface(bitmap, viewport);
+
+    // The frame has to be on screen before the next one is due, which decides how urgently the
+    // scheduler helps us compared to other videos
+    const double convert_start = Platform::GetMonotonicSeconds();
+    const double deadline = convert_start + video_frame_duration;
+    const bool converted = converter->Convert(frame, surface.top_line, surface.pitch, deadline);
+    const double convert_end = Platform::GetMonotonicSeconds();
+    last_convert_seconds.store(convert_end - convert_start);
+    rescale_times.Record(convert_end - convert_start);
+    if (trace) {
+        trace->Record(TraceThread::Render, "rescale", convert_start, convert_end, timestamp);
+    }
+    return converted;
+}
+
+void Decoder::UpdateViewport(const AVFrame& raw, const Blit::Surface& surface) {
+    const auto sar = raw.sample_aspect_ratio;
+    const double pixel_aspect =
+        sar.num > 0 && sar.den > 0 ? static_cast<double>(sar.num) / sar.den : 1.0;
+    const double display_aspect =
+        raw.height > 0 ? static_cast<double>(raw.width) * pixel_aspect / raw.height : 0.0;
+
+    // Nothing to do unless the game asked for something new or the video changed shape
+    const u32 version = viewport_version.load();
+    if (has_viewport && version == applied_viewport_version &&
+        display_aspect == applied_display_aspect) {
+        return;
+    }
+
+    ViewportRect rect{};
+    {
+        std::scoped_lock lock{viewport_mutex};
+        rect = ResolveViewport(viewport_mode, custom_viewport, surface.width, surface.height,
+                               display_aspect);
+    }
+    applied_viewport_version = version;
+    applied_display_aspect = display_aspect;
+    if (has_viewport && rect == viewport) {
+        return;
+    }
+
+    // The border never changes between frames, so it's cleared here rather than every frame
+    ClearViewportBorder(surface, rect);
+    converter->SetOutputSize(rect.width, rect.height);
+    viewport = rect;
+    has_viewport = true;
+}
+
+bool Decoder::SetViewport(ViewportMode mode, const ViewportRect& rect) {
+    if (mode == ViewportMode::Custom && !IsViewportInside(rect, frame_width, frame_height)) {
+        return false;
+    }
+    {
+        std::scoped_lock lock{viewport_mutex};
+        viewport_mode = mode;
+        custom_viewport = rect;
+    }
+    viewport_version++;
+    return true;
+}
+
+void Decoder::SetScaler(ScalerQuality quality) {
+    scaler_quality.store(quality);
+    if (converter) {
+        converter->SetScaler(quality);
+    }
+}
+
+bool Decoder::PresentBakedFrame(std::size_t frame) {
+    const auto surface = sink->GetSurface();
+    if (surface.top_line == nullptr) {
+        return false;
+    }
+    const double copy_start = Platform::GetMonotonicSeconds();
+    const bool copied = baked->CopyFrame(frame, surface);
+    blit_times.Record(Platform::GetMonotonicSeconds() - copy_start);
+    return copied;
+}
+
+bool Decoder::OpenVideoDecoder(int lowres, std::error_code& err) {
+    av::VideoDecoderContext ctx(video_stream.stream);
+    av::Codec codec = av::findDecodingCodec(ctx.raw()->codec_id);
+    if (!codec.isNull()) {
+        max_lowres = codec.raw()->max_lowres;
+    }
+
+    ctx.setCodec(codec);
+    ctx.setRefCountedFrames(true);
+
+    // Frame threading decodes several frames at once at the cost of a frame of latency per
+    // thread, slice threading splits up a single frame for codecs and streams that support it
+    u32 thread_count = settings.video_thread_count;
+    const u32 generation = scheduler->GetStreamGeneration();
+    if (thread_count == 0) {
+        // An even share of the scheduler's budget, taken back up at the next keyframe whenever
+        // another video starts or stops, see RebalanceVideoThreads
+        thread_count = static_cast<u32>(std::min<std::size_t>(scheduler->GetStreamThreadShare(),
+                                                              MAX_AUTO_VIDEO_THREADS));
+    }
+    u32 thread_type = settings.video_thread_type & (VIDEO_THREAD_FRAME | VIDEO_THREAD_SLICE);
+    if (thread_type == 0) {
+        thread_type = VIDEO_THREAD_FRAME | VIDEO_THREAD_SLICE;
+    }
+    ctx.raw()->thread_count = static_cast<int>(thread_count);
+    ctx.raw()->thread_type = static_cast<int>(thread_type);
+
+    // These can only be set before the codec is opened, so keep whatever was active before
+    ctx.raw()->lowres = std::min<int>(lowres, max_lowres);
+    ctx.raw()->skip_frame = discarding_frames ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    ctx.raw()->skip_loop_filter = quality_ladder.IsActive(QualityRung::SkipLoopFilter)
+                                      ? AVDISCARD_ALL
+                                      : AVDISCARD_DEFAULT;
+
+    ctx.open(av::Codec(), err);
+    if (err) {
+        return false;
+    }
+
+    // Frames already in the history hold their own references, so they outlive the old context
+    vdec = std::move(ctx);
+    video_lowres = vdec.raw()->lowres;
+
+    // The codec drops any threading mode it can't do while opening
+    const auto active_type = static_cast<u32>(vdec.raw()->active_thread_type);
+    const u32 active_count = active_type != 0 ? static_cast<u32>(vdec.raw()->thread_count) : 1;
+    video_thread_type.store(active_type);
+    video_thread_count.store(active_count);
+
+    // Codec threads beyond the one the video thread stands for come out of the scheduler's
+    // budget, so the workers back off instead of oversubscribing the machine
+    scheduler->ClaimStreamThreads(active_count - 1);
+    scheduler->ReleaseStreamThreads(claimed_video_threads);
+    claimed_video_threads = active_count - 1;
+    requested_video_threads = thread_count;
+    video_thread_generation = generation;
+    return true;
+}
+
+bool Decoder::RebalanceVideoThreads() {
+    const u32 generation = scheduler->GetStreamGeneration();
+    if (settings.video_thread_count != 0 || generation == video_thread_generation) {
+        return true;
+    }
+    const auto share = static_cast<u32>(
+        std::min<std::size_t>(scheduler->GetStreamThreadShare(), MAX_AUTO_VIDEO_THREADS));
+    if (share == requested_video_threads) {
+        video_thread_generation = generation;
+        return true;
+    }
+
+    // Get back whatever the old codec is holding first, the new one starts clean on this keyframe
+    DrainVideoDecoder();
+    std::error_code err{};
+    if (!OpenVideoDecoder(video_lowres, err)) {
+        SetInternalError(err);
+        return false;
+    }
+    return true;
+}
+
+bool Decoder::UpdateQuality(double decode_seconds) {
+    bool changed = false;
+
+    // Codecs without lowres support can't use the last rung at all
+    u32 allowed = quality_rungs_allowed.load();
+    if (max_lowres == 0) {
+        allowed &= ~QualityRungBit(QualityRung::LowResolution);
+    }
+    if (allowed != quality_ladder.GetAllowedRungs()) {
+        quality_ladder.SetAllowedRungs(allowed);
+        changed = true;
+    }
+
+    // Decoding and conversion run on separate threads, whichever is slower is what holds us back
+    const double cost = std::max<double>(decode_seconds, last_convert_seconds.load());
+    if (quality_ladder.Update(cost)) {
+        changed = true;
+    }
+
+    if (!changed) {
+        return true;
+    }
+    return ApplyQualityRung();
+}
+
+bool Decoder::ApplyQualityRung() {
+    const int lowres = quality_ladder.IsActive(QualityRung::LowResolution) ? 1 : 0;
+    if (lowres != video_lowres) {
+        // Decoding at a lower resolution needs the codec reopening, the bitmap is still filled as
+        // the converter scales the smaller frames back up
+        std::error_code err{};
+        if (!OpenVideoDecoder(lowres, err)) {
+            SetInternalError(err);
+            return false;
+        }
+        awaiting_keyframe = true;
+    }
+
+    vdec.raw()->skip_loop_filter = quality_ladder.IsActive(QualityRung::SkipLoopFilter)
+                                       ? AVDISCARD_ALL
+                                       : AVDISCARD_DEFAULT;
+    converter->SetFastScaling(quality_ladder.IsActive(QualityRung::FastScaling));
+    quality_rung.store(quality_ladder.GetRung());
+    return true;
+}
+
+double Decoder::GetPlaybackPosition() const {
+    // Nothing can be late before rendering starts
+    if (!clock.IsStarted()) {
+        return std::numeric_limits<double>::lowest();
+    }
+
+    double position{};
+    if (!clock.IsPaused() && GetAudioPosition(position)) {
+        return position;
+    }
+    return clock.GetPosition();
+}
+
+bool Decoder::GetAudioPosition(double& position) const {
+    if (!has_audio || !has_audio_base.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    double played{};
+    if (!audio_output.GetPlayedSeconds(Platform::GetMonotonicSeconds(), played)) {
+        return false;
+    }
+    position = audio_base_pts.load() + played;
+    return true;
+}
+
+void Decoder::UpdateClock() {
+    // Keep the monotonic clock on the audio so nothing jumps when it has to take over
+    double position{};
+    const bool audio_master = !clock.IsPaused() && GetAudioPosition(position);
+    if (audio_master) {
+        clock.Sync(position);
+    }
+    audio_is_master.store(audio_master);
+}
+
+bool Decoder::WaitForFrame(double timestamp, u32 serial, const Platform::FocusTracker& focus) {
+    while (true) {
+        if (kill_threads.load() || !focus.HasFocus() ||
+            seek_serial.load() != serial) {
+            return false;
+        }
+
+        UpdateClock();
+        const double remaining = timestamp - GetPlaybackPosition();
+        if (remaining <= 0.0) {
+            return true;
+        }
+        render_timer.Wait(std::min<double>(remaining, MAX_WAIT_SLICE), &render_wake);
+    }
+}
+
+void Decoder::RecordPresentation(double timestamp) {
+    const double now = Platform::GetMonotonicSeconds();
+    const double drift = GetPlaybackPosition() - timestamp;
+
+    std::scoped_lock lock{sync_stats_mutex};
+    last_drift = drift;
+    drift_total += drift;
+    max_drift = std::max<double>(max_drift, std::abs(drift));
+    if (has_present_reference && timestamp > last_present_ts) {
+        const double jitter = (now - last_present_wall) - (timestamp - last_present_ts);
+        jitter_squared_total += jitter * jitter;
+        jitter_samples++;
+    }
+    has_present_reference = true;
+    presented_frames++;
+    last_present_wall = now;
+    last_present_ts = timestamp;
+}
+
+void Decoder::GetSyncStats(SyncStats& stats) const {
+    stats.audio_master = audio_is_master.load() ? 1 : 0;
+
+    std::scoped_lock lock{sync_stats_mutex};
+    const auto to_us = [](double seconds) { return seconds * 1000000.0; };
+    stats.average_drift_us =
+        presented_frames != 0
+            ? static_cast<s32>(to_us(drift_total / static_cast<double>(presented_frames)))
+            : 0;
+    stats.max_drift_us = static_cast<u32>(to_us(max_drift));
+    stats.frame_jitter_us =
+        jitter_samples != 0
+            ? static_cast<u32>(
+                  to_us(std::sqrt(jitter_squared_total / static_cast<double>(jitter_samples))))
+            : 0;
+    stats.presented_frames = static_cast<u32>(presented_frames);
+}
+
+void Decoder::GetStats(PlaybackStats& stats) const {
+    stats.frames_decoded = static_cast<u32>(frames_decoded.load());
+    stats.frames_dropped = static_cast<u32>(frames_dropped.load());
+    stats.frames_skipped = static_cast<u32>(frames_skipped.load());
+    stats.frames_discarded = static_cast<u32>(frames_discarded.load());
+
+    demux_times.Summarize(stats.demux);
+    decode_times.Summarize(stats.decode);
+    rescale_times.Summarize(stats.rescale);
+    blit_times.Summarize(stats.blit);
+
+    const auto to_ms = [](double seconds) { return static_cast<u32>(seconds * 1000.0); };
+    stats.video_queued_frames = static_cast<u32>(VIDEO_FRAME_HISTORY.Size());
+    stats.video_queued_ms = to_ms(GetBufferedVideoSeconds());
+    stats.video_queued_packets = static_cast<u32>(video_packets.GetSize());
+    stats.audio_queued_packets = static_cast<u32>(audio_packets.GetSize());
+    if (has_audio && audio_output.GetBytesPerSecond() != 0) {
+        stats.audio_queued_ms = to_ms(static_cast<double>(audio_output.GetBuffered()) /
+                                      static_cast<double>(audio_output.GetBytesPerSecond()));
+    }
+    stats.audio_underruns = static_cast<u32>(audio_output.GetUnderruns());
+
+    stats.buffered_bytes = static_cast<u32>(GetBufferedBytes());
+    stats.peak_buffered_bytes = static_cast<u32>(peak_buffered_bytes.load());
+    stats.decode_errors = static_cast<u32>(video_decode_errors.load());
+
+    std::scoped_lock lock{sync_stats_mutex};
+    stats.frames_presented = static_cast<u32>(presented_frames);
+    stats.current_drift_us = static_cast<s32>(last_drift * 1000000.0);
+    stats.average_drift_us =
+        presented_frames != 0
+            ? static_cast<s32>(drift_total / static_cast<double>(presented_frames) * 1000000.0)
+            : 0;
+}
+
+bool Decoder::HasAudio() const {
+    return has_audio;
+}
+
+void Decoder::UpdateFrameDiscarding(double lateness) {
+    const auto margin = static_cast<double>(settings.late_discard_margin_ms) / 1000.0;
+    if (!discarding_frames && lateness > margin) {
+        // Non-reference frames can be dropped without breaking anything decoded after them
+        vdec.raw()->skip_frame = AVDISCARD_NONREF;
+        discarding_frames = true;
+    } else if (discarding_frames && lateness <= 0.0) {
+        vdec.raw()->skip_frame = AVDISCARD_DEFAULT;
+        discarding_frames = false;
+    }
+}
+
+void Decoder::SetQualityLadder(u32 allowed_rungs) {
+    quality_rungs_allowed.store(allowed_rungs & ALL_QUALITY_RUNGS);
+}
+
+u32 Decoder::GetQualityLadder() const {
+    return quality_rungs_allowed.load();
+}
+
+QualityRung Decoder::GetQualityRung() const {
+    return quality_rung.load();
+}
+
+u32 Decoder::GetVideoThreadCount() const {
+    return video_thread_count.load();
+}
+
+u32 Decoder::GetVideoThreadType() const {
+    return video_thread_type.load();
+}
+
+u64 Decoder::GetDroppedFrames() const {
+    return frames_dropped.load();
+}
+
+u64 Decoder::GetSkippedFrames() const {
+    return frames_skipped.load();
+}
+
+u64 Decoder::GetDiscardedFrames() const {
+    return frames_discarded.load();
+}
+
+double Decoder::GetBufferedVideoSeconds() const {
+    if (VIDEO_FRAME_HISTORY.Empty()) {
+        return 0.0;
+    }
+
+    // Before playback starts everything from the first queued frame onwards is still ahead of us
+    const double from = clock.IsStarted() ? GetPlaybackPosition() : first_video_ts.load();
+    return std::max<double>(newest_video_ts.load() - from + video_frame_duration, 0.0);
+}
+
+bool Decoder::IsVideoAboveHighWatermark() const {
+    if (VIDEO_FRAME_HISTORY.Full()) {
+        return true;
+    }
+
+    // A single frame always gets through, otherwise a frame larger than the byte limit would
+    // stall everything
+    if (VIDEO_FRAME_HISTORY.Empty()) {
+        return false;
+    }
+    return GetBufferedVideoSeconds() >= max_buffer_seconds ||
+           video_history_bytes.load() >= max_buffer_bytes;
+}
+
+bool Decoder::IsAudioAboveHighWatermark(std::size_t incoming) const {
+    if (!has_audio) {
+        return false;
+    }
+    return audio_output.GetFree() < incoming ||
+           audio_output.GetBuffered() + incoming > audio_high_watermark;
+}
+
+void Decoder::ReleaseFrontFrame() {
+    // Release the decoded frame back to the decoder, dropping our reference to its buffers
+    auto* container = VIDEO_FRAME_HISTORY.Front();
+    if (container == nullptr) {
+        return;
+    }
+    const TraceScope scope{trace.get(), TraceThread::Render, "history pop", container->timestamp};
+    video_history_bytes -= container->bytes;
+    container->frame = av::VideoFrame{};
+    container->bytes = 0;
+    VIDEO_FRAME_HISTORY.Pop();
+    video_space.Set();
+}
+
+void Decoder::ApplyMemoryLimit() {
+    const std::size_t limit = settings.memory_limit_bytes;
+    if (limit == 0) {
+        return;
+    }
+
+    // Give the audio ring and packet queues a small slice each and leave the rest for decoded
+    // frames. The audio ring still has to hold a couple of packets no matter what
+    audio_high_watermark = std::min<std::size_t>(audio_high_watermark, limit / 8);
+    audio_high_watermark = std::max<std::size_t>(audio_high_watermark, audio_buffer_size * 2);
+    audio_start_size = std::min<std::size_t>(audio_start_size, audio_high_watermark);
+
+    const auto video_packet_bytes = std::min<std::size_t>(MAX_VIDEO_PACKET_BYTES, limit / 8);
+    const auto audio_packet_bytes = std::min<std::size_t>(MAX_AUDIO_PACKET_BYTES, limit / 32);
+    video_packets.SetLimits(MAX_VIDEO_PACKETS, video_packet_bytes);
+    audio_packets.SetLimits(MAX_AUDIO_PACKETS, audio_packet_bytes);
+
+    // The ring is rounded up to a power of two when it's created, so count the worst case
+    const auto reserved = audio_high_watermark * 2 + video_packet_bytes + audio_packet_bytes;
+    const auto frame_budget = limit > reserved ? limit - reserved : 1;
+    max_buffer_bytes = std::min<std::size_t>(max_buffer_bytes, frame_budget);
+}
+
+std::size_t Decoder::GetBufferedBytes() const {
+    return video_history_bytes.load() + video_packets.GetBytes() + audio_packets.GetBytes() +
+           audio_output.GetCapacity();
+}
+
+void Decoder::UpdatePeakBufferedBytes() {
+    const auto buffered = GetBufferedBytes();
+    auto peak = peak_buffered_bytes.load();
+    while (buffered > peak && !peak_buffered_bytes.compare_exchange_weak(peak, buffered)) {
+    }
+}
+
+void Decoder::SampleWorkingSet() {
+    const auto working_set = Platform::GetWorkingSetBytes();
+    auto peak = peak_working_set.load();
+    while (working_set > peak && !peak_working_set.compare_exchange_weak(peak, working_set)) {
+    }
+}
+
+std::size_t Decoder::GetPeakWorkingSet() const {
+    return peak_working_set.load();
+}
+
+std::size_t Decoder::GetPeakBufferedBytes() const {
+    return peak_buffered_bytes.load();
+}
+
+bool Decoder::IsPrebuffered() const {
+    if (is_decoder_complete.load()) {
+        return true;
+    }
+
+    // Until the audio decoder gets to a seek the ring only holds audio from before it
+    const bool audio_current = !has_audio || audio_serial.load() == seek_serial.load();
+
+    // Either stream reaching its high watermark means the decoder can't make any more progress on
+    // the other one, so we have to start rendering from what we have
+    if (IsVideoAboveHighWatermark() ||
+        (audio_current && IsAudioAboveHighWatermark(audio_buffer_size))) {
+        return true;
+    }
+
+    if (VIDEO_FRAME_HISTORY.Empty()) {
+        return false;
+    }
+
+    const bool video_ready = GetBufferedVideoSeconds() >= start_buffer_seconds ||
+                             (start_buffer_bytes != 0 &&
+                              video_history_bytes.load() >= start_buffer_bytes);
+    return video_ready && audio_current &&
+           (!has_audio || audio_output.GetBuffered() >= audio_start_size);
 }
 
 bool Decoder::WasBadTermination() const {
@@ -316,128 +1708,193 @@ bool Decoder::WasBadTermination() const {
 }
 
 void Decoder::Render() {
-    // Get the active window so when we lose focus we can freeze the video as we're decoding on a
-    // secondary thread as well as writing to memory
-    game_window = GetForegroundWindow();
+    // Follow the active window so when we lose focus we can freeze the video as we're decoding on
+    // a secondary thread as well as writing to memory
+    const Platform::FocusTracker focus{render_wake};
 
-    while (VIDEO_FRAME_HISTORY.size() < VIDEO_FRAME_HISTORY_SIZE ||
-           AUDIO_FRAME_HISTORY.size() < AUDIO_FRAME_HISTORY_SIZE) {
-        Sleep(1);
+    // Each pass plays from the last seek until the video ends or the game seeks again
+    while (true) {
+        const u32 serial = seek_serial.load();
+        if (!WaitForPrebuffer(serial)) {
+            if (kill_threads.load()) {
+                return;
+            }
+            continue;
+        }
+
+        StartClock();
+        if (!RenderFrames(serial, focus)) {
+            return;
+        }
+    }
+}
+
+bool Decoder::WaitForPrebuffer(u32 serial) {
+    audio_output.Pause(true);
+    PurgeStaleFrames(serial);
+    while (!IsPrebuffered()) {
+        if (kill_threads.load() || seek_serial.load() != serial) {
+            return false;
+        }
+        render_timer.WaitForWake(render_wake);
+        PurgeStaleFrames(serial);
     }
+    return !kill_threads.load() && seek_serial.load() == serial;
+}
 
-    using namespace std::chrono;
-    start_tps = high_resolution_clock::now();
+void Decoder::PurgeStaleFrames(u32 serial) {
+    // Frames from before a seek always come out ahead of the ones after it
+    for (auto* container = VIDEO_FRAME_HISTORY.Front();
+         container != nullptr && container->serial != serial;
+         container = VIDEO_FRAME_HISTORY.Front()) {
+        ReleaseFrontFrame();
+    }
+}
 
+void Decoder::StartClock() {
+    // Start from whatever is meant to be heard first, the audio takes over as soon as the
+    // device starts pulling from the ring
+    auto* first = VIDEO_FRAME_HISTORY.Front();
+    if (has_audio && has_audio_base.load(std::memory_order_acquire)) {
+        clock.Start(audio_base_pts.load());
+    } else {
+        clock.Start(first != nullptr ? first->timestamp : 0.0);
+    }
+    {
+        std::scoped_lock lock{sync_stats_mutex};
+        has_present_reference = false;
+    }
+    audio_output.Pause(false);
+}
+
+bool Decoder::RenderFrames(u32 serial, const Platform::FocusTracker& focus) {
+    auto last_working_set_sample = Platform::GetMonotonicSeconds();
     while (true) {
-        {
-            std::shared_lock<std::shared_mutex> mutex(video_history_mutex);
-            if (is_decoder_complete.load() && VIDEO_FRAME_HISTORY.empty()) {
-                break;
+        if (kill_threads.load()) {
+            return false;
+        }
+        if (seek_serial.load() != serial) {
+            return true;
+        }
+
+        if (is_decoder_complete.load() && VIDEO_FRAME_HISTORY.Empty()) {
+            // A seek can come in just as we finish, in which case we go round again
+            std::scoped_lock lock{seek_mutex};
+            if (seek_serial.load() != serial) {
+                return true;
             }
+            MarkRenderCompleted();
+            return false;
+        }
+
+        // Freeze the clock and the audio while we don't have focus so nothing runs ahead of
+        // the game
+        if (!focus.HasFocus()) {
+            const TraceScope scope{trace.get(), TraceThread::Render, "focus pause",
+                                   GetPlaybackPosition()};
+            clock.Pause();
+            audio_output.Pause(true);
+            while (!focus.HasFocus()) {
+                if (kill_threads.load()) {
+                    return false;
+                }
+                // Without the hook we have to check back every so often
+                if (focus.NotifiesChanges()) {
+                    render_timer.WaitForWake(render_wake);
+                } else {
+                    render_timer.Wait(FOCUS_POLL_INTERVAL, &render_wake);
+                }
+            }
+            clock.Resume();
+            audio_output.Pause(false);
+        }
+        UpdateClock();
+
+        // Only the renderer consumes from the histories, so the slots we look at here can't be
+        // touched by the decoder until we pop them
+        PurgeStaleFrames(serial);
+        auto* container = VIDEO_FRAME_HISTORY.Front();
+        if (container == nullptr) {
+            render_timer.WaitForWake(render_wake);
+            continue;
         }
 
-        // Handle audio/video TPS shift when we lose focus from the window
-        auto before_shift = high_resolution_clock::now();
-        bool need_shift = false;
-        while (GetForegroundWindow() != game_window) {
-            SDL_PauseAudioDevice(audio_device, 1);
-            Sleep(1);
-            need_shift = true;
+        // Frame skipping
+        const double position = GetPlaybackPosition();
+        while (container != nullptr && container->serial == serial &&
+               container->timestamp < position) {
+            frames_dropped++;
+            ReleaseFrontFrame();
+            container = VIDEO_FRAME_HISTORY.Front();
         }
-        auto post_shift = high_resolution_clock::now();
-        if (need_shift) {
-            time_shift += std::chrono::duration<double>(post_shift - before_shift).count();
-            SDL_PauseAudioDevice(audio_device, 0);
+
+        if (container == nullptr || container->serial != serial) {
+            continue;
+        }
+
+        // Wait till we get to the correct timestamp, losing focus or seeking on the way sends us
+        // back round
+        const double timestamp = container->timestamp;
+        if (!WaitForFrame(timestamp, serial, focus)) {
+            continue;
         }
 
+        // Write video frame
+        bool presented{};
         {
-            // We manually handle mutexes here to ensure the ahead of time decoder doesn't stall
-            // any longer than it should
-            video_history_mutex.lock_shared();
-            if (!VIDEO_FRAME_HISTORY.empty()) {
-                video_history_mutex.unlock_shared();
-
-                auto now = high_resolution_clock::now();
-                real_ts = now - start_tps;
-
-                // Write video frame to our bitmap
-                {
-                    std::lock_guard<std::shared_mutex> mutex(video_history_mutex);
-                    auto& container = VIDEO_FRAME_HISTORY.front();
-
-                    // Frame skipping
-                    if ((container.timestamp.seconds() + time_shift) < real_ts.count()) {
-                        for (auto it = VIDEO_FRAME_HISTORY.begin();
-                             it != VIDEO_FRAME_HISTORY.end();) {
-                            if ((it->timestamp.seconds() + time_shift) < real_ts.count()) {
-                                it = VIDEO_FRAME_HISTORY.erase(it);
-                            } else {
-                                break;
-                            }
-                        }
-                    }
-
-                    if (!VIDEO_FRAME_HISTORY.empty()) {
-                        container = VIDEO_FRAME_HISTORY.front();
-                        // Wait till we get to the correct timestamp
-                        while ((container.timestamp.seconds() + time_shift) > real_ts.count()) {
-                            Sleep(1);
-                            now = high_resolution_clock::now();
-                            real_ts = now - start_tps;
-                        }
-
-                        // Send samples to play up to our tps
-                        {
-                            std::lock_guard<std::shared_mutex> mutex(audio_history_mutex);
-                            if (!AUDIO_FRAME_HISTORY.empty()) {
-                                for (auto it = AUDIO_FRAME_HISTORY.begin();
-                                     it != AUDIO_FRAME_HISTORY.end();) {
-                                    if ((it->timestamp.seconds() + time_shift) >= real_ts.count() ||
-                                        AUDIO_FRAME_HISTORY.empty()) {
-                                        break;
-                                    } else {
-                                        SDL_QueueAudio(audio_device, it->data.data(),
-                                                       it->data.size());
-                                        it = AUDIO_FRAME_HISTORY.erase(it);
-                                    }
-                                }
-                            }
-                        }
-
-                        // Write video frame
-                        if (!bitmap->WriteBufferFlipped(container.data.data(),
-                                                        container.data.size())) {
-                            // Failed to write buffer
-                            std::lock_guard<std::shared_mutex> mutex_audio(audio_history_mutex);
-                            VIDEO_FRAME_HISTORY.clear();
-                            AUDIO_FRAME_HISTORY.clear();
-                            kill_threads.store(true);
-                            return;
-                        }
-
-                        // Delete decoded frame
-                        VIDEO_FRAME_HISTORY.erase(VIDEO_FRAME_HISTORY.begin());
-                    }
-                }
-            } else {
-                video_history_mutex.unlock_shared();
+            const TraceScope scope{trace.get(), TraceThread::Render, "bitmap write", timestamp};
+            presented = baked ? PresentBakedFrame(container->baked_frame)
+                              : PresentFrame(container->frame, timestamp);
+        }
+        if (!presented) {
+            // Failed to write buffer, the queued frames go back the same way presented ones do so
+            // their buffers and the queued byte count are released with them
+            kill_threads.store(true);
+            while (VIDEO_FRAME_HISTORY.Front() != nullptr) {
+                ReleaseFrontFrame();
             }
+            audio_output.Pause(true);
+            return false;
+        }
+        RecordPresentation(timestamp);
+        presented_position.store(timestamp - container->offset);
+
+        ReleaseFrontFrame();
+
+        const double now = Platform::GetMonotonicSeconds();
+        if (now - last_working_set_sample >= WORKING_SET_SAMPLE_INTERVAL) {
+            SampleWorkingSet();
+            last_working_set_sample = now;
         }
     }
 }
 
+/* Bootstrap for the demuxer feeding both decoders */
+void DemuxBootstrap(void* param) {
+    auto* ffmpeg = static_cast<Decoder*>(param);
+    ffmpeg->DemuxPackets();
+}
+
 /* Bootstrap for the ahead of time video decoder */
-DWORD WINAPI DecoderBootstrap(LPVOID lpParam) {
-    auto* ffmpeg = static_cast<Decoder*>(lpParam);
-    ffmpeg->AheadOfTimeDecoder();
-    ffmpeg->MarkDecoderCompleted();
-    return 0;
+void VideoDecoderBootstrap(void* param) {
+    auto* ffmpeg = static_cast<Decoder*>(param);
+    ffmpeg->DecodeVideo();
+}
+
+/* Bootstrap for the ahead of time audio decoder */
+void AudioDecoderBootstrap(void* param) {
+    auto* ffmpeg = static_cast<Decoder*>(param);
+    ffmpeg->DecodeAudio();
 }
 
 /* Bootstrap for bitmap rendering for RPG Maker XP */
-DWORD WINAPI RenderBootstrap(LPVOID lpParam) {
-    auto* ffmpeg = static_cast<Decoder*>(lpParam);
+void RenderBootstrap(void* param) {
+    auto* ffmpeg = static_cast<Decoder*>(param);
     ffmpeg->Render();
-    ffmpeg->MarkRenderCompleted();
-    return 0;
+}
+
+/* Bootstrap for feeding a baked video to the renderer */
+void BakedFeedBootstrap(void* param) {
+    auto* ffmpeg = static_cast<Decoder*>(param);
+    ffmpeg->FeedBaked();
 }
@@ -1,17 +1,17 @@
 #pragma once
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <memory>
-#include <shared_mutex>
-#include <Windows.h>
+#include <mutex>
+#include <string>
+#include <vector>
 
-#include <audioresampler.h>
 #include <av.h>
 #include <avutils.h>
 #include <codec.h>
 #include <ffmpeg.h>
 #include <packet.h>
-#include <videorescaler.h>
 
 #include <codec.h>
 #include <codeccontext.h>
@@ -19,36 +19,199 @@
 #include <formatcontext.h>
 
 #include <SDL_audio.h>
+#include "audio_converter.h"
+#include "audio_output.h"
+#include "baked_video.h"
 #include "common_types.h"
+#include "decoder_settings.h"
+#include "frame_compactor.h"
+#include "frame_converter.h"
+#include "frame_sink.h"
+#include "keyframe_index.h"
+#include "media_clock.h"
+#include "media_input.h"
+#include "packet_queue.h"
+#include "platform.h"
+#include "playback_stats.h"
+#include "quality_ladder.h"
+#include "task_scheduler.h"
+#include "trace_recorder.h"
+#include "viewport.h"
 
-namespace RPGMaker {
-class Bitmap;
-}
+/// Fixed capacity single producer, single consumer ring of preallocated slots. The producer fills
+/// a slot in place between AcquireWrite() and CommitWrite(), the consumer reads it in place between
+/// Front() and Pop(). Both sides only ever touch their own index with release semantics and read
+/// the other side's index with acquire semantics, so no locks are needed for the hand over.
+template <typename T, std::size_t Capacity>
+class SpscRing {
+    static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscRing capacity must be a power of two");
+
+public:
+    /// Producer: returns the next free slot or nullptr if the ring is full
+    T* AcquireWrite() {
+        const auto head = write_index.load(std::memory_order_relaxed);
+        if (head - read_index.load(std::memory_order_acquire) == Capacity) {
+            return nullptr;
+        }
+        return &slots[head & MASK];
+    }
+
+    /// Producer: publishes the slot returned by AcquireWrite()
+    void CommitWrite() {
+        write_index.store(write_index.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_release);
+    }
+
+    /// Consumer: returns the oldest published slot or nullptr if the ring is empty
+    T* Front() {
+        const auto tail = read_index.load(std::memory_order_relaxed);
+        if (tail == write_index.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots[tail & MASK];
+    }
+
+    /// Consumer: releases the slot returned by Front() back to the producer
+    void Pop() {
+        read_index.store(read_index.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_release);
+    }
+
+    std::size_t Size() const {
+        // Read the tail first so a concurrent Pop() can never make the size underflow
+        const auto tail = read_index.load(std::memory_order_acquire);
+        return write_index.load(std::memory_order_acquire) - tail;
+    }
+
+    bool Empty() const {
+        return Size() == 0;
+    }
+
+    bool Full() const {
+        return Size() == Capacity;
+    }
+
+    static constexpr std::size_t GetCapacity() {
+        return Capacity;
+    }
+
+    /// Visits every slot, only safe to call while neither the producer nor the consumer is running
+    template <typename Func>
+    void ForEachSlot(Func&& func) {
+        for (auto& slot : slots) {
+            func(slot);
+        }
+    }
+
+private:
+    static constexpr std::size_t MASK = Capacity - 1;
+
+    // Keep both indices on their own cache line so the two threads don't false share
+    alignas(64) std::atomic<std::size_t> write_index{0};
+    alignas(64) std::atomic<std::size_t> read_index{0};
+    std::array<T, Capacity> slots{};
+};
 
 class Decoder {
 public:
-    Decoder(EngineAddr target);
+    /// Frames are drawn into target, which has to stay the same size for as long as the decoder
+    /// is alive
+    Decoder(std::unique_ptr<FrameSink> target, const DecoderSettings& settings);
     ~Decoder();
 
+    /// Records a trace of the pipeline threads and writes it to path once the decoder is
+    /// destroyed, see TraceRecorder. Has to be called before Setup
+    void EnableTracing(const char* path);
+
+    /// The first error the decoder ran into. Once there is one the message never changes, so it
+    /// stays valid until the decoder is destroyed. Empty while there hasn't been an error
     s32 GetInternalError() const;
     const char* GetInternalErrorMessage() const;
 
     bool IsCompleted() const;
 
+    /// Baked videos (see BakedVideo) are recognised by their header and played back without
+    /// any decoding
     ErrorCode Setup(char* video_path);
-    SDL_AudioFormat DecideBestFormat(av::SampleFormat format) const;
-    av::SampleFormat DecideBestTarget(av::SampleFormat format) const;
+    /// Opens media read through input instead of by path, the decoder keeps the input alive for
+    /// as long as it needs it
+    ErrorCode Setup(std::unique_ptr<MediaInput> input);
+    ErrorCode SetupAudio(u32 start_buffer_ms, u32 max_buffer_ms);
+    static SDL_AudioFormat DecideBestFormat(av::SampleFormat format);
+    static av::SampleFormat DecideBestTarget(av::SampleFormat format);
     void StartRender();
 
-    void AheadOfTimeDecoder();
-    void MarkDecoderCompleted();
+    /// Pipeline stages, each runs on its own thread. The demuxer feeds bounded per stream packet
+    /// queues which the video and audio decoders pull from
+    void DemuxPackets();
+    void DecodeVideo();
+    void DecodeAudio();
+    void MarkDecoderCompleted(u32 serial);
+
+    /// Takes the place of every decoding stage for baked videos, queuing frames and writing audio
+    /// in the order they play
+    void FeedBaked();
 
     void Render();
     void MarkRenderCompleted();
+    bool IsPrebuffered() const;
 
     void SetVolume(float _volume_percentage);
 
     bool WasBadTermination() const;
+    u64 GetPlaybackAllocations() const;
+
+    /// Frames the renderer threw away for being late, frames the decoder never queued as they
+    /// were already late, and frames the codec discarded while catching up
+    u64 GetDroppedFrames() const;
+    u64 GetSkippedFrames() const;
+    u64 GetDiscardedFrames() const;
+
+    /// Picks which quality rungs the decoder may step down to when it can't keep up, takes effect
+    /// on the next decoded frame
+    void SetQualityLadder(u32 allowed_rungs);
+    u32 GetQualityLadder() const;
+    QualityRung GetQualityRung() const;
+
+    /// Thread count and VIDEO_THREAD_* mode the video codec actually accepted when it was opened,
+    /// the mode is 0 if it decodes on a single thread
+    u32 GetVideoThreadCount() const;
+    u32 GetVideoThreadType() const;
+
+    /// Largest working set seen since the context was created, and the most memory the context
+    /// itself had buffered at once
+    std::size_t GetPeakWorkingSet() const;
+    std::size_t GetPeakBufferedBytes() const;
+
+    /// Drift and jitter of the presented frames against the clock so far
+    void GetSyncStats(SyncStats& stats) const;
+
+    /// Frame counts, stage timings, queue depths and buffer usage, see PlaybackStats. Safe to
+    /// call from any thread while playing
+    void GetStats(PlaybackStats& stats) const;
+    bool HasAudio() const;
+
+    /// Jumps to position in seconds without reopening anything. Decoding restarts from the
+    /// closest keyframe before it and playback resumes once enough has been buffered again.
+    /// Returns false if the decoder has stopped for good
+    bool Seek(double position);
+
+    /// Loops back to start once end is reached, both in seconds. An end of 0 loops at the end of
+    /// the video. Takes effect the next time the demuxer gets to the end
+    void SetLoop(bool enabled, double start, double end);
+
+    /// Places frames in the bitmap, see ViewportMode. rect is only used by Custom, which returns
+    /// false if it doesn't fit inside the bitmap. Takes effect on the next presented frame, baked
+    /// videos are already the size of the bitmap and ignore it
+    bool SetViewport(ViewportMode mode, const ViewportRect& rect);
+
+    /// Scaler frames are converted with while the quality ladder isn't forcing fast scaling
+    void SetScaler(ScalerQuality quality);
+
+    /// Where in the video the last presented frame was, in seconds
+    double GetPosition() const;
+    std::size_t GetKeyframeCount() const;
 
 private:
     struct StreamHolder {
@@ -56,51 +219,300 @@ private:
         std::size_t index{};
     };
 
-    struct HistoryContainer {
-        std::vector<u8> data{};
-        av::Timestamp timestamp{};
+    // Video frames are kept in the codecs native format and only converted when presented, the
+    // frame buffers are reference counted and come from the codecs own buffer pool
+    struct VideoHistoryContainer {
+        VideoHistoryContainer() = default;
+        VideoHistoryContainer(const VideoHistoryContainer&) = delete;
+        VideoHistoryContainer& operator=(const VideoHistoryContainer&) = delete;
+        VideoHistoryContainer(VideoHistoryContainer&&) = default;
+        VideoHistoryContainer& operator=(VideoHistoryContainer&&) = default;
+
+        av::VideoFrame frame{};
+        // Baked videos only queue the index of the frame to copy
+        std::size_t baked_frame{};
+        // Position on the playback timeline, which keeps counting up across loops, and how far
+        // that is ahead of the frames position in the video
+        double timestamp{};
+        double offset{};
+        std::size_t bytes{};
+        u32 serial{};
     };
 
-    std::shared_mutex video_history_mutex;
-    std::shared_mutex audio_history_mutex;
+    /// Keeps err unless an earlier error has already been recorded
+    void SetInternalError(const std::error_code& err);
+
+    ErrorCode SetupStreams();
+    ErrorCode SetupBaked(const char* video_path);
+    void SetupBuffering(u32& start_buffer_ms, u32& max_buffer_ms);
+    ErrorCode OpenAudioDevice(int frequency, SDL_AudioFormat format, u8 channels, int frame_size,
+                              u32 start_buffer_ms, u32 max_buffer_ms);
+    void PreallocateBuffers();
+    void ResizePooled(std::vector<u8>& buffer, std::size_t size);
+    bool PresentFrame(const av::VideoFrame& frame, double timestamp);
+    bool PresentBakedFrame(std::size_t frame);
+    void UpdateViewport(const AVFrame& raw, const Blit::Surface& surface);
+    double GetPlaybackPosition() const;
+    bool GetAudioPosition(double& position) const;
+    void UpdateClock();
+    bool WaitForFrame(double timestamp, u32 serial, const Platform::FocusTracker& focus);
+    bool WaitForPrebuffer(u32 serial);
+    void StartClock();
+    bool RenderFrames(u32 serial, const Platform::FocusTracker& focus);
+    void PurgeStaleFrames(u32 serial);
+    void WaitForVideoSpace(VideoHistoryContainer*& container);
+    void WakeRenderer();
+    void RecordPresentation(double timestamp);
+    double GetBufferedVideoSeconds() const;
+    bool IsVideoAboveHighWatermark() const;
+    bool IsAudioAboveHighWatermark(std::size_t incoming) const;
+    void ReleaseFrontFrame();
+    void ApplyMemoryLimit();
+    std::size_t GetBufferedBytes() const;
+    void UpdatePeakBufferedBytes();
+    void SampleWorkingSet();
+    void UpdateFrameDiscarding(double lateness);
+    bool OpenVideoDecoder(int lowres, std::error_code& err);
+
+    /// Reopens the codec with the current share of the scheduler's threads if other videos have
+    /// started or stopped since it was opened. Only called on keyframes
+    bool RebalanceVideoThreads();
+    void LoadContainerIndex();
+    bool TakeSeekRequest(double& position, u32& serial);
+    bool SeekInput(double position);
+    bool StartNextLoop(PlaybackSegment& segment, double stream_end);
+    double GetLoopEnd() const;
+    void FlushAudio(u32 serial);
+    bool WriteAudio(const u8* data, std::size_t size);
+    bool WriteSilence(double seconds);
+    bool DecodeVideoPacket(const av::Packet& pkt);
+    bool DecodeAudioPacket(const av::Packet& pkt);
+    void StopThreads();
+    void DrainVideoDecoder();
+    bool QueueVideoFrame(av::VideoFrame frame, const av::Timestamp& packet_ts);
+    bool QueueBakedFrame(std::size_t frame);
+    void CommitVideoFrame(VideoHistoryContainer* container, double timeline_ts);
+    bool WriteBakedAudio(std::size_t& position, std::size_t end);
+    bool UpdateQuality(double decode_seconds);
+    TraceThread GetFeedThread(TraceThread decoded) const;
+    bool ApplyQualityRung();
 
     std::atomic<bool> kill_threads{false};
     std::atomic<bool> is_decoder_complete{false};
     std::atomic<bool> is_render_complete{false};
     std::atomic<bool> is_bad_terimination{false};
 
-    std::unique_ptr<RPGMaker::Bitmap> bitmap;
+    std::unique_ptr<FrameSink> sink;
     std::size_t frame_width{};
     std::size_t frame_height{};
-    HWND game_window{};
-    HANDLE decoder_thread{};
-    HANDLE render_thread{};
+    Platform::Thread demux_thread{};
+    Platform::Thread video_thread{};
+    Platform::Thread audio_thread{};
+    Platform::Thread render_thread{};
     std::size_t sample_width{0};
+    // Bytes per sample frame across every channel the device plays
+    std::size_t audio_frame_bytes{0};
+
+    // The history holds decoded frames waiting to be shown. How much of it is used is decided by
+    // the buffering watermarks, the capacity is only a hard limit on top of those
+    static constexpr std::size_t FRAME_HISTORY_CAPACITY = 128;
+    SpscRing<VideoHistoryContainer, FRAME_HISTORY_CAPACITY> VIDEO_FRAME_HISTORY;
+
+    // Audio is decoded straight into the PCM ring the device pulls from
+    static constexpr u16 AUDIO_BUFFER_SAMPLES = 1024;
+    static constexpr u16 LOW_LATENCY_AUDIO_BUFFER_SAMPLES = 256;
+
+    // FFmpeg warns about using more than 16 threads, it rarely helps past that anyway
+    static constexpr u32 MAX_AUTO_VIDEO_THREADS = 16;
+
+    // Buffering watermarks in media time and bytes, see DecoderSettings
+    static constexpr u32 DEFAULT_MAX_BUFFER_MILLISECONDS = 2000;
+    static constexpr u32 LOW_LATENCY_MAX_BUFFER_MILLISECONDS = 1000;
+    double start_buffer_seconds{};
+    double max_buffer_seconds{};
+    std::size_t start_buffer_bytes{};
+    std::size_t max_buffer_bytes{};
+    std::size_t audio_start_size{};
+    std::size_t audio_high_watermark{};
 
-    static constexpr std::size_t VIDEO_FRAME_HISTORY_SIZE = 120;
-    static constexpr std::size_t AUDIO_FRAME_HISTORY_SIZE = 120;
-    std::vector<HistoryContainer> VIDEO_FRAME_HISTORY;
-    std::vector<HistoryContainer> AUDIO_FRAME_HISTORY;
+    // Written by the video decoder as frames are queued, the byte count is given back by the
+    // renderer as it releases them
+    double video_frame_duration{1.0 / 30.0};
+    std::atomic<double> first_video_ts{};
+    std::atomic<double> newest_video_ts{};
+    std::atomic<bool> has_queued_video{false};
+    std::atomic<std::size_t> video_history_bytes{0};
 
+    // Only used by the video decoder when compact_frames is set
+    FrameCompactor compactor{};
+
+    // The working set is sampled by the renderer every so often rather than every frame
+    static constexpr double WORKING_SET_SAMPLE_INTERVAL = 0.25;
+    std::atomic<std::size_t> peak_working_set{0};
+    std::atomic<std::size_t> peak_buffered_bytes{0};
+
+    // Declared ahead of the format context so it outlives it
+    std::unique_ptr<MediaInput> media_input{};
     av::FormatContext format_ctx{};
     StreamHolder video_stream{};
     StreamHolder audio_stream{};
 
+    // Set instead of the codecs when playing a baked video
+    std::unique_ptr<BakedVideo> baked{};
+
+    // Only set while tracing, every stage checks it before recording anything
+    std::unique_ptr<TraceRecorder> trace{};
+
     av::VideoDecoderContext vdec{};
     av::AudioDecoderContext adec{};
 
-    std::unique_ptr<av::VideoRescaler> rescaler;
-    std::unique_ptr<av::AudioResampler> resampler;
+    // Packets waiting to be decoded, the demuxer blocks when either is full. Video packets are
+    // much larger so they're limited in bytes as well
+    static constexpr std::size_t MAX_VIDEO_PACKETS = 64;
+    static constexpr std::size_t MAX_VIDEO_PACKET_BYTES = 32 * 1024 * 1024;
+    static constexpr std::size_t MAX_AUDIO_PACKETS = 256;
+    static constexpr std::size_t MAX_AUDIO_PACKET_BYTES = 4 * 1024 * 1024;
+    PacketQueue video_packets{MAX_VIDEO_PACKETS, MAX_VIDEO_PACKET_BYTES};
+    PacketQueue audio_packets{MAX_AUDIO_PACKETS, MAX_AUDIO_PACKET_BYTES};
+
+    // The video and audio decoders each mark themselves as done, the decoder is complete once
+    // neither is running. Guarded by seek_mutex so a seek can't be undone by a late finish
+    u32 running_decoders{0};
+
+    // Seeks are requested by the game and carried out by the demuxer. Each one bumps the serial,
+    // which is how every later stage tells that what it's holding on to is from before the seek
+    std::mutex seek_mutex;
+    std::atomic<u32> seek_serial{0};
+    bool seek_pending{false};
+    double seek_target{};
+    Platform::Event demux_wake{};
+    std::atomic<bool> loop_enabled{false};
+    std::atomic<double> loop_start{};
+    std::atomic<double> loop_end{};
+    // The index has room for every frame of the video, up to a limit, so the demuxer never grows
+    // it while playing. Videos of unknown length get the minimum
+    static constexpr std::size_t MIN_KEYFRAME_CAPACITY = 4096;
+    static constexpr std::size_t MAX_KEYFRAME_CAPACITY = 65536;
+    KeyframeIndex keyframe_index{};
+    // avcpp shifts packet timestamps to start from 0, the containers index and seeking don't
+    double video_start_time{};
+    std::atomic<double> presented_position{};
+
+    // The segment each decoder is working through, only touched by their own thread
+    PlaybackSegment video_segment{};
+    PlaybackSegment audio_segment{};
+    // Serial of what's in the PCM ring, set by the audio decoder once it has flushed for a seek
+    std::atomic<u32> audio_serial{0};
+    // Where the last audio written ends on the playback timeline, so each loop can be lined up
+    // with the end of the previous one
+    double audio_written_end{};
+    bool audio_segment_started{false};
+
+    // Shared with every other context, the frame converter splits each frame into bands on it
+    // and the render thread helps out with its own
+    static constexpr u32 MAX_AUTO_CONVERSION_THREADS = 3;
+    TaskScheduler* scheduler{nullptr};
+
+    std::unique_ptr<FrameConverter> converter;
+    std::atomic<ScalerQuality> scaler_quality{ScalerQuality::Bicubic};
+
+    // Requested by the game and picked up by the renderer before the next frame it presents. The
+    // rest is only touched by the renderer, the border outside the viewport is only cleared when
+    // the rectangle it resolves to changes
+    std::mutex viewport_mutex;
+    ViewportMode viewport_mode{ViewportMode::Stretch};
+    ViewportRect custom_viewport{};
+    std::atomic<u32> viewport_version{0};
+    u32 applied_viewport_version{};
+    double applied_display_aspect{};
+    bool has_viewport{false};
+    ViewportRect viewport{};
+    AudioConverter audio_converter{};
+
+    // Scratch space for converted audio before it's written to the ring, and silence for
+    // filling in gaps between loops
+    std::vector<u8> audio_scratch{};
+    std::vector<u8> audio_silence{};
+    std::size_t audio_buffer_size{};
+
+    // Any buffer growth after Setup counts as an allocation during playback, along with the
+    // scalers, pools and resamplers the converters set up, see GetPlaybackAllocations
+    std::atomic<u64> playback_allocations{0};
 
     std::size_t audio_stream_pos{};
-    double time_shift{};
-    std::atomic<float> volume_percentage{0.1f};
+    // The audio device is the master clock whenever it's playing, the monotonic clock follows it
+    // and takes over for silent videos, while paused and once the audio runs out. The base is
+    // the timestamp of the first samples written to the device
+    bool has_audio{false};
+    MediaClock clock{};
+    std::atomic<double> audio_base_pts{};
+    std::atomic<bool> has_audio_base{false};
+    std::atomic<bool> audio_is_master{false};
 
-    std::chrono::duration<double> real_ts{};
+    // The renderer resyncs to the audio at least this often while waiting on a frame, anything
+    // else it needs to react to wakes it through render_wake
+    static constexpr double MAX_WAIT_SLICE = 0.010;
+    // How often focus is checked while paused if the foreground hook couldn't be installed
+    static constexpr double FOCUS_POLL_INTERVAL = 0.25;
+    Platform::PreciseTimer render_timer{};
 
-    SDL_AudioDeviceID audio_device{};
+    // Auto reset events so a signal sent before the other side starts waiting isn't lost.
+    // render_wake is set for new frames while the renderer could be waiting on them, for audio
+    // while prebuffering, focus changes, completion and shutdown. video_space is set whenever
+    // the renderer releases a frame
+    Platform::Event render_wake{};
+    Platform::Event video_space{};
 
-    std::error_code internal_error{};
+    // Only written by the renderer, read under the lock by ViDecGetSyncStats
+    mutable std::mutex sync_stats_mutex;
+    double drift_total{};
+    double max_drift{};
+    double jitter_squared_total{};
+    u64 presented_frames{};
+    u64 jitter_samples{};
+    bool has_present_reference{false};
+    double last_present_wall{};
+    double last_present_ts{};
+    double last_drift{};
 
-    std::chrono::time_point<std::chrono::steady_clock> start_tps;
+    bool discarding_frames{false};
+    std::atomic<u64> frames_dropped{0};
+    std::atomic<u64> frames_skipped{0};
+    std::atomic<u64> frames_discarded{0};
+    std::atomic<u64> video_decode_errors{0};
+    std::atomic<u64> frames_decoded{0};
+
+    // Each histogram is only recorded into by the thread running that stage, the demuxer, the
+    // video decoder and the renderer
+    LatencyHistogram demux_times{};
+    LatencyHistogram decode_times{};
+    LatencyHistogram rescale_times{};
+    LatencyHistogram blit_times{};
+
+    // The ladder itself is only touched by the decoder thread, the allowed rungs come from the
+    // game and the conversion time from the renderer
+    QualityLadder quality_ladder{};
+    std::atomic<u32> quality_rungs_allowed{ALL_QUALITY_RUNGS};
+    std::atomic<QualityRung> quality_rung{QualityRung::Full};
+    std::atomic<double> last_convert_seconds{};
+    double pending_decode_seconds{};
+    int max_lowres{};
+    int video_lowres{};
+    bool awaiting_keyframe{false};
+
+    std::atomic<u32> video_thread_count{0};
+    std::atomic<u32> video_thread_type{0};
+    // What the codec was last opened asking for, and the threads it holds out of the scheduler's
+    // budget on top of the video thread itself
+    u32 requested_video_threads{};
+    std::size_t claimed_video_threads{};
+    u32 video_thread_generation{};
+
+    DecoderSettings settings{};
+    AudioOutput audio_output{};
+
+    // Set from the setup, demux and video threads and read from the game's, the first error wins
+    mutable std::mutex internal_error_mutex;
+    std::error_code internal_error{};
+    std::string internal_error_message{};
 };
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstring>
+
+#include "common_types.h"
+
+/// Optional settings a context can be created with through ViDecCreateContextEx. The struct is
+/// shared with callers across the DLL boundary, so fields are only ever appended and are all 32
+/// bits wide. Callers set struct_size to the size of the struct they know about and any field past
+/// it keeps its default value.
+struct DecoderSettings {
+    u32 struct_size{sizeof(DecoderSettings)};
+
+    // Audio device buffer size in sample frames, 0 picks a default based on the latency mode
+    u32 audio_buffer_samples{0};
+    // Non zero trades some robustness against stalls for a smaller device buffer and PCM ring
+    u32 low_latency_audio{0};
+
+    // Once decoded video falls this far behind the presentation clock the codec is told to stop
+    // decoding non-reference frames until it catches back up
+    u32 late_discard_margin_ms{200};
+
+    // Threads the video codec decodes with, 0 uses one per logical core and 1 disables threading
+    u32 video_thread_count{0};
+    // VIDEO_THREAD_FRAME and/or VIDEO_THREAD_SLICE, 0 lets the codec use whichever it supports
+    u32 video_thread_type{0};
+
+    // Bands each frame is split into on the shared task scheduler, the render thread converts one
+    // of them itself. 0 picks a small number based on the core count and 1 converts on the render
+    // thread alone
+    u32 conversion_threads{0};
+
+    // Low watermark, playback starts once this much video and audio is buffered. 0 starts as soon
+    // as there's a frame to show and a device buffer worth of audio. If start_buffer_bytes is set,
+    // that much decoded video is also enough to start
+    u32 start_buffer_ms{0};
+    u32 start_buffer_bytes{0};
+
+    // High watermark, the decoders stop once this much is buffered ahead of playback. 0 picks 2
+    // seconds, or 1 second for low latency audio. max_buffer_bytes caps the decoded video held in
+    // memory
+    u32 max_buffer_ms{0};
+    u32 max_buffer_bytes{64 * 1024 * 1024};
+
+    // Non zero repacks decoded frames which are bigger than 8-bit YUV 4:2:0, such as 4:4:4 or RGB,
+    // into 4:2:0 before they're queued
+    u32 compact_frames{0};
+    // Hard cap on the memory the context buffers with, covering queued packets, decoded frames and
+    // the audio ring. 0 leaves it to the watermarks alone
+    u32 memory_limit_bytes{0};
+};
+
+/// Threading modes for DecoderSettings::video_thread_type, these match FFmpegs FF_THREAD_* flags
+constexpr u32 VIDEO_THREAD_FRAME = 1;
+constexpr u32 VIDEO_THREAD_SLICE = 2;
+
+/// Copies the fields the caller knows about over the defaults, a null pointer keeps every default
+inline DecoderSettings LoadDecoderSettings(const DecoderSettings* user_settings) {
+    DecoderSettings settings{};
+    if (user_settings == nullptr || user_settings->struct_size < sizeof(u32)) {
+        return settings;
+    }
+
+    const auto copy_size = user_settings->struct_size < sizeof(DecoderSettings)
+                               ? user_settings->struct_size
+                               : sizeof(DecoderSettings);
+    std::memcpy(&settings, user_settings, copy_size);
+    settings.struct_size = sizeof(DecoderSettings);
+    return settings;
+}
@@ -0,0 +1,132 @@
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+#include "frame_compactor.h"
+
+namespace {
+
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+using PoolBufferSize = std::size_t;
+#else
+using PoolBufferSize = int;
+#endif
+
+AVBufferRef* AllocatePoolBuffer(void* opaque, PoolBufferSize size) {
+    // Only called when the pool has nothing to recycle
+    static_cast<std::atomic<u64>*>(opaque)->fetch_add(1);
+    return av_buffer_alloc(size);
+}
+
+} // Anonymous namespace
+
+FrameCompactor::~FrameCompactor() {
+    if (context != nullptr) {
+        sws_freeContext(context);
+        context = nullptr;
+    }
+    if (pool != nullptr) {
+        av_buffer_pool_uninit(&pool);
+    }
+}
+
+bool FrameCompactor::CanCompact(const AVFrame& raw) {
+    const auto format = static_cast<AVPixelFormat>(raw.format);
+    const auto* desc = av_pix_fmt_desc_get(format);
+    if (desc == nullptr || (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL)) != 0) {
+        return false;
+    }
+
+    // Anything at or below 12 bits per pixel, such as 4:2:0 in its various layouts, stays as is
+    const int current = av_image_get_buffer_size(format, raw.width, raw.height, 1);
+    const int compacted = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, raw.width, raw.height, 1);
+    return current > 0 && compacted > 0 && compacted < current;
+}
+
+av::VideoFrame FrameCompactor::Compact(av::VideoFrame frame) {
+    const auto* src = frame.raw();
+    if (src == nullptr || !CanCompact(*src)) {
+        return frame;
+    }
+
+    // Full range and RGB sources keep their full range through the J format
+    const auto* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(src->format));
+    const bool full_range =
+        src->color_range == AVCOL_RANGE_JPEG || (desc->flags & AV_PIX_FMT_FLAG_RGB) != 0;
+    const auto format = full_range ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_YUV420P;
+    if (!EnsurePool(src->width, src->height, format)) {
+        return frame;
+    }
+
+    // A different context back means the old one didn't fit the frame and was rebuilt
+    auto* cached = sws_getCachedContext(context, src->width, src->height,
+                                        static_cast<AVPixelFormat>(src->format), src->width,
+                                        src->height, format, SWS_BICUBIC, nullptr, nullptr,
+                                        nullptr);
+    if (cached != context) {
+        allocations++;
+    }
+    context = cached;
+    if (context == nullptr) {
+        return frame;
+    }
+
+    AVFrame* dst = av_frame_alloc();
+    if (dst == nullptr) {
+        return frame;
+    }
+    dst->buf[0] = av_buffer_pool_get(pool);
+    if (dst->buf[0] == nullptr) {
+        av_frame_free(&dst);
+        return frame;
+    }
+    av_frame_copy_props(dst, src);
+    dst->format = format;
+    dst->width = src->width;
+    dst->height = src->height;
+    av_image_fill_arrays(dst->data, dst->linesize, dst->buf[0]->data, format, dst->width,
+                         dst->height, PLANE_ALIGNMENT);
+    if ((desc->flags & AV_PIX_FMT_FLAG_RGB) != 0) {
+        // swscale converts RGB with the BT.601 matrix
+        dst->colorspace = AVCOL_SPC_BT470BG;
+    }
+
+    sws_scale(context, src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+
+    // The new frame takes its own reference to the pooled buffer, the timebase lives outside of
+    // the AVFrame so it has to be carried over by hand
+    av::VideoFrame compacted{dst};
+    av_frame_free(&dst);
+    compacted.setTimeBase(frame.timeBase());
+    compacted.setStreamIndex(frame.streamIndex());
+    return compacted;
+}
+
+u64 FrameCompactor::GetAllocations() const {
+    return allocations.load();
+}
+
+bool FrameCompactor::EnsurePool(int width, int height, AVPixelFormat format) {
+    if (pool != nullptr && width == pool_width && height == pool_height &&
+        format == pool_format) {
+        return true;
+    }
+
+    // Frames still holding buffers from the old pool keep it alive until they're released
+    if (pool != nullptr) {
+        av_buffer_pool_uninit(&pool);
+    }
+
+    const int size = av_image_get_buffer_size(format, width, height, PLANE_ALIGNMENT);
+    if (size <= 0) {
+        return false;
+    }
+    pool = av_buffer_pool_init2(size, &allocations, AllocatePoolBuffer, nullptr);
+    pool_width = width;
+    pool_height = height;
+    pool_format = format;
+    return pool != nullptr;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <atomic>
+
+#include <frame.h>
+
+#include "common_types.h"
+
+struct AVBufferPool;
+struct SwsContext;
+
+/// Repacks decoded frames into 8-bit planar YUV 4:2:0 at their native resolution so queued frames
+/// take as little memory as possible. Frames which are already that small are passed through
+/// untouched, the repacked ones come from a buffer pool so steady playback doesn't allocate
+/// pixel buffers.
+class FrameCompactor {
+public:
+    FrameCompactor() = default;
+    ~FrameCompactor();
+
+    FrameCompactor(const FrameCompactor&) = delete;
+    FrameCompactor& operator=(const FrameCompactor&) = delete;
+
+    /// Whether frames in this format would get smaller by compacting them
+    static bool CanCompact(const AVFrame& raw);
+
+    /// Returns the compacted frame, or the original frame if it can't be made any smaller or the
+    /// conversion failed
+    av::VideoFrame Compact(av::VideoFrame frame);
+
+    /// Pooled buffers and scalers made so far, the pool stops allocating once enough frames are
+    /// in flight to recycle them. Safe to call from any thread
+    u64 GetAllocations() const;
+
+private:
+    bool EnsurePool(int width, int height, AVPixelFormat format);
+
+    SwsContext* context{nullptr};
+    AVBufferPool* pool{nullptr};
+    int pool_width{};
+    int pool_height{};
+    AVPixelFormat pool_format{AV_PIX_FMT_NONE};
+    std::atomic<u64> allocations{0};
+
+    // Planes are aligned for the SIMD paths in swscale
+    static constexpr int PLANE_ALIGNMENT = 32;
+};
@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <numeric>
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+#include "frame_converter.h"
+#include "task_scheduler.h"
+#include "yuv_kernels.h"
+
+namespace {
+
+/// Describes raw for the built-in kernels, false for formats they can't read
+bool GetYuvImage(const AVFrame& raw, Yuv::Image& image) {
+    switch (static_cast<AVPixelFormat>(raw.format)) {
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_YUVJ420P:
+        image.layout = Yuv::Layout::I420;
+        break;
+    case AV_PIX_FMT_NV12:
+        image.layout = Yuv::Layout::NV12;
+        break;
+    default:
+        return false;
+    }
+    for (std::size_t plane = 0; plane < 3; plane++) {
+        image.planes[plane] = raw.data[plane];
+        image.pitches[plane] = raw.linesize[plane];
+    }
+    image.width = static_cast<std::size_t>(raw.width);
+    image.height = static_cast<std::size_t>(raw.height);
+    return true;
+}
+
+Yuv::Coefficients GetYuvCoefficients(const AVFrame& raw) {
+    // Untagged video is BT.601, the same as swscale assumes
+    const auto matrix =
+        raw.colorspace == AVCOL_SPC_BT709 ? Yuv::Matrix::BT709 : Yuv::Matrix::BT601;
+    const bool full_range =
+        raw.format == AV_PIX_FMT_YUVJ420P || raw.color_range == AVCOL_RANGE_JPEG;
+    return Yuv::MakeCoefficients(matrix, full_range ? Yuv::Range::Full : Yuv::Range::Limited);
+}
+
+} // Anonymous namespace
+
+FrameConverter::FrameConverter(std::size_t dst_width, std::size_t dst_height,
+                               TaskScheduler* scheduler, std::size_t max_bands)
+    : dst_width(dst_width), dst_height(dst_height), scheduler(scheduler) {
+    band_contexts.resize(scheduler != nullptr ? std::max<std::size_t>(max_bands, 1) : 1, nullptr);
+    ResizeScratch();
+}
+
+FrameConverter::~FrameConverter() {
+    for (auto& context : band_contexts) {
+        if (context != nullptr) {
+            sws_freeContext(context);
+            context = nullptr;
+        }
+    }
+}
+
+bool FrameConverter::Convert(const av::VideoFrame& frame, u8* dst, std::ptrdiff_t dst_stride,
+                             double deadline) {
+    const auto* raw = frame.raw();
+    if (raw == nullptr || dst == nullptr) {
+        return false;
+    }
+
+    // Frames the built-in kernels can handle never need swscale's generic paths
+    Yuv::Image image{};
+    if (GetYuvImage(*raw, image) && Yuv::CanConvert(image, dst_width, dst_height)) {
+        return ConvertYuv(*raw, image, dst, dst_stride, deadline);
+    }
+
+    const auto quality = fast_scaling.load() ? ScalerQuality::FastBilinear : scaler.load();
+    int flags = SWS_BICUBIC;
+    if (quality == ScalerQuality::FastBilinear) {
+        flags = SWS_FAST_BILINEAR;
+    } else if (quality == ScalerQuality::Bilinear) {
+        flags = SWS_BILINEAR;
+    }
+    BandSteps steps{};
+    auto band_count = GetBandCount(*raw);
+    if (band_count > 1 && GetBandSteps(*raw, steps) &&
+        (steps.margin + 1) * steps.dst_rows <= MAX_MARGIN_ROWS) {
+        band_count = std::min<std::size_t>(band_count, steps.count);
+    } else {
+        band_count = 1;
+    }
+    if (band_count <= 1) {
+        // Scaling the whole frame with one context is what every banded conversion has to match
+        return Scale(band_contexts[0], *raw, 0, static_cast<std::size_t>(raw->height),
+                     dst_height, dst, dst_stride, flags);
+    }
+
+    std::atomic<bool> succeeded{true};
+    scheduler->Run(band_count, deadline, [&](std::size_t band) {
+        if (!ConvertBand(*raw, steps, band, band_count, dst, dst_stride, flags)) {
+            succeeded.store(false);
+        }
+    });
+    return succeeded.load();
+}
+
+void FrameConverter::SetOutputSize(std::size_t width, std::size_t height) {
+    // The cached scalers notice the new size on their next frame
+    dst_width = width;
+    dst_height = height;
+    const auto capacity = band_scratch.capacity();
+    ResizeScratch();
+    if (band_scratch.capacity() != capacity) {
+        allocations++;
+    }
+}
+
+void FrameConverter::ResizeScratch() {
+    if (band_contexts.size() <= 1) {
+        return;
+    }
+    // Outputs are never larger than the bitmap the converter is made for, so the scratch keeps
+    // the capacity it was created with and resizing never allocates again
+    const auto rows = dst_height + 2 * MAX_MARGIN_ROWS * band_contexts.size();
+    band_scratch.resize(rows * dst_width * 4);
+}
+
+void FrameConverter::SetScaler(ScalerQuality quality) {
+    scaler.store(quality);
+}
+
+ScalerQuality FrameConverter::GetScaler() const {
+    return scaler.load();
+}
+
+void FrameConverter::SetFastScaling(bool enabled) {
+    fast_scaling.store(enabled);
+}
+
+bool FrameConverter::IsFastScaling() const {
+    return fast_scaling.load();
+}
+
+u64 FrameConverter::GetAllocations() const {
+    return allocations.load();
+}
+
+std::size_t FrameConverter::GetBandCount(const AVFrame& raw) const {
+    if (band_contexts.size() <= 1) {
+        return 1;
+    }
+
+    // Palettes and hardware surfaces can't be split by offsetting the plane pointers
+    const auto* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(raw.format));
+    if (desc == nullptr || (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL)) != 0) {
+        return 1;
+    }
+
+    const auto rows = std::min<std::size_t>(dst_height, static_cast<std::size_t>(raw.height));
+    return std::max<std::size_t>(1, std::min<std::size_t>(band_contexts.size(),
+                                                          rows / MIN_BAND_ROWS));
+}
+
+bool FrameConverter::ConvertYuv(const AVFrame& raw, const Yuv::Image& image, u8* dst,
+                                std::ptrdiff_t dst_stride, double deadline) {
+    const Blit::Surface surface{dst, dst_stride, dst_width, dst_height};
+    const auto coefficients = GetYuvCoefficients(raw);
+    const auto band_count = GetBandCount(raw);
+    if (band_count <= 1) {
+        return Yuv::ConvertRows(surface, image, coefficients, 0, dst_height);
+    }
+
+    // Rows only ever read their own source lines, so bands need no alignment
+    std::atomic<bool> succeeded{true};
+    scheduler->Run(band_count, deadline, [&](std::size_t band) {
+        if (!Yuv::ConvertRows(surface, image, coefficients, dst_height * band / band_count,
+                              dst_height * (band + 1) / band_count)) {
+            succeeded.store(false);
+        }
+    });
+    return succeeded.load();
+}
+
+bool FrameConverter::GetBandSteps(const AVFrame& raw, BandSteps& steps) const {
+    const auto* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(raw.format));
+    const int chroma_shift = desc != nullptr ? desc->log2_chroma_h : 0;
+    const std::size_t src_align = std::size_t{1} << chroma_shift;
+    const auto src_height = static_cast<std::size_t>(raw.height);
+    if (src_height == 0 || dst_height == 0 || src_height % src_align != 0) {
+        return false;
+    }
+
+    // swscale steps through the source in 16.16 fixed point. When the chroma step, and so the
+    // luma one, is exact a band starting on a step boundary samples the same positions as a
+    // scaler covering the whole frame. Otherwise the rounding error would shift every band a
+    // little differently
+    if (((src_height >> chroma_shift) << 16) % dst_height != 0) {
+        return false;
+    }
+
+    // Smallest whole number of source and destination rows that line up, made a multiple of the
+    // chroma subsampling so bands also start on a chroma row
+    const auto divisor = std::gcd(src_height, dst_height);
+    const auto src_ratio = src_height / divisor;
+    const auto dst_ratio = dst_height / divisor;
+    const auto multiple = src_align / std::gcd(src_ratio, src_align);
+    steps.src_rows = src_ratio * multiple;
+    steps.dst_rows = dst_ratio * multiple;
+    steps.count = dst_height / steps.dst_rows;
+
+    // The widest filter reaches about two taps per destination row either side, doubled for
+    // subsampled chroma. A few rows more than that keeps every band well clear of the clamping
+    const auto reach = 4 * ((src_height + dst_height - 1) / dst_height) + 4;
+    steps.margin = (reach + steps.src_rows - 1) / steps.src_rows;
+    return steps.count > 0;
+}
+
+bool FrameConverter::ConvertBand(const AVFrame& raw, const BandSteps& steps, std::size_t band,
+                                 std::size_t band_count, u8* dst, std::ptrdiff_t dst_stride,
+                                 int flags) {
+    // Split the steps evenly, the last band also takes the partial step at the bottom
+    const bool last = band + 1 == band_count;
+    const auto first_step = steps.count * band / band_count;
+    const auto end_step = steps.count * (band + 1) / band_count;
+    const auto dst_start = first_step * steps.dst_rows;
+    const auto dst_end = last ? dst_height : end_step * steps.dst_rows;
+
+    // Scale the band along with its margins. Any run of whole steps, or whole steps up to the
+    // bottom of the frame, has the same ratio as the frame itself
+    const auto scaled_step = first_step - std::min<std::size_t>(first_step, steps.margin);
+    const bool to_bottom = last || end_step + steps.margin >= steps.count;
+    const auto scaled_src_start = scaled_step * steps.src_rows;
+    const auto scaled_src_end = to_bottom ? static_cast<std::size_t>(raw.height)
+                                          : (end_step + steps.margin) * steps.src_rows;
+    const auto scaled_dst_start = scaled_step * steps.dst_rows;
+    const auto scaled_dst_end =
+        to_bottom ? dst_height : (end_step + steps.margin) * steps.dst_rows;
+
+    // Each band sits 2 * MAX_MARGIN_ROWS further down the scratch than the one above it, which
+    // is enough for neither margin to reach into the next band's rows
+    const auto row_bytes = dst_width * 4;
+    u8* scratch = band_scratch.data() + (scaled_dst_start + 2 * MAX_MARGIN_ROWS * band) * row_bytes;
+    if (!Scale(band_contexts[band], raw, scaled_src_start, scaled_src_end,
+               scaled_dst_end - scaled_dst_start, scratch, static_cast<std::ptrdiff_t>(row_bytes),
+               flags)) {
+        return false;
+    }
+
+    // Only the band's own rows are copied out, its margins belong to the neighbouring bands
+    const u8* src_row = scratch + (dst_start - scaled_dst_start) * row_bytes;
+    for (auto row = dst_start; row < dst_end; row++, src_row += row_bytes) {
+        std::memcpy(dst + static_cast<std::ptrdiff_t>(row) * dst_stride, src_row, row_bytes);
+    }
+    return true;
+}
+
+bool FrameConverter::Scale(SwsContext*& context, const AVFrame& raw, std::size_t src_start,
+                           std::size_t src_end, std::size_t dst_rows, u8* dst,
+                           std::ptrdiff_t dst_stride, int flags) {
+    const auto format = static_cast<AVPixelFormat>(raw.format);
+    const auto* desc = av_pix_fmt_desc_get(format);
+    const int chroma_shift = desc != nullptr ? desc->log2_chroma_h : 0;
+    if (dst_rows == 0 || src_end <= src_start) {
+        return true;
+    }
+
+    // The cached context is only rebuilt if the source format, resolution or scaler changes mid
+    // stream
+    const auto src_rows = static_cast<int>(src_end - src_start);
+    auto* cached = sws_getCachedContext(context, raw.width, src_rows, format,
+                                        static_cast<int>(dst_width), static_cast<int>(dst_rows),
+                                        AV_PIX_FMT_BGRA, flags, nullptr, nullptr, nullptr);
+    if (cached != context) {
+        allocations++;
+    }
+    context = cached;
+    if (context == nullptr) {
+        return false;
+    }
+
+    // Offset every plane to the first source row, chroma planes are subsampled vertically
+    const u8* src_planes[4]{};
+    for (std::size_t plane = 0; plane < 4; plane++) {
+        if (raw.data[plane] == nullptr) {
+            continue;
+        }
+        const bool is_chroma = plane == 1 || plane == 2;
+        const auto row = is_chroma ? src_start >> chroma_shift : src_start;
+        src_planes[plane] = raw.data[plane] + static_cast<std::ptrdiff_t>(row) * raw.linesize[plane];
+    }
+
+    // swscale walks the destination with the stride we give it, so a negative stride starting at
+    // the top line writes a bottom-up image directly
+    u8* const dst_planes[4] = {dst, nullptr, nullptr, nullptr};
+    const int dst_strides[4] = {static_cast<int>(dst_stride), 0, 0, 0};
+    sws_scale(context, src_planes, raw.linesize, 0, static_cast<int>(src_end - src_start),
+              dst_planes, dst_strides);
+    return true;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include <frame.h>
+
+#include "common_types.h"
+
+struct SwsContext;
+class TaskScheduler;
+
+namespace Yuv {
+struct Image;
+}
+
+/// How a frame is split into bands for swscale, see FrameConverter::GetBandSteps
+struct BandSteps {
+    std::size_t src_rows{};
+    std::size_t dst_rows{};
+    std::size_t count{};
+    std::size_t margin{};
+};
+
+/// Filter used to scale frames to the destination size, from cheapest to sharpest
+enum class ScalerQuality : u32 {
+    FastBilinear = 0,
+    Bilinear = 1,
+    Bicubic = 2,
+};
+
+constexpr u32 SCALER_QUALITY_COUNT = 3;
+
+/// Converts decoded frames in their native pixel format straight into a BGRA destination. The
+/// destination stride may be negative so bottom-up images such as the RGSS bitmap can be written
+/// without an extra flip pass. With a task scheduler the frame is split into up to max_bands
+/// horizontal bands which are scaled in parallel, each band with its own scaler. Bands overlap
+/// their neighbours by a few rows and keep the frame's exact scale ratio, so the output matches
+/// scaling the whole frame at once bit for bit. Ratios swscale can't represent exactly are
+/// scaled as a single band. 4:2:0 frames at the destination size or exactly twice it skip
+/// swscale and go through the built-in YUV kernels, which ignore the scaler setting.
+class FrameConverter {
+public:
+    FrameConverter(std::size_t dst_width, std::size_t dst_height,
+                   TaskScheduler* scheduler = nullptr, std::size_t max_bands = 1);
+    ~FrameConverter();
+
+    FrameConverter(const FrameConverter&) = delete;
+    FrameConverter& operator=(const FrameConverter&) = delete;
+
+    /// deadline is when the frame has to be done by on the GetMonotonicSeconds clock, it decides
+    /// which conversions the scheduler helps first when several videos are playing
+    bool Convert(const av::VideoFrame& frame, u8* dst, std::ptrdiff_t dst_stride,
+                 double deadline = 0.0);
+
+    /// Changes the size frames are scaled to, only safe to call from the thread converting
+    void SetOutputSize(std::size_t width, std::size_t height);
+
+    /// Scaler used unless fast scaling is forced, bicubic by default. Safe to call from any thread
+    void SetScaler(ScalerQuality quality);
+    ScalerQuality GetScaler() const;
+
+    /// Overrides the scaler with the much cheaper fast bilinear path, safe to call from any thread
+    void SetFastScaling(bool enabled);
+    bool IsFastScaling() const;
+
+    /// Scalers and scratch space set up since the converter was made, they're only rebuilt when
+    /// the frame format or output size changes. Safe to call from any thread
+    u64 GetAllocations() const;
+
+private:
+    std::size_t GetBandCount(const AVFrame& raw) const;
+
+    /// Bands can only start on a row where the source and destination line up exactly, every
+    /// step of src_rows source rows becomes dst_rows destination rows. Each band is scaled with
+    /// margin extra steps on either side so the filter never has to clamp inside the frame.
+    /// False if the scale ratio isn't exact in swscale's fixed point and has to be done in one go
+    bool GetBandSteps(const AVFrame& raw, BandSteps& steps) const;
+
+    bool ConvertYuv(const AVFrame& raw, const Yuv::Image& image, u8* dst,
+                    std::ptrdiff_t dst_stride, double deadline);
+    bool ConvertBand(const AVFrame& raw, const BandSteps& steps, std::size_t band,
+                     std::size_t band_count, u8* dst, std::ptrdiff_t dst_stride, int flags);
+    bool Scale(SwsContext*& context, const AVFrame& raw, std::size_t src_start,
+               std::size_t src_end, std::size_t dst_rows, u8* dst, std::ptrdiff_t dst_stride,
+               int flags);
+
+    /// Makes room for every band and its margins, see ConvertBand
+    void ResizeScratch();
+
+    // Bands shorter than this aren't worth handing to another thread
+    static constexpr std::size_t MIN_BAND_ROWS = 64;
+    // Margins, including the partial step at the bottom, can't be wider than this. Ratios that
+    // need more are scaled as a single band
+    static constexpr std::size_t MAX_MARGIN_ROWS = 48;
+
+    std::size_t dst_width{};
+    std::size_t dst_height{};
+    TaskScheduler* scheduler{nullptr};
+    std::vector<SwsContext*> band_contexts{};
+    // Bands are scaled in here along with their margins, each band a fixed distance further down
+    // than the one before so they never overlap, then the band itself is copied out. It's only
+    // resized along with the output, never while playing
+    std::vector<u8> band_scratch{};
+    std::atomic<ScalerQuality> scaler{ScalerQuality::Bicubic};
+    std::atomic<bool> fast_scaling{false};
+    std::atomic<u64> allocations{0};
+};
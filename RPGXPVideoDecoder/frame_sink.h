@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+
+#include "blit_kernels.h"
+
+/// Wherever presented frames are drawn to, normally the games bitmap. Frames are written straight
+/// into the surface, which is bottom-up like every RGSS bitmap unless its pitch says otherwise.
+class FrameSink {
+public:
+    virtual ~FrameSink() = default;
+
+    virtual std::size_t GetWidth() const = 0;
+    virtual std::size_t GetHeight() const = 0;
+
+    /// The surface has a null top line once the sink can't be drawn to any more
+    virtual Blit::Surface GetSurface() const = 0;
+};
@@ -0,0 +1,39 @@
+#include <algorithm>
+
+#include "keyframe_index.h"
+
+void KeyframeIndex::Reserve(std::size_t count) {
+    std::scoped_lock lock{mutex};
+    keyframes.reserve(count);
+}
+
+bool KeyframeIndex::Add(double timestamp) {
+    std::scoped_lock lock{mutex};
+    const auto capacity = keyframes.capacity();
+
+    // The demuxer reads forwards, so this is almost always an append or a keyframe we've seen
+    if (keyframes.empty() || keyframes.back() < timestamp) {
+        keyframes.push_back(timestamp);
+        return keyframes.capacity() != capacity;
+    }
+    const auto it = std::lower_bound(keyframes.begin(), keyframes.end(), timestamp);
+    if (it == keyframes.end() || *it != timestamp) {
+        keyframes.insert(it, timestamp);
+    }
+    return keyframes.capacity() != capacity;
+}
+
+bool KeyframeIndex::FindAtOrBefore(double timestamp, double& keyframe) const {
+    std::scoped_lock lock{mutex};
+    const auto it = std::upper_bound(keyframes.begin(), keyframes.end(), timestamp);
+    if (it == keyframes.begin()) {
+        return false;
+    }
+    keyframe = *(it - 1);
+    return true;
+}
+
+std::size_t KeyframeIndex::GetCount() const {
+    std::scoped_lock lock{mutex};
+    return keyframes.size();
+}
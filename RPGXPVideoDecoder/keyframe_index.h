@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "common_types.h"
+
+/// Sorted timestamps, in seconds, of the video keyframes we know about. Seeded from the
+/// containers own index where it has one and filled in by the demuxer as it reads, so seeks can
+/// land right on the keyframe closest to the target. Safe to use from any thread.
+class KeyframeIndex {
+public:
+    /// Makes room for count keyframes up front so adding them later doesn't allocate
+    void Reserve(std::size_t count);
+
+    /// Returns true if the index had to grow its storage to fit the keyframe
+    bool Add(double timestamp);
+
+    /// Latest known keyframe at or before timestamp, returns false if there's none
+    bool FindAtOrBefore(double timestamp, double& keyframe) const;
+
+    std::size_t GetCount() const;
+
+private:
+    mutable std::mutex mutex;
+    std::vector<double> keyframes;
+};
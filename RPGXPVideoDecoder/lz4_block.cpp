@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "lz4_block.h"
+
+namespace Lz4 {
+
+namespace {
+
+// Limits from the block format, matches are at least 4 bytes, reach back at most 64KiB, the last
+// 5 bytes are always literals and the last match has to start 12 bytes before the end
+constexpr std::size_t MIN_MATCH = 4;
+constexpr std::size_t MAX_OFFSET = 0xffff;
+constexpr std::size_t LAST_LITERALS = 5;
+constexpr std::size_t MATCH_FIND_LIMIT = 12;
+
+constexpr u32 HASH_BITS = 14;
+constexpr u32 NO_POSITION = 0xffffffff;
+
+u32 Read32(const u8* data) {
+    u32 value{};
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+u32 Hash(u32 sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Lengths that don't fit in their 4 bits of the token carry on in bytes of 255
+bool WriteLength(std::size_t length, u8*& op, const u8* end) {
+    for (; length >= 255; length -= 255) {
+        if (op >= end) {
+            return false;
+        }
+        *op++ = 255;
+    }
+    if (op >= end) {
+        return false;
+    }
+    *op++ = static_cast<u8>(length);
+    return true;
+}
+
+bool ReadLength(std::size_t& length, const u8*& ip, const u8* end) {
+    u8 byte{};
+    do {
+        if (ip >= end) {
+            return false;
+        }
+        byte = *ip++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool WriteSequence(const u8* literals, std::size_t literal_length, std::size_t offset,
+                   std::size_t match_length, u8*& op, const u8* end) {
+    if (op >= end) {
+        return false;
+    }
+    u8* token = op++;
+    *token = static_cast<u8>(std::min<std::size_t>(literal_length, 15) << 4);
+    if (literal_length >= 15 && !WriteLength(literal_length - 15, op, end)) {
+        return false;
+    }
+    if (static_cast<std::size_t>(end - op) < literal_length) {
+        return false;
+    }
+    if (literal_length != 0) {
+        std::memcpy(op, literals, literal_length);
+    }
+    op += literal_length;
+
+    // The final sequence is literals alone
+    if (match_length == 0) {
+        return true;
+    }
+
+    if (end - op < 2) {
+        return false;
+    }
+    *op++ = static_cast<u8>(offset & 0xff);
+    *op++ = static_cast<u8>(offset >> 8);
+    const auto extra = match_length - MIN_MATCH;
+    *token |= static_cast<u8>(std::min<std::size_t>(extra, 15));
+    return extra < 15 || WriteLength(extra - 15, op, end);
+}
+
+} // Anonymous namespace
+
+std::size_t CompressBound(std::size_t size) {
+    return size + size / 255 + 16;
+}
+
+std::size_t Compress(const u8* src, std::size_t size, u8* dst, std::size_t capacity) {
+    u8* op = dst;
+    const u8* const op_end = dst + capacity;
+    std::size_t anchor = 0;
+
+    if (size > MATCH_FIND_LIMIT) {
+        std::vector<u32> table(std::size_t{1} << HASH_BITS, NO_POSITION);
+        const std::size_t match_limit = size - MATCH_FIND_LIMIT;
+        const std::size_t extend_limit = size - LAST_LITERALS;
+
+        std::size_t ip = 0;
+        while (ip < match_limit) {
+            const u32 sequence = Read32(src + ip);
+            const u32 hash = Hash(sequence);
+            const u32 candidate = table[hash];
+            table[hash] = static_cast<u32>(ip);
+
+            if (candidate == NO_POSITION || ip - candidate > MAX_OFFSET ||
+                Read32(src + candidate) != sequence) {
+                // Step faster through data that isn't compressing
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            std::size_t match = candidate;
+            std::size_t length = MIN_MATCH;
+            while (ip + length < extend_limit && src[match + length] == src[ip + length]) {
+                length++;
+            }
+            while (ip > anchor && match > 0 && src[ip - 1] == src[match - 1]) {
+                ip--;
+                match--;
+                length++;
+            }
+
+            if (!WriteSequence(src + anchor, ip - anchor, ip - match, length, op, op_end)) {
+                return 0;
+            }
+            ip += length;
+            anchor = ip;
+        }
+    }
+
+    if (!WriteSequence(src + anchor, size - anchor, 0, 0, op, op_end)) {
+        return 0;
+    }
+    return static_cast<std::size_t>(op - dst);
+}
+
+bool Decompress(const u8* src, std::size_t size, u8* dst, std::size_t dst_size) {
+    const u8* ip = src;
+    const u8* const ip_end = src + size;
+    u8* op = dst;
+    u8* const op_end = dst + dst_size;
+
+    while (ip < ip_end) {
+        const u8 token = *ip++;
+
+        std::size_t literal_length = token >> 4;
+        if (literal_length == 15 && !ReadLength(literal_length, ip, ip_end)) {
+            return false;
+        }
+        if (static_cast<std::size_t>(ip_end - ip) < literal_length ||
+            static_cast<std::size_t>(op_end - op) < literal_length) {
+            return false;
+        }
+        std::memcpy(op, ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        // The last sequence ends after its literals
+        if (ip == ip_end) {
+            break;
+        }
+
+        if (ip_end - ip < 2) {
+            return false;
+        }
+        const std::size_t offset =
+            static_cast<std::size_t>(ip[0]) | (static_cast<std::size_t>(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<std::size_t>(op - dst)) {
+            return false;
+        }
+
+        std::size_t match_length = token & 15;
+        if (match_length == 15 && !ReadLength(match_length, ip, ip_end)) {
+            return false;
+        }
+        match_length += MIN_MATCH;
+        if (static_cast<std::size_t>(op_end - op) < match_length) {
+            return false;
+        }
+
+        // Overlapping matches repeat the last offset bytes, which flat areas of a frame are full
+        // of. Copying from the start of the match keeps every copy clear of its own output while
+        // the repeated run doubles in length each time round
+        const u8* match = op - offset;
+        while (match_length != 0) {
+            const auto chunk =
+                std::min<std::size_t>(match_length, static_cast<std::size_t>(op - match));
+            std::memcpy(op, match, chunk);
+            op += chunk;
+            match_length -= chunk;
+        }
+    }
+    return op == op_end;
+}
+
+bool DecompressRows(const u8* src, std::size_t size, u8* dst, std::ptrdiff_t pitch,
+                    std::size_t row_bytes, std::size_t rows) {
+    if (row_bytes == 0) {
+        return false;
+    }
+    // Positions count through the rows as if they were packed, every copy stops at the end of a
+    // row as the next one can be anywhere
+    const auto at = [&](std::size_t position) {
+        return dst + static_cast<std::ptrdiff_t>(position / row_bytes) * pitch +
+               static_cast<std::ptrdiff_t>(position % row_bytes);
+    };
+    const auto row_left = [&](std::size_t position) { return row_bytes - position % row_bytes; };
+
+    const u8* ip = src;
+    const u8* const ip_end = src + size;
+    std::size_t op = 0;
+    const std::size_t op_end = row_bytes * rows;
+
+    while (ip < ip_end) {
+        const u8 token = *ip++;
+
+        std::size_t literal_length = token >> 4;
+        if (literal_length == 15 && !ReadLength(literal_length, ip, ip_end)) {
+            return false;
+        }
+        if (static_cast<std::size_t>(ip_end - ip) < literal_length ||
+            op_end - op < literal_length) {
+            return false;
+        }
+        while (literal_length != 0) {
+            const auto chunk = std::min<std::size_t>(literal_length, row_left(op));
+            std::memcpy(at(op), ip, chunk);
+            ip += chunk;
+            op += chunk;
+            literal_length -= chunk;
+        }
+
+        // The last sequence ends after its literals
+        if (ip == ip_end) {
+            break;
+        }
+
+        if (ip_end - ip < 2) {
+            return false;
+        }
+        const std::size_t offset =
+            static_cast<std::size_t>(ip[0]) | (static_cast<std::size_t>(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) {
+            return false;
+        }
+
+        std::size_t match_length = token & 15;
+        if (match_length == 15 && !ReadLength(match_length, ip, ip_end)) {
+            return false;
+        }
+        match_length += MIN_MATCH;
+        if (op_end - op < match_length) {
+            return false;
+        }
+
+        // The history is read back out of the rows already written. Copying at most offset bytes
+        // at a time keeps every copy clear of its own output
+        std::size_t match = op - offset;
+        while (match_length != 0) {
+            const auto chunk = std::min<std::size_t>(
+                {match_length, offset, row_left(op), row_left(match)});
+            std::memcpy(at(op), at(match), chunk);
+            op += chunk;
+            match += chunk;
+            match_length -= chunk;
+        }
+    }
+    return op == op_end;
+}
+
+} // namespace Lz4
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include "common_types.h"
+
+namespace Lz4 {
+
+/// Largest size Compress can produce for size bytes of input
+std::size_t CompressBound(std::size_t size);
+
+/// Compresses src into the LZ4 block format, returns the compressed size or 0 if it didn't fit in
+/// capacity bytes. Favours speed over ratio, it's only run when baking
+std::size_t Compress(const u8* src, std::size_t size, u8* dst, std::size_t capacity);
+
+/// Decompresses an LZ4 block which has to expand to exactly dst_size bytes. Every read and write
+/// is bounds checked, so a damaged block fails instead of running past either buffer
+bool Decompress(const u8* src, std::size_t size, u8* dst, std::size_t dst_size);
+
+/// Same as Decompress, but the block expands into rows of row_bytes each which start pitch bytes
+/// apart, such as a bitmap with padding or the opposite row order
+bool DecompressRows(const u8* src, std::size_t size, u8* dst, std::ptrdiff_t pitch,
+                    std::size_t row_bytes, std::size_t rows);
+
+} // namespace Lz4
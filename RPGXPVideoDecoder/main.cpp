@@ -1,10 +1,25 @@
+#include <cstring>
+#include <mutex>
+#include <string>
 #include <SDL.h>
 #include <Windows.h>
 #include "common_types.h"
+#include "context_registry.h"
 #include "decoder.h"
+#include "decoder_settings.h"
+#include "media_input.h"
+#include "video_baker.h"
 #include "rgssad_bitmap.h"
+#include "task_scheduler.h"
+
+ContextRegistry decoder_contexts{};
+// Context used by the original single instance calls, 0 while none is open
+u32 legacy_context{};
+
+// Every context created while this is set records a trace into it, see ViDecSetTraceDirectory
+std::mutex trace_mutex;
+std::string trace_directory{};
 
-std::unique_ptr<Decoder> ffmpeg_decoder{};
 BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved) {
     switch (fdwReason) {
     case DLL_PROCESS_ATTACH:
@@ -13,9 +28,15 @@ BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved) {
 
         break;
     case DLL_PROCESS_DETACH:
-        if (ffmpeg_decoder) {
-            ffmpeg_decoder.reset();
+        // The process is exiting and every other thread is already gone, the OS reclaims the rest
+        if (lpvReserved != nullptr) {
+            break;
         }
+        // Closing contexts joins their threads under the loader lock, which is why scripts should
+        // call ViDecShutdown before unloading us. This is only a fallback for when they didn't
+        decoder_contexts.Clear();
+        legacy_context = 0;
+        TaskScheduler::Shutdown();
         SDL_AudioQuit();
         SDL_Quit();
         break;
@@ -23,8 +44,36 @@ BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved) {
     return true;
 }
 
-API_CALL ErrorCode ViDecCreateContext(char* video_path, s32 video_volume,
-                                      EngineAddr bitmap_object) {
+// Makes sure the bitmap can be drawn to and registers a new context for it, the decoder still
+// has to be set up by the caller
+static ErrorCode CreateDecoder(s32 video_volume, EngineAddr bitmap_object,
+                               const DecoderSettings& settings, u32* context,
+                               std::shared_ptr<Decoder>& decoder) {
+    const RPGMaker::Bitmap bitmap(bitmap_object);
+    // Make sure our bitmap is still valid
+    if (bitmap.IsDisposed()) {
+        return ErrorCode::BitmapIsDisposed;
+    }
+
+    decoder =
+        std::make_shared<Decoder>(std::make_unique<RPGMaker::Bitmap>(bitmap_object), settings);
+
+    video_volume = max(0, min(video_volume, 128));
+    decoder->SetVolume(static_cast<float>(video_volume) / 128.0f);
+
+    // The context is registered even if setup fails so the game can still ask it what went wrong,
+    // it has to be closed either way
+    *context = decoder_contexts.Add(decoder);
+
+    std::scoped_lock lock{trace_mutex};
+    if (!trace_directory.empty()) {
+        const auto path = trace_directory + "\\videc_trace_" + std::to_string(*context) + ".json";
+        decoder->EnableTracing(path.c_str());
+    }
+    return ErrorCode::Success;
+}
+
+static ErrorCode CheckVideoPath(const char* video_path) {
     const DWORD file_attributes = GetFileAttributesA(video_path);
     // Make sure the file exists
     if (file_attributes == INVALID_FILE_ATTRIBUTES) {
@@ -34,65 +83,152 @@ API_CALL ErrorCode ViDecCreateContext(char* video_path, s32 video_volume,
     if (file_attributes & FILE_ATTRIBUTE_DIRECTORY) {
         return ErrorCode::InvalidFile;
     }
+    return ErrorCode::Success;
+}
 
-    const RPGMaker::Bitmap bitmap(bitmap_object);
-    // Make sure our bitmap is still valid
-    if (bitmap.IsDisposed()) {
-        return ErrorCode::BitmapIsDisposed;
+static ErrorCode CreateContext(char* video_path, s32 video_volume, EngineAddr bitmap_object,
+                               const DecoderSettings& settings, u32* context) {
+    auto result = CheckVideoPath(video_path);
+    if (result != ErrorCode::Success) {
+        return result;
     }
 
-    // Only allow 1 decoder instance at one time
-    if (ffmpeg_decoder) {
-        return ErrorCode::DecoderInstanceAlreadyCreated;
-    } else {
-        ffmpeg_decoder = std::make_unique<Decoder>(bitmap_object);
+    std::shared_ptr<Decoder> decoder{};
+    result = CreateDecoder(video_volume, bitmap_object, settings, context, decoder);
+    if (result != ErrorCode::Success) {
+        return result;
     }
 
-    video_volume = max(0, min(video_volume, 128));
-    ffmpeg_decoder->SetVolume(static_cast<float>(video_volume) / 128.0f);
-
     // Setup the decoder and start the ahead of time decoder
-    return ffmpeg_decoder->Setup(video_path);
+    return decoder->Setup(video_path);
 }
 
-API_CALL ErrorCode ViDecSetVolume(s32 volume) {
-    if (!ffmpeg_decoder) {
-        return ErrorCode::DecoderNotCreated;
+static ErrorCode CreateContext(std::unique_ptr<MediaInput> input, s32 video_volume,
+                               EngineAddr bitmap_object, const DecoderSettings* settings,
+                               u32* context) {
+    std::shared_ptr<Decoder> decoder{};
+    const auto result = CreateDecoder(video_volume, bitmap_object, LoadDecoderSettings(settings),
+                                      context, decoder);
+    if (result != ErrorCode::Success) {
+        return result;
     }
+    return decoder->Setup(std::move(input));
+}
 
-    volume = max(0, min(volume, 128));
+API_CALL ErrorCode ViDecCtxCreate(char* video_path, s32 video_volume, EngineAddr bitmap_object,
+                                  const DecoderSettings* settings, u32* context) {
+    if (context == nullptr) {
+        return ErrorCode::InvalidArguments;
+    }
+    *context = 0;
+    return CreateContext(video_path, video_volume, bitmap_object, LoadDecoderSettings(settings),
+                         context);
+}
 
-    ffmpeg_decoder->SetVolume(static_cast<float>(volume) / 128.0f);
+API_CALL ErrorCode ViDecCtxCreateFromMemory(const u8* data, u32 size, u32 copy_data,
+                                            s32 video_volume, EngineAddr bitmap_object,
+                                            const DecoderSettings* settings, u32* context) {
+    if (context == nullptr || data == nullptr || size == 0) {
+        return ErrorCode::InvalidArguments;
+    }
+    *context = 0;
+
+    // Without copy_data the caller has to keep the buffer alive until the context is closed
+    auto input = std::make_unique<MemoryInput>(data, size, copy_data != 0);
+    return CreateContext(std::move(input), video_volume, bitmap_object, settings, context);
+}
 
+API_CALL ErrorCode ViDecCtxCreateMapped(char* video_path, s32 video_volume,
+                                        EngineAddr bitmap_object, const DecoderSettings* settings,
+                                        u32* context) {
+    if (context == nullptr) {
+        return ErrorCode::InvalidArguments;
+    }
+    *context = 0;
+
+    const auto result = CheckVideoPath(video_path);
+    if (result != ErrorCode::Success) {
+        return result;
+    }
+
+    // Files too big for the address space are read normally instead, baked videos are always
+    // mapped by the decoder itself
+    auto input = BakedVideo::IsBaked(video_path) ? nullptr : MappedFileInput::Open(video_path);
+    if (!input) {
+        return CreateContext(video_path, video_volume, bitmap_object,
+                             LoadDecoderSettings(settings), context);
+    }
+    return CreateContext(std::move(input), video_volume, bitmap_object, settings, context);
+}
+
+API_CALL ErrorCode ViDecCtxCreateFromReader(const MediaReader* reader, s32 video_volume,
+                                            EngineAddr bitmap_object,
+                                            const DecoderSettings* settings, u32* context) {
+    if (context == nullptr) {
+        return ErrorCode::InvalidArguments;
+    }
+    *context = 0;
+
+    auto input = ReaderInput::Open(reader);
+    if (!input) {
+        return ErrorCode::InvalidArguments;
+    }
+    return CreateContext(std::move(input), video_volume, bitmap_object, settings, context);
+}
+
+API_CALL ErrorCode ViDecCtxCreateFromArchive(char* archive_path, char* entry_name,
+                                             s32 video_volume, EngineAddr bitmap_object,
+                                             const DecoderSettings* settings, u32* context) {
+    if (context == nullptr) {
+        return ErrorCode::InvalidArguments;
+    }
+    *context = 0;
+
+    auto input = RgssArchiveInput::Open(archive_path, entry_name);
+    if (!input) {
+        return ErrorCode::FileNotFound;
+    }
+    return CreateContext(std::move(input), video_volume, bitmap_object, settings, context);
+}
+
+API_CALL ErrorCode ViDecCtxClose(u32 context) {
+    if (!decoder_contexts.Remove(context)) {
+        return ErrorCode::DecoderNotCreated;
+    }
     return ErrorCode::Success;
 }
 
-API_CALL ErrorCode ViDecCloseContext() {
-    if (!ffmpeg_decoder) {
+API_CALL ErrorCode ViDecCtxSetVolume(u32 context, s32 volume) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
         return ErrorCode::DecoderNotCreated;
     }
 
-    // Free up our decoder context
-    ffmpeg_decoder.reset();
+    volume = max(0, min(volume, 128));
+
+    decoder->SetVolume(static_cast<float>(volume) / 128.0f);
+
     return ErrorCode::Success;
 }
 
-API_CALL ErrorCode ViDecStartRender() {
-    if (!ffmpeg_decoder) {
+API_CALL ErrorCode ViDecCtxStartRender(u32 context) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
         return ErrorCode::DecoderNotCreated;
     }
 
-    ffmpeg_decoder->StartRender();
+    decoder->StartRender();
     return ErrorCode::Success;
 }
 
-API_CALL ErrorCode ViDecGetVideoState() {
-    if (!ffmpeg_decoder) {
+API_CALL ErrorCode ViDecCtxGetVideoState(u32 context) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
         return ErrorCode::DecoderNotCreated;
     }
 
     // Return if we're still rendering the video
-    if (!ffmpeg_decoder->IsCompleted()) {
+    if (!decoder->IsCompleted()) {
         return ErrorCode::VideoNotFinished;
     }
 
@@ -100,23 +236,366 @@ API_CALL ErrorCode ViDecGetVideoState() {
     return ErrorCode::Success;
 }
 
-API_CALL s32 ViDecGetInternalError() {
-    if (!ffmpeg_decoder) {
+API_CALL s32 ViDecCtxGetInternalError(u32 context) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
         return 0;
     }
-    return ffmpeg_decoder->GetInternalError();
+    return decoder->GetInternalError();
 }
 
-API_CALL const char* ViDecGetInternalErrorMessage() {
-    if (!ffmpeg_decoder) {
+API_CALL const char* ViDecCtxGetInternalErrorMessage(u32 context) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
         return "Decoder instance doesn't exist";
     }
-    return ffmpeg_decoder->GetInternalErrorMessage();
+    // The message lives in the decoder and never changes once set, so it stays valid until the
+    // context is closed
+    return decoder->GetInternalErrorMessage();
 }
 
-API_CALL s32 ViDecWasBadTermination() {
-    if (!ffmpeg_decoder) {
+API_CALL s32 ViDecCtxWasBadTermination(u32 context) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
+        return 0;
+    }
+    return decoder->WasBadTermination() ? 1 : 0;
+}
+
+API_CALL u32 ViDecCtxGetPlaybackAllocations(u32 context) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
+        return 0;
+    }
+    return static_cast<u32>(decoder->GetPlaybackAllocations());
+}
+
+API_CALL ErrorCode ViDecCtxGetFrameDropCounts(u32 context, u32* dropped, u32* skipped,
+                                              u32* discarded) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
+        return ErrorCode::DecoderNotCreated;
+    }
+
+    if (dropped != nullptr) {
+        *dropped = static_cast<u32>(decoder->GetDroppedFrames());
+    }
+    if (skipped != nullptr) {
+        *skipped = static_cast<u32>(decoder->GetSkippedFrames());
+    }
+    if (discarded != nullptr) {
+        *discarded = static_cast<u32>(decoder->GetDiscardedFrames());
+    }
+    return ErrorCode::Success;
+}
+
+API_CALL ErrorCode ViDecCtxSetQualityLadder(u32 context, u32 allowed_rungs) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
+        return ErrorCode::DecoderNotCreated;
+    }
+
+    decoder->SetQualityLadder(allowed_rungs);
+    return ErrorCode::Success;
+}
+
+API_CALL u32 ViDecCtxGetQualityRung(u32 context) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
         return 0;
     }
-    return ffmpeg_decoder->WasBadTermination() ? 1 : 0;
+    return static_cast<u32>(decoder->GetQualityRung());
+}
+
+API_CALL ErrorCode ViDecCtxGetVideoThreading(u32 context, u32* thread_count, u32* thread_type) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
+        return ErrorCode::DecoderNotCreated;
+    }
+
+    if (thread_count != nullptr) {
+        *thread_count = decoder->GetVideoThreadCount();
+    }
+    if (thread_type != nullptr) {
+        *thread_type = decoder->GetVideoThreadType();
+    }
+    return ErrorCode::Success;
+}
+
+API_CALL ErrorCode ViDecCtxGetMemoryStats(u32 context, u32* peak_working_set,
+                                          u32* peak_buffered_bytes) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
+        return ErrorCode::DecoderNotCreated;
+    }
+
+    if (peak_working_set != nullptr) {
+        *peak_working_set = static_cast<u32>(decoder->GetPeakWorkingSet());
+    }
+    if (peak_buffered_bytes != nullptr) {
+        *peak_buffered_bytes = static_cast<u32>(decoder->GetPeakBufferedBytes());
+    }
+    return ErrorCode::Success;
+}
+
+API_CALL ErrorCode ViDecCtxGetSyncStats(u32 context, SyncStats* stats) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
+        return ErrorCode::DecoderNotCreated;
+    }
+    if (stats == nullptr || stats->struct_size < sizeof(u32)) {
+        return ErrorCode::InvalidArguments;
+    }
+
+    // Older callers get the fields they know about, newer ones can tell what we left untouched
+    // from struct_size
+    SyncStats current{};
+    decoder->GetSyncStats(current);
+    const auto copy_size = stats->struct_size < sizeof(SyncStats) ? stats->struct_size
+                                                                   : sizeof(SyncStats);
+    std::memcpy(stats, &current, copy_size);
+    stats->struct_size = static_cast<u32>(copy_size);
+    return ErrorCode::Success;
+}
+
+API_CALL ErrorCode ViDecCtxGetStats(u32 context, PlaybackStats* stats) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
+        return ErrorCode::DecoderNotCreated;
+    }
+    if (stats == nullptr || stats->struct_size < sizeof(u32)) {
+        return ErrorCode::InvalidArguments;
+    }
+
+    // Versioned by struct_size the same way as SyncStats
+    PlaybackStats current{};
+    decoder->GetStats(current);
+    const auto copy_size = stats->struct_size < sizeof(PlaybackStats) ? stats->struct_size
+                                                                      : sizeof(PlaybackStats);
+    std::memcpy(stats, &current, copy_size);
+    stats->struct_size = static_cast<u32>(copy_size);
+    return ErrorCode::Success;
+}
+
+API_CALL ErrorCode ViDecCtxSeek(u32 context, u32 position_ms) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
+        return ErrorCode::DecoderNotCreated;
+    }
+
+    if (!decoder->Seek(static_cast<double>(position_ms) / 1000.0)) {
+        return ErrorCode::InternalError;
+    }
+    return ErrorCode::Success;
+}
+
+API_CALL ErrorCode ViDecCtxSetLoop(u32 context, u32 enabled, u32 start_ms, u32 end_ms) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
+        return ErrorCode::DecoderNotCreated;
+    }
+
+    decoder->SetLoop(enabled != 0, static_cast<double>(start_ms) / 1000.0,
+                     static_cast<double>(end_ms) / 1000.0);
+    return ErrorCode::Success;
+}
+
+API_CALL ErrorCode ViDecCtxSetViewport(u32 context, u32 mode, u32 x, u32 y, u32 width,
+                                       u32 height) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
+        return ErrorCode::DecoderNotCreated;
+    }
+    if (mode >= VIEWPORT_MODE_COUNT) {
+        return ErrorCode::InvalidArguments;
+    }
+
+    const ViewportRect rect{x, y, width, height};
+    if (!decoder->SetViewport(static_cast<ViewportMode>(mode), rect)) {
+        return ErrorCode::InvalidArguments;
+    }
+    return ErrorCode::Success;
+}
+
+API_CALL ErrorCode ViDecCtxSetScaler(u32 context, u32 quality) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
+        return ErrorCode::DecoderNotCreated;
+    }
+    if (quality >= SCALER_QUALITY_COUNT) {
+        return ErrorCode::InvalidArguments;
+    }
+
+    decoder->SetScaler(static_cast<ScalerQuality>(quality));
+    return ErrorCode::Success;
+}
+
+API_CALL u32 ViDecCtxGetPosition(u32 context) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
+        return 0;
+    }
+    return static_cast<u32>(decoder->GetPosition() * 1000.0);
+}
+
+API_CALL u32 ViDecCtxGetKeyframeCount(u32 context) {
+    const auto decoder = decoder_contexts.Get(context);
+    if (!decoder) {
+        return 0;
+    }
+    return static_cast<u32>(decoder->GetKeyframeCount());
+}
+
+API_CALL ErrorCode ViDecSetWorkerCount(u32 worker_count) {
+    // Shared by every context, 0 goes back to one per logical core minus one
+    TaskScheduler::Configure(worker_count);
+    return ErrorCode::Success;
+}
+
+API_CALL u32 ViDecGetWorkerCount() {
+    return static_cast<u32>(TaskScheduler::Get().GetWorkerCount());
+}
+
+API_CALL ErrorCode ViDecShutdown() {
+    // Closes every context and stops the shared workers while it's still safe to wait on threads,
+    // DllMain can't. Anything created afterwards starts them up again
+    decoder_contexts.Clear();
+    legacy_context = 0;
+    TaskScheduler::Shutdown();
+    return ErrorCode::Success;
+}
+
+API_CALL ErrorCode ViDecSetTraceDirectory(const char* directory) {
+    // Only contexts created from now on are traced, each writes its trace once it's closed
+    std::scoped_lock lock{trace_mutex};
+    trace_directory = directory != nullptr ? directory : "";
+    while (!trace_directory.empty() &&
+           (trace_directory.back() == '\\' || trace_directory.back() == '/')) {
+        trace_directory.pop_back();
+    }
+    return ErrorCode::Success;
+}
+
+API_CALL ErrorCode ViDecBakeVideo(char* video_path, char* baked_path, u32 width, u32 height,
+                                  u32 flags) {
+    if (baked_path == nullptr || width == 0 || height == 0) {
+        return ErrorCode::InvalidArguments;
+    }
+    const auto result = CheckVideoPath(video_path);
+    if (result != ErrorCode::Success) {
+        return result;
+    }
+
+    // Runs on the calling thread until the whole video has been baked
+    VideoBaker baker{};
+    return baker.Bake(video_path, baked_path, width, height, (flags & BAKE_COMPRESS) != 0);
+}
+
+// The original single instance API, every call below acts on the one legacy context
+
+static ErrorCode CreateLegacyContext(char* video_path, s32 video_volume, EngineAddr bitmap_object,
+                                     const DecoderSettings& settings) {
+    // Only allow 1 legacy decoder instance at one time, handle based contexts don't count
+    if (decoder_contexts.Get(legacy_context)) {
+        return ErrorCode::DecoderInstanceAlreadyCreated;
+    }
+    return CreateContext(video_path, video_volume, bitmap_object, settings, &legacy_context);
+}
+
+API_CALL ErrorCode ViDecCreateContext(char* video_path, s32 video_volume,
+                                      EngineAddr bitmap_object) {
+    return CreateLegacyContext(video_path, video_volume, bitmap_object, DecoderSettings{});
+}
+
+API_CALL ErrorCode ViDecCreateContextEx(char* video_path, s32 video_volume,
+                                        EngineAddr bitmap_object,
+                                        const DecoderSettings* settings) {
+    return CreateLegacyContext(video_path, video_volume, bitmap_object,
+                               LoadDecoderSettings(settings));
+}
+
+API_CALL ErrorCode ViDecSetVolume(s32 volume) {
+    return ViDecCtxSetVolume(legacy_context, volume);
+}
+
+API_CALL ErrorCode ViDecCloseContext() {
+    const ErrorCode result = ViDecCtxClose(legacy_context);
+    legacy_context = 0;
+    return result;
+}
+
+API_CALL ErrorCode ViDecStartRender() {
+    return ViDecCtxStartRender(legacy_context);
+}
+
+API_CALL ErrorCode ViDecGetVideoState() {
+    return ViDecCtxGetVideoState(legacy_context);
+}
+
+API_CALL s32 ViDecGetInternalError() {
+    return ViDecCtxGetInternalError(legacy_context);
+}
+
+API_CALL const char* ViDecGetInternalErrorMessage() {
+    return ViDecCtxGetInternalErrorMessage(legacy_context);
+}
+
+API_CALL s32 ViDecWasBadTermination() {
+    return ViDecCtxWasBadTermination(legacy_context);
+}
+
+API_CALL u32 ViDecGetPlaybackAllocations() {
+    return ViDecCtxGetPlaybackAllocations(legacy_context);
+}
+
+API_CALL ErrorCode ViDecGetFrameDropCounts(u32* dropped, u32* skipped, u32* discarded) {
+    return ViDecCtxGetFrameDropCounts(legacy_context, dropped, skipped, discarded);
+}
+
+API_CALL ErrorCode ViDecSetQualityLadder(u32 allowed_rungs) {
+    return ViDecCtxSetQualityLadder(legacy_context, allowed_rungs);
+}
+
+API_CALL u32 ViDecGetQualityRung() {
+    return ViDecCtxGetQualityRung(legacy_context);
+}
+
+API_CALL ErrorCode ViDecGetVideoThreading(u32* thread_count, u32* thread_type) {
+    return ViDecCtxGetVideoThreading(legacy_context, thread_count, thread_type);
+}
+
+API_CALL ErrorCode ViDecGetMemoryStats(u32* peak_working_set, u32* peak_buffered_bytes) {
+    return ViDecCtxGetMemoryStats(legacy_context, peak_working_set, peak_buffered_bytes);
+}
+
+API_CALL ErrorCode ViDecGetSyncStats(SyncStats* stats) {
+    return ViDecCtxGetSyncStats(legacy_context, stats);
+}
+
+API_CALL ErrorCode ViDecGetStats(PlaybackStats* stats) {
+    return ViDecCtxGetStats(legacy_context, stats);
+}
+
+API_CALL ErrorCode ViDecSeek(u32 position_ms) {
+    return ViDecCtxSeek(legacy_context, position_ms);
+}
+
+API_CALL ErrorCode ViDecSetLoop(u32 enabled, u32 start_ms, u32 end_ms) {
+    return ViDecCtxSetLoop(legacy_context, enabled, start_ms, end_ms);
+}
+
+API_CALL ErrorCode ViDecSetViewport(u32 mode, u32 x, u32 y, u32 width, u32 height) {
+    return ViDecCtxSetViewport(legacy_context, mode, x, y, width, height);
+}
+
+API_CALL ErrorCode ViDecSetScaler(u32 quality) {
+    return ViDecCtxSetScaler(legacy_context, quality);
+}
+
+API_CALL u32 ViDecGetPosition() {
+    return ViDecCtxGetPosition(legacy_context);
+}
+
+API_CALL u32 ViDecGetKeyframeCount() {
+    return ViDecCtxGetKeyframeCount(legacy_context);
 }
@@ -0,0 +1,49 @@
+#include "media_clock.h"
+
+void MediaClock::Start(double position) {
+    paused.store(false);
+    offset.store(position - Platform::GetMonotonicSeconds());
+    started.store(true, std::memory_order_release);
+}
+
+bool MediaClock::IsStarted() const {
+    return started.load(std::memory_order_acquire);
+}
+
+void MediaClock::Stop() {
+    started.store(false, std::memory_order_release);
+}
+
+void MediaClock::Pause() {
+    if (paused.load()) {
+        return;
+    }
+    paused_position.store(GetPosition());
+    paused.store(true);
+}
+
+void MediaClock::Resume() {
+    if (!paused.load()) {
+        return;
+    }
+    offset.store(paused_position.load() - Platform::GetMonotonicSeconds());
+    paused.store(false);
+}
+
+bool MediaClock::IsPaused() const {
+    return paused.load();
+}
+
+void MediaClock::Sync(double position) {
+    if (paused.load()) {
+        return;
+    }
+    offset.store(position - Platform::GetMonotonicSeconds());
+}
+
+double MediaClock::GetPosition() const {
+    if (paused.load()) {
+        return paused_position.load();
+    }
+    return Platform::GetMonotonicSeconds() + offset.load();
+}
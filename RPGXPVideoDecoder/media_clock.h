@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+
+#include "common_types.h"
+#include "platform.h"
+
+/// Monotonic presentation clock which can be paused and re-anchored to a master source such as
+/// the audio device. Every method is safe to call from any thread.
+class MediaClock {
+public:
+    /// Starts the clock running from position
+    void Start(double position);
+    bool IsStarted() const;
+
+    /// Stops the clock until the next Start, nothing counts as late in the meantime
+    void Stop();
+
+    /// Freezes the position until Resume is called
+    void Pause();
+    void Resume();
+    bool IsPaused() const;
+
+    /// Moves the clock to position from now on, ignored while paused
+    void Sync(double position);
+
+    double GetPosition() const;
+
+private:
+    std::atomic<bool> started{false};
+    std::atomic<bool> paused{false};
+    std::atomic<double> offset{};
+    std::atomic<double> paused_position{};
+};
+
+/// How closely presented frames followed the clock, exposed through ViDecGetSyncStats. The struct
+/// is shared across the DLL boundary so fields are only ever appended, struct_size is filled in
+/// with the size the DLL knows about.
+struct SyncStats {
+    u32 struct_size{sizeof(SyncStats)};
+    // 1 while the clock follows the audio device, 0 while it runs off the monotonic clock
+    u32 audio_master{};
+    // Average and largest difference between a frames timestamp and the clock when it was shown,
+    // positive means late
+    s32 average_drift_us{};
+    u32 max_drift_us{};
+    // RMS difference between the time between presented frames and the time between their
+    // timestamps
+    u32 frame_jitter_us{};
+    u32 presented_frames{};
+};
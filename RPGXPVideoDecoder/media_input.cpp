@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "media_input.h"
+
+namespace {
+
+// Works out where a seek lands for media of a known size, returns -1 if it's out of range
+int64_t ResolveSeek(int64_t offset, int whence, u64 position, u64 size) {
+    if ((whence & AVSEEK_SIZE) != 0) {
+        return static_cast<int64_t>(size);
+    }
+
+    int64_t target{};
+    switch (whence & ~AVSEEK_FORCE) {
+    case SEEK_SET:
+        target = offset;
+        break;
+    case SEEK_CUR:
+        target = static_cast<int64_t>(position) + offset;
+        break;
+    case SEEK_END:
+        target = static_cast<int64_t>(size) + offset;
+        break;
+    default:
+        return -1;
+    }
+    if (target < 0 || static_cast<u64>(target) > size) {
+        return -1;
+    }
+    return target;
+}
+
+bool ReadExact(Platform::File& file, void* buffer, std::size_t size) {
+    return file.Read(buffer, size) == static_cast<s64>(size);
+}
+
+// Archive entries are stored with backslashes, games tend to write paths either way
+std::string NormalizeEntryName(std::string name) {
+    for (auto& c : name) {
+        c = c == '/' ? '\\' : static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return name;
+}
+
+} // Anonymous namespace
+
+MemoryInput::MemoryInput(const u8* data, std::size_t size, bool copy) {
+    if (copy) {
+        owned.assign(data, data + size);
+        SetView(owned.data(), owned.size());
+    } else {
+        SetView(data, size);
+    }
+}
+
+void MemoryInput::SetView(const u8* data, std::size_t size) {
+    view = data;
+    view_size = size;
+    position = 0;
+}
+
+int MemoryInput::read(uint8_t* data, size_t size) {
+    const auto remaining = view_size - position;
+    if (remaining == 0) {
+        return AVERROR_EOF;
+    }
+    const auto count = std::min<std::size_t>({size, remaining, 0x7fffffff});
+    std::memcpy(data, view + position, count);
+    position += count;
+    return static_cast<int>(count);
+}
+
+int64_t MemoryInput::seek(int64_t offset, int whence) {
+    const auto target = ResolveSeek(offset, whence, position, view_size);
+    if (target >= 0 && (whence & AVSEEK_SIZE) == 0) {
+        position = static_cast<std::size_t>(target);
+    }
+    return target;
+}
+
+int MemoryInput::seekable() const {
+    return AVIO_SEEKABLE_NORMAL;
+}
+
+const char* MemoryInput::name() const {
+    return "memory";
+}
+
+std::unique_ptr<MappedFileInput> MappedFileInput::Open(const char* path) {
+    std::unique_ptr<MappedFileInput> input(new MappedFileInput());
+    input->mapped = Platform::MappedFile::Open(path, true);
+    if (!input->mapped) {
+        return nullptr;
+    }
+    input->SetView(input->mapped->GetData(), input->mapped->GetSize());
+    return input;
+}
+
+int MappedFileInput::read(uint8_t* data, size_t size) {
+    // Stay a block ahead of the demuxer, topping up once it gets half way through what's left
+    if (position + size + READAHEAD_BYTES / 2 > prefetched_end && prefetched_end < view_size) {
+        Prefetch();
+    }
+    return MemoryInput::read(data, size);
+}
+
+void MappedFileInput::Prefetch() {
+    // Seeks can jump past what we've prefetched, start again from wherever we are now
+    const auto start = std::max<std::size_t>(prefetched_end, position);
+    const auto end = std::min<std::size_t>(view_size, start + READAHEAD_BYTES);
+    prefetched_end = end;
+    if (end > start) {
+        mapped->Prefetch(start, end - start);
+    }
+}
+
+const char* MappedFileInput::name() const {
+    return "mapped file";
+}
+
+std::unique_ptr<ReaderInput> ReaderInput::Open(const MediaReader* user_reader) {
+    if (user_reader == nullptr || user_reader->struct_size < sizeof(u32)) {
+        return nullptr;
+    }
+
+    // Copy the fields the caller knows about, anything newer stays null
+    MediaReader reader{};
+    const auto copy_size = user_reader->struct_size < sizeof(MediaReader)
+                               ? user_reader->struct_size
+                               : sizeof(MediaReader);
+    std::memcpy(&reader, user_reader, copy_size);
+    reader.struct_size = sizeof(MediaReader);
+    if (reader.read == nullptr) {
+        return nullptr;
+    }
+    return std::unique_ptr<ReaderInput>(new ReaderInput(reader));
+}
+
+ReaderInput::ReaderInput(const MediaReader& reader) : reader(reader) {}
+
+ReaderInput::~ReaderInput() {
+    if (reader.close != nullptr) {
+        reader.close(reader.user_data);
+    }
+}
+
+int ReaderInput::read(uint8_t* data, size_t size) {
+    const auto count = std::min<std::size_t>(size, 0x7fffffff);
+    const s32 result = reader.read(reader.user_data, data, static_cast<u32>(count));
+    if (result == 0) {
+        return AVERROR_EOF;
+    }
+    if (result < 0) {
+        return AVERROR(EIO);
+    }
+    return result;
+}
+
+int64_t ReaderInput::seek(int64_t offset, int whence) {
+    if ((whence & AVSEEK_SIZE) != 0) {
+        return reader.get_size != nullptr ? reader.get_size(reader.user_data) : -1;
+    }
+    if (reader.seek == nullptr) {
+        return -1;
+    }
+
+    const int origin = whence & ~AVSEEK_FORCE;
+    if (origin != SEEK_SET && origin != SEEK_CUR && origin != SEEK_END) {
+        return -1;
+    }
+    // SEEK_SET, SEEK_CUR and SEEK_END are 0, 1 and 2 which is what the reader takes as well
+    return reader.seek(reader.user_data, offset, origin);
+}
+
+int ReaderInput::seekable() const {
+    return reader.seek != nullptr ? AVIO_SEEKABLE_NORMAL : 0;
+}
+
+const char* ReaderInput::name() const {
+    return "reader";
+}
+
+std::unique_ptr<RgssArchiveInput> RgssArchiveInput::Open(const char* archive_path,
+                                                         const char* entry_name) {
+    if (archive_path == nullptr || entry_name == nullptr) {
+        return nullptr;
+    }
+
+    std::unique_ptr<RgssArchiveInput> input(new RgssArchiveInput());
+    input->file = Platform::File::OpenRead(archive_path);
+    if (!input->file) {
+        return nullptr;
+    }
+    auto& file = *input->file;
+
+    static constexpr char MAGIC[8] = {'R', 'G', 'S', 'S', 'A', 'D', '\0', '\1'};
+    char magic[sizeof(MAGIC)]{};
+    if (!ReadExact(file, magic, sizeof(magic)) ||
+        std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        return nullptr;
+    }
+
+    // Every entry header is encrypted with a key which steps forward once per field and once per
+    // byte of the name, the entry data carries on from wherever the key got to
+    const auto wanted = NormalizeEntryName(entry_name);
+    u32 key = 0xDEADCAFE;
+    std::string name{};
+    while (true) {
+        u32 name_length{};
+        if (!ReadExact(file, &name_length, sizeof(name_length))) {
+            return nullptr;
+        }
+        name_length ^= key;
+        key = AdvanceKey(key, 1);
+        if (name_length == 0 || name_length > 4096) {
+            return nullptr;
+        }
+
+        name.resize(name_length);
+        if (!ReadExact(file, name.data(), name_length)) {
+            return nullptr;
+        }
+        for (auto& c : name) {
+            c = static_cast<char>(static_cast<u8>(c) ^ static_cast<u8>(key & 0xff));
+            key = AdvanceKey(key, 1);
+        }
+
+        u32 data_size{};
+        if (!ReadExact(file, &data_size, sizeof(data_size))) {
+            return nullptr;
+        }
+        data_size ^= key;
+        key = AdvanceKey(key, 1);
+
+        u64 here{};
+        if (!file.GetPosition(here)) {
+            return nullptr;
+        }
+
+        if (NormalizeEntryName(name) == wanted) {
+            input->data_offset = here;
+            input->data_size = data_size;
+            input->data_key = key;
+            return input;
+        }
+        if (!file.SetPosition(here + data_size)) {
+            return nullptr;
+        }
+    }
+}
+
+int RgssArchiveInput::read(uint8_t* data, size_t size) {
+    const auto remaining = data_size - position;
+    if (remaining == 0) {
+        return AVERROR_EOF;
+    }
+    const auto count = static_cast<std::size_t>(std::min<u64>({size, remaining, 0x7fffffff}));
+    if (!file->SetPosition(data_offset + position)) {
+        return AVERROR(EIO);
+    }
+    const s64 read = file->Read(data, count);
+    if (read <= 0) {
+        return AVERROR(EIO);
+    }
+
+    // The data is XORed a little endian word at a time, the key stepping once per word
+    u32 key = AdvanceKey(data_key, position / 4);
+    u32 shift = static_cast<u32>(position % 4) * 8;
+    for (s64 i = 0; i < read; i++) {
+        data[i] ^= static_cast<u8>(key >> shift);
+        shift += 8;
+        if (shift == 32) {
+            shift = 0;
+            key = AdvanceKey(key, 1);
+        }
+    }
+    position += read;
+    return static_cast<int>(read);
+}
+
+int64_t RgssArchiveInput::seek(int64_t offset, int whence) {
+    const auto target = ResolveSeek(offset, whence, position, data_size);
+    if (target >= 0 && (whence & AVSEEK_SIZE) == 0) {
+        position = static_cast<u64>(target);
+    }
+    return target;
+}
+
+int RgssArchiveInput::seekable() const {
+    return AVIO_SEEKABLE_NORMAL;
+}
+
+const char* RgssArchiveInput::name() const {
+    return "rgss archive";
+}
+
+u32 RgssArchiveInput::AdvanceKey(u32 key, u64 count) {
+    // Each step is key * 7 + 3, composing the step with itself lets us jump straight to any
+    // offset in the entry instead of walking the key forward a word at a time
+    u32 multiplier = 1;
+    u32 increment = 0;
+    u32 step_multiplier = 7;
+    u32 step_increment = 3;
+    while (count != 0) {
+        if ((count & 1) != 0) {
+            multiplier *= step_multiplier;
+            increment = increment * step_multiplier + step_increment;
+        }
+        step_increment = step_increment * step_multiplier + step_increment;
+        step_multiplier *= step_multiplier;
+        count >>= 1;
+    }
+    return key * multiplier + increment;
+}
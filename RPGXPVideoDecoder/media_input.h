@@ -0,0 +1,133 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <formatcontext.h>
+
+#include "common_types.h"
+#include "platform.h"
+
+/// Callbacks for reading media from somewhere the DLL can't get to on its own, such as an entry
+/// in a packed archive. The struct is shared with callers across the DLL boundary, so fields are
+/// only ever appended. Callers set struct_size to the size of the struct they know about.
+struct MediaReader {
+    u32 struct_size{sizeof(MediaReader)};
+    // Handed back to every callback untouched
+    void* user_data{};
+    // Reads up to size bytes into buffer and returns how many were read, 0 at the end of the media
+    // and a negative value on errors
+    s32(USER_CALLBACK* read)(void* user_data, u8* buffer, u32 size){};
+    // Moves to offset bytes from origin (0 for the start, 1 for the current position, 2 for the
+    // end) and returns the new position, or a negative value on errors. Null if the media can't
+    // seek, which rules out seeking and looping
+    s64(USER_CALLBACK* seek)(void* user_data, s64 offset, s32 origin){};
+    // Total size in bytes or a negative value if it isn't known, may be null
+    s64(USER_CALLBACK* get_size)(void* user_data){};
+    // Called once the context is done with the reader, may be null
+    void(USER_CALLBACK* close)(void* user_data){};
+};
+
+/// Media the demuxer reads through callbacks instead of opening a file by path. Implementations
+/// only need to be usable from the demux thread, FFmpeg never calls them from anywhere else.
+class MediaInput : public av::CustomIO {
+public:
+    /// Size of the buffer FFmpeg reads through
+    virtual std::size_t GetBufferSize() const {
+        return DEFAULT_BUFFER_SIZE;
+    }
+
+    static constexpr std::size_t DEFAULT_BUFFER_SIZE = 64 * 1024;
+};
+
+/// Media held in memory, either borrowed from the caller for as long as the context is open or
+/// copied when the caller can't promise that
+class MemoryInput : public MediaInput {
+public:
+    MemoryInput(const u8* data, std::size_t size, bool copy);
+
+    int read(uint8_t* data, size_t size) override;
+    int64_t seek(int64_t offset, int whence) override;
+    int seekable() const override;
+    const char* name() const override;
+
+protected:
+    MemoryInput() = default;
+
+    /// Points the input at memory owned by someone else
+    void SetView(const u8* data, std::size_t size);
+
+    const u8* view{nullptr};
+    std::size_t view_size{};
+    std::size_t position{};
+
+private:
+    std::vector<u8> owned{};
+};
+
+/// A file mapped into memory, reads come straight out of the page cache with no copies in
+/// between. The range just ahead of the demuxer is prefetched in large blocks where the system
+/// supports it, so reads rarely wait on the disk.
+class MappedFileInput : public MemoryInput {
+public:
+    /// Returns nullptr if the file can't be mapped, for example if it doesn't fit in the address
+    /// space of a 32-bit process
+    static std::unique_ptr<MappedFileInput> Open(const char* path);
+
+    int read(uint8_t* data, size_t size) override;
+    const char* name() const override;
+
+private:
+    MappedFileInput() = default;
+    void Prefetch();
+
+    static constexpr std::size_t READAHEAD_BYTES = 16 * 1024 * 1024;
+
+    std::unique_ptr<Platform::MappedFile> mapped{};
+    std::size_t prefetched_end{};
+};
+
+/// Reads through a caller supplied MediaReader
+class ReaderInput : public MediaInput {
+public:
+    /// Returns nullptr if the reader is missing its read callback
+    static std::unique_ptr<ReaderInput> Open(const MediaReader* reader);
+    ~ReaderInput();
+
+    int read(uint8_t* data, size_t size) override;
+    int64_t seek(int64_t offset, int whence) override;
+    int seekable() const override;
+    const char* name() const override;
+
+private:
+    explicit ReaderInput(const MediaReader& reader);
+
+    MediaReader reader{};
+};
+
+/// An entry inside an encrypted RGSS archive (Game.rgssad), decrypted as it's read so the video
+/// never has to be extracted to disk
+class RgssArchiveInput : public MediaInput {
+public:
+    /// entry_name is matched without regard to case or slash direction, for example
+    /// "Movies/intro.mp4". Returns nullptr if the archive can't be read or has no such entry
+    static std::unique_ptr<RgssArchiveInput> Open(const char* archive_path,
+                                                  const char* entry_name);
+    int read(uint8_t* data, size_t size) override;
+    int64_t seek(int64_t offset, int whence) override;
+    int seekable() const override;
+    const char* name() const override;
+
+private:
+    RgssArchiveInput() = default;
+
+    /// Key the archive uses after it has been stepped count times from key
+    static u32 AdvanceKey(u32 key, u64 count);
+
+    std::unique_ptr<Platform::File> file{};
+    u64 data_offset{};
+    u64 data_size{};
+    u32 data_key{};
+    u64 position{};
+};
@@ -0,0 +1,90 @@
+#include "packet_queue.h"
+
+PacketQueue::PacketQueue(std::size_t max_packets, std::size_t max_bytes)
+    : max_packets(max_packets), max_bytes(max_bytes) {}
+
+void PacketQueue::SetLimits(std::size_t packets, std::size_t bytes) {
+    std::scoped_lock lock{mutex};
+    max_packets = packets;
+    max_bytes = bytes;
+    not_full.notify_all();
+}
+
+bool PacketQueue::Push(av::Packet packet, const PlaybackSegment& segment) {
+    QueuedPacket entry{};
+    entry.packet = std::move(packet);
+    entry.segment = segment;
+    return PushEntry(std::move(entry));
+}
+
+bool PacketQueue::PushEnd(const PlaybackSegment& segment) {
+    QueuedPacket entry{};
+    entry.segment = segment;
+    entry.end_of_stream = true;
+    return PushEntry(std::move(entry));
+}
+
+bool PacketQueue::PushEntry(QueuedPacket entry) {
+    std::unique_lock lock{mutex};
+    not_full.wait(lock, [this] { return aborted || !IsFull(); });
+    if (aborted) {
+        return false;
+    }
+
+    // The demuxer may have been part way through a push when a seek flushed us
+    if (entry.segment.serial != serial) {
+        return true;
+    }
+
+    bytes += entry.packet.size();
+    packets.push_back(std::move(entry));
+    not_empty.notify_one();
+    return true;
+}
+
+bool PacketQueue::Pop(QueuedPacket& entry) {
+    std::unique_lock lock{mutex};
+    not_empty.wait(lock, [this] { return aborted || !packets.empty(); });
+    if (aborted) {
+        return false;
+    }
+
+    entry = std::move(packets.front());
+    packets.pop_front();
+    bytes -= entry.packet.size();
+    not_full.notify_one();
+    return true;
+}
+
+void PacketQueue::Flush(u32 new_serial) {
+    std::scoped_lock lock{mutex};
+    packets.clear();
+    bytes = 0;
+    serial = new_serial;
+    not_full.notify_all();
+}
+
+void PacketQueue::Abort() {
+    std::scoped_lock lock{mutex};
+    aborted = true;
+    not_empty.notify_all();
+    not_full.notify_all();
+}
+
+std::size_t PacketQueue::GetSize() const {
+    std::scoped_lock lock{mutex};
+    return packets.size();
+}
+
+std::size_t PacketQueue::GetBytes() const {
+    std::scoped_lock lock{mutex};
+    return bytes;
+}
+
+bool PacketQueue::IsFull() const {
+    // A single packet bigger than the byte limit still has to get through on its own
+    if (packets.empty()) {
+        return false;
+    }
+    return packets.size() >= max_packets || bytes >= max_bytes;
+}
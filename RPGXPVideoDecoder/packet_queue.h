@@ -0,0 +1,79 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <limits>
+#include <mutex>
+
+#include <packet.h>
+
+#include "common_types.h"
+
+/// A stretch of the stream that plays back contiguously. Seeking starts a new serial, which
+/// throws away everything queued for the old one, while looping starts a new segment within the
+/// same serial so whatever is still queued gets to play out first. Timestamps in a segment are
+/// shifted by offset to get their place on the playback timeline, anything outside of
+/// [start, end) is decoded but never played
+struct PlaybackSegment {
+    u32 serial{};
+    u32 id{};
+    double offset{};
+    double start{};
+    double end{std::numeric_limits<double>::infinity()};
+};
+
+/// A demuxed packet along with the segment it was read for. End of stream is queued as an entry
+/// of its own so the decoders can tell it apart from a seek emptying the queue
+struct QueuedPacket {
+    av::Packet packet{};
+    PlaybackSegment segment{};
+    bool end_of_stream{false};
+};
+
+/// Bounded queue of demuxed packets for a single stream. The demuxer blocks once the queue holds
+/// max_packets or max_bytes, so a stream that's being consumed slowly pushes back on the demuxer
+/// instead of growing without limit.
+class PacketQueue {
+public:
+    PacketQueue(std::size_t max_packets, std::size_t max_bytes);
+
+    /// Changes the limits, only meant to be called before anything is pushed
+    void SetLimits(std::size_t packets, std::size_t bytes);
+
+    PacketQueue(const PacketQueue&) = delete;
+    PacketQueue& operator=(const PacketQueue&) = delete;
+
+    /// Blocks while the queue is full, returns false if the queue was aborted. Packets for a
+    /// serial the queue has been flushed past are dropped
+    bool Push(av::Packet packet, const PlaybackSegment& segment);
+
+    /// Marks the end of the stream, consumers still get everything queued before it
+    bool PushEnd(const PlaybackSegment& segment);
+
+    /// Blocks while the queue is empty, returns false once the queue was aborted
+    bool Pop(QueuedPacket& entry);
+
+    /// Drops everything queued and only accepts packets for serial from now on
+    void Flush(u32 serial);
+
+    /// Wakes everyone up and makes every following call fail straight away
+    void Abort();
+
+    std::size_t GetSize() const;
+    std::size_t GetBytes() const;
+
+private:
+    bool PushEntry(QueuedPacket entry);
+    bool IsFull() const;
+
+    std::size_t max_packets;
+    std::size_t max_bytes;
+
+    mutable std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<QueuedPacket> packets;
+    std::size_t bytes{};
+    u32 serial{};
+    bool aborted{false};
+};
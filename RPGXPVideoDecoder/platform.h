@@ -0,0 +1,207 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#ifndef _WIN32
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+#include "common_types.h"
+
+/// Everything the decoder core needs from the operating system. Windows builds go straight to
+/// Win32 (platform_win32.cpp), everything else goes through POSIX (platform_posix.cpp) so the core
+/// can be built, profiled and benchmarked headless on Linux. Nothing outside of those two files
+/// and the DLL entry points should need to include Windows.h.
+namespace Platform {
+
+/// Seconds on a monotonic high resolution clock, unaffected by the system timer resolution
+double GetMonotonicSeconds();
+
+/// Resident memory of the whole process in bytes, 0 if it can't be read
+std::size_t GetWorkingSetBytes();
+
+/// Auto reset event. A Set with nobody waiting stays signalled until the next wait, so a wake up
+/// sent just before the other side starts waiting isn't lost.
+class Event {
+public:
+    Event();
+    ~Event();
+
+    Event(const Event&) = delete;
+    Event& operator=(const Event&) = delete;
+
+    void Set();
+
+    /// Waits with no timeout
+    void Wait();
+
+    /// Waits for up to seconds, returns false if the event wasn't set in time
+    bool Wait(double seconds);
+
+#ifdef _WIN32
+    void* GetHandle() const {
+        return handle;
+    }
+
+private:
+    void* handle{};
+#else
+private:
+    std::mutex mutex;
+    std::condition_variable signal;
+    bool signalled{false};
+#endif
+};
+
+/// A joinable thread running entry(param). Threads are joined rather than detached, so the
+/// object has to outlive whatever the thread touches.
+class Thread {
+public:
+    using Entry = void (*)(void* param);
+
+    Thread() = default;
+    ~Thread();
+
+    Thread(const Thread&) = delete;
+    Thread& operator=(const Thread&) = delete;
+
+    /// Returns false if the thread couldn't be created or one is already running
+    bool Start(Entry entry, void* param);
+    bool IsStarted() const;
+
+    /// Whether a started thread has returned, without waiting for it
+    bool HasFinished() const;
+
+    /// Waits for the thread to return, afterwards it can be started again
+    void Join();
+
+private:
+#ifdef _WIN32
+    void* handle{};
+#else
+    std::thread thread{};
+    std::atomic<bool> finished{false};
+#endif
+};
+
+/// Sleeps with sub-millisecond precision. On Windows it uses a high resolution waitable timer
+/// where the system has them, otherwise it raises the timer resolution to 1ms for as long as the
+/// timer exists. Waits can be cut short by an event so the waiting thread stays responsive
+/// without polling.
+class PreciseTimer {
+public:
+    PreciseTimer();
+    ~PreciseTimer();
+
+    PreciseTimer(const PreciseTimer&) = delete;
+    PreciseTimer& operator=(const PreciseTimer&) = delete;
+
+    /// Waits for seconds to pass or for wake to be set, whichever comes first. Messages sent to
+    /// the calling thread are dispatched while waiting. Returns false if the event cut the wait
+    /// short
+    bool Wait(double seconds, Event* wake = nullptr);
+
+    /// Waits with no timeout until wake is set, dispatching messages in the meantime
+    void WaitForWake(Event& wake);
+
+#ifdef _WIN32
+private:
+    u32 WaitForHandles(void* const* handles, u32 count);
+
+    void* timer{};
+    bool raised_resolution{false};
+#endif
+};
+
+/// Follows whether the window that had focus when the tracker was created still has it. Has to
+/// be created, checked and destroyed on one thread, which has to wait through PreciseTimer for
+/// change notifications to get through. Headless platforms always have focus.
+class FocusTracker {
+public:
+    /// wake is set whenever focus changes, if NotifiesChanges
+    explicit FocusTracker(Event& wake);
+    ~FocusTracker();
+
+    FocusTracker(const FocusTracker&) = delete;
+    FocusTracker& operator=(const FocusTracker&) = delete;
+
+    bool HasFocus() const;
+
+    /// False if focus changes can't be reported, in which case HasFocus has to be polled
+    bool NotifiesChanges() const;
+
+#ifdef _WIN32
+private:
+    void* window{};
+    void* hook{};
+#endif
+};
+
+/// A file opened for plain reads or writes at an explicit position
+class File {
+public:
+    ~File();
+
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+
+    /// Returns nullptr if the file can't be opened. Writing creates the file, replacing anything
+    /// that was there before
+    static std::unique_ptr<File> OpenRead(const char* path);
+    static std::unique_ptr<File> OpenWrite(const char* path);
+
+    /// Reads up to size bytes, returns how many were read or -1 on errors
+    s64 Read(void* buffer, std::size_t size);
+    /// Returns false unless every byte was written
+    bool Write(const void* data, std::size_t size);
+    bool SetPosition(u64 position);
+    bool GetPosition(u64& position) const;
+    bool GetSize(u64& size) const;
+
+private:
+    File() = default;
+
+#ifdef _WIN32
+    void* handle{};
+#else
+    int descriptor{-1};
+#endif
+};
+
+/// A whole file mapped read only into memory
+class MappedFile {
+public:
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /// Returns nullptr if the file can't be mapped, for example if it's empty or doesn't fit in
+    /// the address space of a 32-bit process. sequential hints that it'll be read front to back
+    static std::unique_ptr<MappedFile> Open(const char* path, bool sequential);
+
+    const u8* GetData() const {
+        return data;
+    }
+
+    std::size_t GetSize() const {
+        return size;
+    }
+
+    /// Asks the system to start reading [offset, offset + length) in ahead of time, where it can
+    void Prefetch(std::size_t offset, std::size_t length) const;
+
+private:
+    MappedFile() = default;
+
+    const u8* data{nullptr};
+    std::size_t size{};
+#ifdef _WIN32
+    void* file{};
+    void* mapping{};
+#endif
+};
+
+} // namespace Platform
@@ -0,0 +1,246 @@
+#ifndef _WIN32
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "platform.h"
+
+namespace Platform {
+
+double GetMonotonicSeconds() {
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<double>(now.tv_sec) + static_cast<double>(now.tv_nsec) / 1000000000.0;
+}
+
+std::size_t GetWorkingSetBytes() {
+    // The second field is the resident set in pages
+    std::FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (statm == nullptr) {
+        return 0;
+    }
+    unsigned long long total_pages{};
+    unsigned long long resident_pages{};
+    const bool parsed = std::fscanf(statm, "%llu %llu", &total_pages, &resident_pages) == 2;
+    std::fclose(statm);
+    if (!parsed) {
+        return 0;
+    }
+    const long page_size = sysconf(_SC_PAGESIZE);
+    return static_cast<std::size_t>(resident_pages) *
+           static_cast<std::size_t>(page_size > 0 ? page_size : 4096);
+}
+
+Event::Event() = default;
+Event::~Event() = default;
+
+void Event::Set() {
+    std::scoped_lock lock{mutex};
+    signalled = true;
+    signal.notify_one();
+}
+
+void Event::Wait() {
+    std::unique_lock lock{mutex};
+    signal.wait(lock, [this] { return signalled; });
+    signalled = false;
+}
+
+bool Event::Wait(double seconds) {
+    std::unique_lock lock{mutex};
+    const auto timeout = std::chrono::duration<double>(std::max<double>(seconds, 0.0));
+    if (!signal.wait_for(lock, timeout, [this] { return signalled; })) {
+        return false;
+    }
+    signalled = false;
+    return true;
+}
+
+Thread::~Thread() {
+    Join();
+}
+
+bool Thread::Start(Entry entry, void* param) {
+    if (thread.joinable()) {
+        return false;
+    }
+    finished.store(false);
+    try {
+        thread = std::thread([this, entry, param] {
+            entry(param);
+            finished.store(true);
+        });
+    } catch (const std::system_error&) {
+        return false;
+    }
+    return true;
+}
+
+bool Thread::IsStarted() const {
+    return thread.joinable();
+}
+
+bool Thread::HasFinished() const {
+    return thread.joinable() && finished.load();
+}
+
+void Thread::Join() {
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+PreciseTimer::PreciseTimer() = default;
+PreciseTimer::~PreciseTimer() = default;
+
+bool PreciseTimer::Wait(double seconds, Event* wake) {
+    if (seconds <= 0.0) {
+        return true;
+    }
+    // Sleeps and condition variable timeouts are already backed by high resolution timers
+    if (wake == nullptr) {
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        return true;
+    }
+    return !wake->Wait(seconds);
+}
+
+void PreciseTimer::WaitForWake(Event& wake) {
+    wake.Wait();
+}
+
+FocusTracker::FocusTracker(Event&) {}
+FocusTracker::~FocusTracker() = default;
+
+bool FocusTracker::HasFocus() const {
+    return true;
+}
+
+bool FocusTracker::NotifiesChanges() const {
+    // Focus never changes, so there's nothing to poll for either
+    return true;
+}
+
+File::~File() {
+    if (descriptor >= 0) {
+        close(descriptor);
+        descriptor = -1;
+    }
+}
+
+std::unique_ptr<File> File::OpenRead(const char* path) {
+    const int descriptor = open(path, O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+        return nullptr;
+    }
+    std::unique_ptr<File> file(new File());
+    file->descriptor = descriptor;
+    return file;
+}
+
+std::unique_ptr<File> File::OpenWrite(const char* path) {
+    const int descriptor = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (descriptor < 0) {
+        return nullptr;
+    }
+    std::unique_ptr<File> file(new File());
+    file->descriptor = descriptor;
+    return file;
+}
+
+s64 File::Read(void* buffer, std::size_t size) {
+    const auto count = std::min<std::size_t>(size, 0x40000000);
+    const ssize_t result = read(descriptor, buffer, count);
+    return result < 0 ? -1 : static_cast<s64>(result);
+}
+
+bool File::Write(const void* data, std::size_t size) {
+    const auto* bytes = static_cast<const u8*>(data);
+    while (size != 0) {
+        const ssize_t written = write(descriptor, bytes, std::min<std::size_t>(size, 0x40000000));
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+bool File::SetPosition(u64 position) {
+    return lseek(descriptor, static_cast<off_t>(position), SEEK_SET) >= 0;
+}
+
+bool File::GetPosition(u64& position) const {
+    const off_t here = lseek(descriptor, 0, SEEK_CUR);
+    if (here < 0) {
+        return false;
+    }
+    position = static_cast<u64>(here);
+    return true;
+}
+
+bool File::GetSize(u64& size) const {
+    struct stat info {};
+    if (fstat(descriptor, &info) != 0) {
+        return false;
+    }
+    size = static_cast<u64>(info.st_size);
+    return true;
+}
+
+MappedFile::~MappedFile() {
+    if (data != nullptr) {
+        munmap(const_cast<u8*>(data), size);
+        data = nullptr;
+    }
+}
+
+std::unique_ptr<MappedFile> MappedFile::Open(const char* path, bool sequential) {
+    const int descriptor = open(path, O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+        return nullptr;
+    }
+
+    // The mapping keeps the file alive by itself
+    struct stat info {};
+    void* view = MAP_FAILED;
+    if (fstat(descriptor, &info) == 0 && info.st_size > 0 &&
+        static_cast<u64>(info.st_size) <= std::numeric_limits<std::size_t>::max()) {
+        view = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE,
+                    descriptor, 0);
+    }
+    close(descriptor);
+    if (view == MAP_FAILED) {
+        return nullptr;
+    }
+
+    std::unique_ptr<MappedFile> mapped(new MappedFile());
+    mapped->data = static_cast<const u8*>(view);
+    mapped->size = static_cast<std::size_t>(info.st_size);
+    if (sequential) {
+        madvise(view, mapped->size, MADV_SEQUENTIAL);
+    }
+    return mapped;
+}
+
+void MappedFile::Prefetch(std::size_t offset, std::size_t length) const {
+    if (offset >= size || length == 0) {
+        return;
+    }
+    // madvise wants a page aligned start
+    const auto page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    const auto start = offset / page_size * page_size;
+    const auto end = std::min<std::size_t>(size, offset + length);
+    madvise(const_cast<u8*>(data + start), end - start, MADV_WILLNEED);
+}
+
+} // namespace Platform
+#endif
@@ -0,0 +1,353 @@
+#ifdef _WIN32
+#include <algorithm>
+#include <limits>
+#include <Windows.h>
+#include <Psapi.h>
+
+#include "platform.h"
+
+namespace {
+
+// Window event hooks can't carry any user data, the callback runs on the thread which installed
+// the hook so each tracker keeps its own event here
+thread_local Platform::Event* foreground_wake_event = nullptr;
+
+void CALLBACK ForegroundChanged(HWINEVENTHOOK, DWORD, HWND, LONG, LONG, DWORD, DWORD) {
+    if (foreground_wake_event != nullptr) {
+        foreground_wake_event->Set();
+    }
+}
+
+struct ThreadStart {
+    Platform::Thread::Entry entry{};
+    void* param{};
+};
+
+DWORD WINAPI ThreadBootstrap(LPVOID lpParam) {
+    const ThreadStart start = *static_cast<ThreadStart*>(lpParam);
+    delete static_cast<ThreadStart*>(lpParam);
+    start.entry(start.param);
+    return 0;
+}
+
+using PrefetchVirtualMemoryFn = BOOL(WINAPI*)(HANDLE, SIZE_T, WIN32_MEMORY_RANGE_ENTRY*, ULONG);
+
+// Only exists on Windows 8 and newer, older systems just fault the pages in as they're read
+PrefetchVirtualMemoryFn GetPrefetchVirtualMemory() {
+    static const auto prefetch = [] {
+        const HMODULE kernel = GetModuleHandleW(L"kernel32.dll");
+        if (kernel == NULL) {
+            return PrefetchVirtualMemoryFn{};
+        }
+        return reinterpret_cast<PrefetchVirtualMemoryFn>(
+            GetProcAddress(kernel, "PrefetchVirtualMemory"));
+    }();
+    return prefetch;
+}
+
+} // Anonymous namespace
+
+namespace Platform {
+
+double GetMonotonicSeconds() {
+    static const LONGLONG frequency = [] {
+        LARGE_INTEGER value{};
+        QueryPerformanceFrequency(&value);
+        return value.QuadPart;
+    }();
+
+    LARGE_INTEGER counter{};
+    QueryPerformanceCounter(&counter);
+    return static_cast<double>(counter.QuadPart) / static_cast<double>(frequency);
+}
+
+std::size_t GetWorkingSetBytes() {
+    PROCESS_MEMORY_COUNTERS counters{};
+    counters.cb = sizeof(counters);
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return static_cast<std::size_t>(counters.WorkingSetSize);
+}
+
+Event::Event() {
+    handle = CreateEventW(NULL, FALSE, FALSE, NULL);
+}
+
+Event::~Event() {
+    if (handle != NULL) {
+        CloseHandle(handle);
+        handle = NULL;
+    }
+}
+
+void Event::Set() {
+    SetEvent(handle);
+}
+
+void Event::Wait() {
+    WaitForSingleObject(handle, INFINITE);
+}
+
+bool Event::Wait(double seconds) {
+    const auto milliseconds = static_cast<DWORD>(std::max<double>(seconds, 0.0) * 1000.0);
+    return WaitForSingleObject(handle, milliseconds) == WAIT_OBJECT_0;
+}
+
+Thread::~Thread() {
+    Join();
+}
+
+bool Thread::Start(Entry entry, void* param) {
+    if (handle != NULL) {
+        return false;
+    }
+    auto* start = new ThreadStart{entry, param};
+    handle = CreateThread(NULL, NULL, ThreadBootstrap, start, NULL, NULL);
+    if (handle == NULL) {
+        delete start;
+        return false;
+    }
+    return true;
+}
+
+bool Thread::IsStarted() const {
+    return handle != NULL;
+}
+
+bool Thread::HasFinished() const {
+    return handle != NULL && WaitForSingleObject(handle, 0) != WAIT_TIMEOUT;
+}
+
+void Thread::Join() {
+    if (handle != NULL) {
+        WaitForSingleObject(handle, INFINITE);
+        CloseHandle(handle);
+        handle = NULL;
+    }
+}
+
+PreciseTimer::PreciseTimer() {
+    timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+                                   TIMER_ALL_ACCESS);
+    if (timer == NULL) {
+        // High resolution timers need Windows 10 1803, older systems get a regular timer with the
+        // system timer resolution raised instead
+        timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+        raised_resolution = timeBeginPeriod(1) == 0;
+    }
+}
+
+PreciseTimer::~PreciseTimer() {
+    if (timer != NULL) {
+        CloseHandle(timer);
+        timer = NULL;
+    }
+    if (raised_resolution) {
+        timeEndPeriod(1);
+    }
+}
+
+bool PreciseTimer::Wait(double seconds, Event* wake) {
+    if (seconds <= 0.0) {
+        return true;
+    }
+
+    // Relative due times are negative and in 100ns units
+    LARGE_INTEGER due{};
+    due.QuadPart = -static_cast<LONGLONG>(seconds * 10000000.0);
+    if (timer == NULL || due.QuadPart == 0 ||
+        !SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE)) {
+        if (wake == nullptr) {
+            Sleep(static_cast<DWORD>(seconds * 1000.0));
+            return true;
+        }
+        return !wake->Wait(seconds);
+    }
+
+    void* const handles[] = {timer, wake != nullptr ? wake->GetHandle() : NULL};
+    const u32 result = WaitForHandles(handles, wake != nullptr ? 2 : 1);
+    if (result == WAIT_OBJECT_0 + 1) {
+        CancelWaitableTimer(timer);
+        return false;
+    }
+    return true;
+}
+
+void PreciseTimer::WaitForWake(Event& wake) {
+    void* const handle = wake.GetHandle();
+    WaitForHandles(&handle, 1);
+}
+
+u32 PreciseTimer::WaitForHandles(void* const* handles, u32 count) {
+    while (true) {
+        const DWORD result =
+            MsgWaitForMultipleObjects(count, handles, FALSE, INFINITE, QS_ALLINPUT);
+        if (result != WAIT_OBJECT_0 + count) {
+            return result;
+        }
+
+        // Window event hooks are delivered as messages to the thread that installed them
+        MSG msg{};
+        while (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE)) {
+            TranslateMessage(&msg);
+            DispatchMessageW(&msg);
+        }
+    }
+}
+
+FocusTracker::FocusTracker(Event& wake) {
+    window = GetForegroundWindow();
+    foreground_wake_event = &wake;
+    hook = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, NULL,
+                           ForegroundChanged, 0, 0, WINEVENT_OUTOFCONTEXT);
+}
+
+FocusTracker::~FocusTracker() {
+    if (hook != NULL) {
+        UnhookWinEvent(static_cast<HWINEVENTHOOK>(hook));
+    }
+    foreground_wake_event = nullptr;
+}
+
+bool FocusTracker::HasFocus() const {
+    return GetForegroundWindow() == window;
+}
+
+bool FocusTracker::NotifiesChanges() const {
+    return hook != NULL;
+}
+
+File::~File() {
+    if (handle != INVALID_HANDLE_VALUE && handle != NULL) {
+        CloseHandle(handle);
+        handle = NULL;
+    }
+}
+
+std::unique_ptr<File> File::OpenRead(const char* path) {
+    const HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                      FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    std::unique_ptr<File> file(new File());
+    file->handle = handle;
+    return file;
+}
+
+std::unique_ptr<File> File::OpenWrite(const char* path) {
+    const HANDLE handle =
+        CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    std::unique_ptr<File> file(new File());
+    file->handle = handle;
+    return file;
+}
+
+s64 File::Read(void* buffer, std::size_t size) {
+    const auto count = static_cast<DWORD>(std::min<std::size_t>(size, 0x40000000));
+    DWORD read{};
+    if (!ReadFile(handle, buffer, count, &read, NULL)) {
+        return -1;
+    }
+    return read;
+}
+
+bool File::Write(const void* data, std::size_t size) {
+    const auto* bytes = static_cast<const u8*>(data);
+    while (size != 0) {
+        const auto chunk = static_cast<DWORD>(std::min<std::size_t>(size, 0x40000000));
+        DWORD written{};
+        if (!WriteFile(handle, bytes, chunk, &written, NULL) || written != chunk) {
+            return false;
+        }
+        bytes += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+bool File::SetPosition(u64 position) {
+    LARGE_INTEGER distance{};
+    distance.QuadPart = static_cast<LONGLONG>(position);
+    return SetFilePointerEx(handle, distance, NULL, FILE_BEGIN) != FALSE;
+}
+
+bool File::GetPosition(u64& position) const {
+    LARGE_INTEGER distance{};
+    LARGE_INTEGER here{};
+    if (!SetFilePointerEx(handle, distance, &here, FILE_CURRENT)) {
+        return false;
+    }
+    position = static_cast<u64>(here.QuadPart);
+    return true;
+}
+
+bool File::GetSize(u64& size) const {
+    LARGE_INTEGER file_size{};
+    if (!GetFileSizeEx(handle, &file_size)) {
+        return false;
+    }
+    size = static_cast<u64>(file_size.QuadPart);
+    return true;
+}
+
+MappedFile::~MappedFile() {
+    if (data != nullptr) {
+        UnmapViewOfFile(data);
+        data = nullptr;
+    }
+    if (mapping != NULL) {
+        CloseHandle(mapping);
+        mapping = NULL;
+    }
+    if (file != NULL) {
+        CloseHandle(file);
+        file = NULL;
+    }
+}
+
+std::unique_ptr<MappedFile> MappedFile::Open(const char* path, bool sequential) {
+    const DWORD flags = FILE_ATTRIBUTE_NORMAL | (sequential ? FILE_FLAG_SEQUENTIAL_SCAN : 0);
+    const HANDLE handle =
+        CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    std::unique_ptr<MappedFile> mapped(new MappedFile());
+    mapped->file = handle;
+
+    LARGE_INTEGER file_size{};
+    if (!GetFileSizeEx(handle, &file_size) || file_size.QuadPart <= 0 ||
+        static_cast<u64>(file_size.QuadPart) > std::numeric_limits<std::size_t>::max()) {
+        return nullptr;
+    }
+
+    mapped->mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapped->mapping == NULL) {
+        return nullptr;
+    }
+    mapped->data = static_cast<const u8*>(MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0));
+    if (mapped->data == nullptr) {
+        return nullptr;
+    }
+    mapped->size = static_cast<std::size_t>(file_size.QuadPart);
+    return mapped;
+}
+
+void MappedFile::Prefetch(std::size_t offset, std::size_t length) const {
+    const auto prefetch = GetPrefetchVirtualMemory();
+    if (prefetch == nullptr || offset >= size || length == 0) {
+        return;
+    }
+    WIN32_MEMORY_RANGE_ENTRY range{};
+    range.VirtualAddress = const_cast<u8*>(data + offset);
+    range.NumberOfBytes = std::min<std::size_t>(length, size - offset);
+    prefetch(GetCurrentProcess(), 1, &range, 0);
+}
+
+} // namespace Platform
+#endif
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <cmath>
+
+#include "playback_stats.h"
+
+void LatencyHistogram::Record(double seconds) {
+    const auto microseconds = static_cast<u64>(std::max<double>(seconds, 0.0) * 1000000.0);
+
+    // Only ever one writer, so plain stores are enough to publish the new values
+    auto& bucket = buckets[GetBucket(microseconds)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    total_us.store(total_us.load(std::memory_order_relaxed) + microseconds,
+                   std::memory_order_relaxed);
+    if (microseconds > max_us.load(std::memory_order_relaxed)) {
+        max_us.store(microseconds, std::memory_order_relaxed);
+    }
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Reset() {
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    total_us.store(0, std::memory_order_relaxed);
+    max_us.store(0, std::memory_order_relaxed);
+    count.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Summarize(StageTimings& timings) const {
+    const u64 samples = count.load(std::memory_order_relaxed);
+    if (samples == 0) {
+        timings = StageTimings{};
+        return;
+    }
+
+    const auto to_u32 = [](u64 value) {
+        return static_cast<u32>(std::min<u64>(value, 0xFFFFFFFF));
+    };
+    timings.samples = to_u32(samples);
+    timings.mean_us = to_u32(total_us.load(std::memory_order_relaxed) / samples);
+    timings.p95_us = to_u32(GetPercentile(samples, 0.95));
+    timings.p99_us = to_u32(GetPercentile(samples, 0.99));
+    timings.max_us = to_u32(max_us.load(std::memory_order_relaxed));
+}
+
+std::size_t LatencyHistogram::GetBucket(u64 microseconds) {
+    if (microseconds < SUB_BUCKETS) {
+        return static_cast<std::size_t>(microseconds);
+    }
+
+    std::size_t magnitude = SUB_BUCKET_BITS;
+    while (magnitude <= MAX_MAGNITUDE && (microseconds >> (magnitude + 1)) != 0) {
+        magnitude++;
+    }
+    if (magnitude > MAX_MAGNITUDE) {
+        return BUCKET_COUNT - 1;
+    }
+    const auto step = static_cast<std::size_t>(microseconds >> (magnitude - SUB_BUCKET_BITS));
+    return (magnitude - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + (step & (SUB_BUCKETS - 1));
+}
+
+u64 LatencyHistogram::GetBucketLimit(std::size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+
+    // Largest value that still lands in the bucket
+    const std::size_t magnitude = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    const u64 step = u64{1} << (magnitude - SUB_BUCKET_BITS);
+    return (SUB_BUCKETS + bucket % SUB_BUCKETS + 1) * step - 1;
+}
+
+u64 LatencyHistogram::GetPercentile(u64 samples, double percentile) const {
+    const auto rank = static_cast<u64>(std::ceil(static_cast<double>(samples) * percentile));
+    const u64 max = max_us.load(std::memory_order_relaxed);
+    u64 seen = 0;
+    for (std::size_t i = 0; i < BUCKET_COUNT; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // The top bucket is open ended, and nothing can be above the largest sample anyway
+            return i == BUCKET_COUNT - 1 ? max : std::min<u64>(GetBucketLimit(i), max);
+        }
+    }
+    return max;
+}
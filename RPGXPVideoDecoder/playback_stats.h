@@ -0,0 +1,90 @@
+#pragma once
+#include <array>
+#include <atomic>
+
+#include "common_types.h"
+
+/// Summary of one pipeline stage as exposed through ViDecGetStats, all times in microseconds.
+/// Percentiles come from a log-linear histogram and are rounded up to the bucket they fall in,
+/// which keeps them within 12.5% of the real value.
+struct StageTimings {
+    u32 samples{};
+    u32 mean_us{};
+    u32 p95_us{};
+    u32 p99_us{};
+    u32 max_us{};
+};
+
+/// Everything ViDecGetStats reports about a context. Shared across the DLL boundary the same way
+/// as SyncStats, fields are only ever appended and struct_size is filled in with the size the
+/// DLL knows about.
+struct PlaybackStats {
+    u32 struct_size{sizeof(PlaybackStats)};
+    u32 frames_decoded{};
+    u32 frames_presented{};
+    u32 frames_dropped{};
+    u32 frames_skipped{};
+    u32 frames_discarded{};
+
+    // Reading one packet, decoding one frame (including packets that gave no frame), converting
+    // a decoded frame into the bitmap and copying a baked frame into it. Decoded frames are
+    // scaled straight into the bitmap, so for them the blit is part of the rescale
+    StageTimings demux{};
+    StageTimings decode{};
+    StageTimings rescale{};
+    StageTimings blit{};
+
+    // What's waiting right now, decoded frames and compressed packets for video and
+    // compressed packets and PCM for audio
+    u32 video_queued_frames{};
+    u32 video_queued_ms{};
+    u32 video_queued_packets{};
+    u32 audio_queued_packets{};
+    u32 audio_queued_ms{};
+    // Device callbacks that ran dry while more audio was still to come
+    u32 audio_underruns{};
+
+    // Difference between the last presented frames timestamp and the clock, and the average over
+    // every presented frame. Positive means late
+    s32 current_drift_us{};
+    s32 average_drift_us{};
+
+    // Memory held in frames, packets and the audio ring right now and at most
+    u32 buffered_bytes{};
+    u32 peak_buffered_bytes{};
+
+    // Video packets the codec failed to decode, they're skipped and aren't counted as discarded
+    u32 decode_errors{};
+};
+
+/// Latency histogram cheap enough to leave running in release builds. Recording is a handful of
+/// relaxed loads and stores with no locks or read-modify-write instructions, which is why each
+/// histogram may only have a single thread recording into it. Any thread may read it, a read
+/// racing a record can be off by that one sample.
+class LatencyHistogram {
+public:
+    void Record(double seconds);
+
+    /// Clears every sample, only safe while nothing is recording
+    void Reset();
+
+    void Summarize(StageTimings& timings) const;
+
+private:
+    static std::size_t GetBucket(u64 microseconds);
+    static u64 GetBucketLimit(std::size_t bucket);
+    u64 GetPercentile(u64 samples, double percentile) const;
+
+    // Values below SUB_BUCKETS get a bucket each, every power of two above that is split into
+    // SUB_BUCKETS even steps. The last bucket catches anything past about a minute
+    static constexpr std::size_t SUB_BUCKET_BITS = 3;
+    static constexpr std::size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr std::size_t MAX_MAGNITUDE = 26;
+    static constexpr std::size_t BUCKET_COUNT =
+        (MAX_MAGNITUDE - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+    std::atomic<u64> count{0};
+    std::atomic<u64> total_us{0};
+    std::atomic<u64> max_us{0};
+    std::array<std::atomic<u32>, BUCKET_COUNT> buckets{};
+};
@@ -0,0 +1,83 @@
+#include "quality_ladder.h"
+
+void QualityLadder::SetBudget(double frame_seconds) {
+    if (frame_seconds > 0.0) {
+        budget = frame_seconds;
+    }
+}
+
+void QualityLadder::SetAllowedRungs(u32 mask) {
+    allowed = mask & ALL_QUALITY_RUNGS;
+
+    // Drop back to the closest allowed rung if ours was just taken away
+    while (rung != 0 && (allowed & (1u << rung)) == 0) {
+        rung--;
+    }
+}
+
+u32 QualityLadder::GetAllowedRungs() const {
+    return allowed;
+}
+
+QualityRung QualityLadder::GetRung() const {
+    return static_cast<QualityRung>(rung);
+}
+
+bool QualityLadder::IsActive(QualityRung rung_to_check) const {
+    const auto index = static_cast<u32>(rung_to_check);
+    return index != 0 && index <= rung && (allowed & (1u << index)) != 0;
+}
+
+bool QualityLadder::Update(double frame_seconds) {
+    window_total += frame_seconds;
+    window_frames++;
+    if (window_frames < WINDOW_FRAMES) {
+        return false;
+    }
+
+    const double average = window_total / static_cast<double>(window_frames);
+    ResetWindow();
+
+    if (average > budget * STEP_DOWN_RATIO) {
+        headroom_windows = 0;
+        return StepDown();
+    }
+    if (average >= budget * STEP_UP_RATIO) {
+        headroom_windows = 0;
+        return false;
+    }
+
+    if (++headroom_windows < STEP_UP_WINDOWS) {
+        return false;
+    }
+    headroom_windows = 0;
+    return StepUp();
+}
+
+bool QualityLadder::StepDown() {
+    for (u32 next = rung + 1; next < QUALITY_RUNG_COUNT; next++) {
+        if ((allowed & (1u << next)) != 0) {
+            rung = next;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool QualityLadder::StepUp() {
+    if (rung == 0) {
+        return false;
+    }
+
+    u32 next = rung - 1;
+    while (next != 0 && (allowed & (1u << next)) == 0) {
+        next--;
+    }
+    rung = next;
+    return true;
+}
+
+void QualityLadder::ResetWindow() {
+    window_total = 0.0;
+    window_frames = 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "common_types.h"
+
+/// Steps of the quality ladder, each rung also keeps every allowed rung below it active
+enum class QualityRung : u32 {
+    Full = 0,
+    SkipLoopFilter = 1,
+    FastScaling = 2,
+    LowResolution = 3,
+};
+
+constexpr u32 QUALITY_RUNG_COUNT = 4;
+
+constexpr u32 QualityRungBit(QualityRung rung) {
+    return 1u << static_cast<u32>(rung);
+}
+
+constexpr u32 ALL_QUALITY_RUNGS = QualityRungBit(QualityRung::SkipLoopFilter) |
+                                  QualityRungBit(QualityRung::FastScaling) |
+                                  QualityRungBit(QualityRung::LowResolution);
+
+/// Watches how long each frame takes against the time budget of a single frame and steps down
+/// the ladder when we're over budget, then back up once there's headroom again. Only used from
+/// the decoder thread.
+class QualityLadder {
+public:
+    void SetBudget(double frame_seconds);
+
+    /// Rungs missing from the mask are stepped over, Full is always allowed
+    void SetAllowedRungs(u32 mask);
+    u32 GetAllowedRungs() const;
+
+    QualityRung GetRung() const;
+
+    /// Whether the rung is both allowed and at or below the current one
+    bool IsActive(QualityRung rung) const;
+
+    /// Feeds the time a frame took to produce, returns true if the rung changed
+    bool Update(double frame_seconds);
+
+private:
+    bool StepDown();
+    bool StepUp();
+    void ResetWindow();
+
+    // How many frames are averaged before deciding anything, this also stops us from changing
+    // rungs again before the last change has had an effect
+    static constexpr u32 WINDOW_FRAMES = 30;
+
+    // Step down when the average frame uses most of the budget, step up when it uses under half
+    static constexpr double STEP_DOWN_RATIO = 0.9;
+    static constexpr double STEP_UP_RATIO = 0.5;
+
+    // Cheaper rungs make the average drop a lot, so only climb back up after the headroom has held
+    // for a few windows in a row to avoid bouncing between two rungs
+    static constexpr u32 STEP_UP_WINDOWS = 4;
+
+    double budget{1.0 / 30.0};
+    u32 allowed{ALL_QUALITY_RUNGS};
+    u32 rung{};
+    double window_total{};
+    u32 window_frames{};
+    u32 headroom_windows{};
+};
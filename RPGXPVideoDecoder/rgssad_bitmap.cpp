@@ -15,14 +15,13 @@ void Bitmap::WriteLine(void* data, std::size_t size, u32 line) {
         return;
     }
 
-    if (IsDisposed()) {
+    const auto surface = GetSurface();
+    if (surface.top_line == nullptr) {
         return;
     }
 
-    const auto copy_size = std::min<std::size_t>(size, width * sizeof(Color));
-    const auto line_index = GetLineIndex(line);
-
-    std::memcpy(static_cast<char*>(layout->base->obj->bitmap_data) - line_index, data, copy_size);
+    const auto copy_pixels = std::min<std::size_t>(size / sizeof(Color), width);
+    Blit::CopyRect(surface, 0, line, copy_pixels, 1, static_cast<const u8*>(data), 0);
 }
 
 bool Bitmap::WriteBuffer(void* data, std::size_t size) {
@@ -38,25 +37,61 @@ bool Bitmap::WriteBuffer(void* data, std::size_t size) {
 }
 
 bool Bitmap::WriteBufferFlipped(void* data, std::size_t size) {
-    if (IsDisposed()) {
+    if (size != (width * height * sizeof(Color))) {
         return false;
     }
 
+    const auto surface = GetSurface();
+    if (surface.top_line == nullptr) {
+        return false;
+    }
+
+    Blit::CopyImage(surface, static_cast<const u8*>(data), GetLineIndex(1));
+    return true;
+}
+
+bool Bitmap::WriteBufferOpaque(void* data, std::size_t size) {
     if (size != (width * height * sizeof(Color))) {
         return false;
     }
 
-    const auto line_copy_size = width * sizeof(Color);
-    for (std::size_t y = 0; y < height; y++) {
-        const auto line_index = GetLineIndex(y);
-        const auto reversed_line_index = GetLineIndex(height - 1 - y);
+    const auto surface = GetSurface();
+    if (surface.top_line == nullptr) {
+        return false;
+    }
+
+    Blit::CopyImageOpaque(surface, static_cast<const u8*>(data), GetLineIndex(1));
+    return true;
+}
 
-        std::memcpy(static_cast<char*>(layout->base->obj->bitmap_data) - line_index,
-                    static_cast<char*>(data) + line_index, line_copy_size);
+bool Bitmap::WriteRect(void* data, std::size_t pitch, u32 x, u32 y, u32 rect_width,
+                       u32 rect_height) {
+    const auto surface = GetSurface();
+    if (surface.top_line == nullptr) {
+        return false;
     }
+
+    Blit::CopyRect(surface, x, y, rect_width, rect_height, static_cast<const u8*>(data),
+                   static_cast<std::ptrdiff_t>(pitch));
     return true;
 }
 
+u8* Bitmap::GetTopLine() const {
+    if (IsDisposed()) {
+        return nullptr;
+    }
+    return static_cast<u8*>(layout->base->obj->bitmap_data);
+}
+
+std::ptrdiff_t Bitmap::GetPitch() const {
+    // The engine stores bitmaps bottom-up, each line below the top line lives at a lower address
+    return -static_cast<std::ptrdiff_t>(width * sizeof(Color));
+}
+
+Blit::Surface Bitmap::GetSurface() const {
+    return Blit::Surface{GetTopLine(), GetPitch(), width, height};
+}
+
 std::size_t Bitmap::GetWidth() const {
     return width;
 }
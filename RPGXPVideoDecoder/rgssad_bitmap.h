@@ -1,6 +1,8 @@
 #pragma once
 #include <Windows.h>
+#include "blit_kernels.h"
 #include "common_types.h"
+#include "frame_sink.h"
 
 namespace RPGMaker {
 struct Color {
@@ -18,16 +20,21 @@ struct Color {
 };
 static_assert(sizeof(Color) == 4, "Color is an invalid size");
 
-class Bitmap {
+class Bitmap : public FrameSink {
 public:
     Bitmap(EngineAddr base);
-    ~Bitmap();
+    ~Bitmap() override;
 
     void WriteLine(void* data, std::size_t size, u32 line);
     bool WriteBuffer(void* data, std::size_t size);
     bool WriteBufferFlipped(void* data, std::size_t size);
-    std::size_t GetWidth() const;
-    std::size_t GetHeight() const;
+    bool WriteBufferOpaque(void* data, std::size_t size);
+    bool WriteRect(void* data, std::size_t pitch, u32 x, u32 y, u32 rect_width, u32 rect_height);
+    u8* GetTopLine() const;
+    std::ptrdiff_t GetPitch() const;
+    Blit::Surface GetSurface() const override;
+    std::size_t GetWidth() const override;
+    std::size_t GetHeight() const override;
     bool IsDisposed() const;
 
 private:
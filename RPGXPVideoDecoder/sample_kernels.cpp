@@ -0,0 +1,196 @@
+#include <cstring>
+#include "cpu_features.h"
+#include "sample_kernels.h"
+
+#if VIDEC_ARCH_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+namespace Samples {
+
+namespace {
+
+void InterleaveAny(u8* dst, const u8* const* planes, std::size_t channels, std::size_t frames,
+                   std::size_t sample_bytes, std::size_t first) {
+    u8* out = dst + first * channels * sample_bytes;
+    for (std::size_t frame = first; frame < frames; frame++) {
+        for (std::size_t channel = 0; channel < channels; channel++) {
+            std::memcpy(out, planes[channel] + frame * sample_bytes, sample_bytes);
+            out += sample_bytes;
+        }
+    }
+}
+
+/// Finishes off the frames from first onwards, the sample size being a constant lets the copies
+/// turn into plain loads and stores
+template <std::size_t Bytes>
+void InterleaveTail(u8* dst, const u8* const* planes, std::size_t channels, std::size_t frames,
+                    std::size_t first) {
+    InterleaveAny(dst, planes, channels, frames, Bytes, first);
+}
+
+template <std::size_t Bytes>
+void InterleaveScalar(u8* dst, const u8* const* planes, std::size_t channels,
+                      std::size_t frames) {
+    InterleaveTail<Bytes>(dst, planes, channels, frames, 0);
+}
+
+#if VIDEC_ARCH_X86
+void Interleave16SSE2(u8* dst, const u8* const* planes, std::size_t channels,
+                      std::size_t frames) {
+    if (channels != 2) {
+        InterleaveTail<2>(dst, planes, channels, frames, 0);
+        return;
+    }
+
+    std::size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        const __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[0] + i * 2));
+        const __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[1] + i * 2));
+        auto* out = reinterpret_cast<__m128i*>(dst + i * 4);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(left, right));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(left, right));
+    }
+    InterleaveTail<2>(dst, planes, channels, frames, i);
+}
+
+void Interleave32SSE2(u8* dst, const u8* const* planes, std::size_t channels,
+                      std::size_t frames) {
+    if (channels != 2) {
+        InterleaveTail<4>(dst, planes, channels, frames, 0);
+        return;
+    }
+
+    std::size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        const __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[0] + i * 4));
+        const __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[1] + i * 4));
+        auto* out = reinterpret_cast<__m128i*>(dst + i * 8);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi32(left, right));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi32(left, right));
+    }
+    InterleaveTail<4>(dst, planes, channels, frames, i);
+}
+
+// Unpacks stay within each 128 bit lane, so the low and high halves of both results are swapped
+// around before storing to keep the frames in order
+VIDEC_TARGET_AVX2 void Interleave16AVX2(u8* dst, const u8* const* planes, std::size_t channels,
+                                        std::size_t frames) {
+    if (channels != 2) {
+        InterleaveTail<2>(dst, planes, channels, frames, 0);
+        return;
+    }
+
+    std::size_t i = 0;
+    for (; i + 16 <= frames; i += 16) {
+        const __m256i left =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(planes[0] + i * 2));
+        const __m256i right =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(planes[1] + i * 2));
+        const __m256i lo = _mm256_unpacklo_epi16(left, right);
+        const __m256i hi = _mm256_unpackhi_epi16(left, right);
+        auto* out = reinterpret_cast<__m256i*>(dst + i * 4);
+        _mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    InterleaveTail<2>(dst, planes, channels, frames, i);
+}
+
+VIDEC_TARGET_AVX2 void Interleave32AVX2(u8* dst, const u8* const* planes, std::size_t channels,
+                                        std::size_t frames) {
+    if (channels != 2) {
+        InterleaveTail<4>(dst, planes, channels, frames, 0);
+        return;
+    }
+
+    std::size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        const __m256i left =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(planes[0] + i * 4));
+        const __m256i right =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(planes[1] + i * 4));
+        const __m256i lo = _mm256_unpacklo_epi32(left, right);
+        const __m256i hi = _mm256_unpackhi_epi32(left, right);
+        auto* out = reinterpret_cast<__m256i*>(dst + i * 8);
+        _mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    InterleaveTail<4>(dst, planes, channels, frames, i);
+}
+#endif
+
+constexpr Kernels SCALAR_KERNELS{
+    Blit::Isa::Scalar,
+    "scalar",
+    InterleaveScalar<2>,
+    InterleaveScalar<4>,
+};
+#if VIDEC_ARCH_X86
+constexpr Kernels SSE2_KERNELS{
+    Blit::Isa::SSE2,
+    "sse2",
+    Interleave16SSE2,
+    Interleave32SSE2,
+};
+constexpr Kernels AVX2_KERNELS{
+    Blit::Isa::AVX2,
+    "avx2",
+    Interleave16AVX2,
+    Interleave32AVX2,
+};
+#endif
+
+const Kernels& SelectKernels() {
+    if (const auto* kernels = Samples::GetKernels(Blit::Isa::AVX2)) {
+        return *kernels;
+    }
+    if (const auto* kernels = Samples::GetKernels(Blit::Isa::SSE2)) {
+        return *kernels;
+    }
+    return SCALAR_KERNELS;
+}
+
+} // Anonymous namespace
+
+const Kernels& GetKernels() {
+    static const Kernels& kernels = SelectKernels();
+    return kernels;
+}
+
+const Kernels* GetKernels(Blit::Isa isa) {
+    switch (isa) {
+    case Blit::Isa::Scalar:
+        return &SCALAR_KERNELS;
+#if VIDEC_ARCH_X86
+    case Blit::Isa::SSE2:
+        return GetCpuFeatures().sse2 ? &SSE2_KERNELS : nullptr;
+    case Blit::Isa::AVX2:
+        return GetCpuFeatures().avx2 ? &AVX2_KERNELS : nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+void Interleave(u8* dst, const u8* const* planes, std::size_t channels, std::size_t frames,
+                std::size_t sample_bytes, const Kernels& kernels) {
+    if (channels == 1) {
+        std::memcpy(dst, planes[0], frames * sample_bytes);
+        return;
+    }
+
+    switch (sample_bytes) {
+    case 2:
+        kernels.interleave_16(dst, planes, channels, frames);
+        break;
+    case 4:
+        kernels.interleave_32(dst, planes, channels, frames);
+        break;
+    default:
+        InterleaveAny(dst, planes, channels, frames, sample_bytes, 0);
+        break;
+    }
+}
+
+} // namespace Samples
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include "blit_kernels.h"
+#include "common_types.h"
+
+namespace Samples {
+
+/// Interleaves frames samples from each of the channels planes into dst
+using InterleaveFunc = void (*)(u8* dst, const u8* const* planes, std::size_t channels,
+                                std::size_t frames);
+
+/// Kernels for 16 and 32 bit samples. The SIMD ones only speed up stereo, which is what nearly
+/// every video has, and hand any other channel count to the scalar loop
+struct Kernels {
+    Blit::Isa isa{};
+    const char* name{};
+    InterleaveFunc interleave_16{};
+    InterleaveFunc interleave_32{};
+};
+
+/// Best kernels for the running CPU, picked once on first use
+const Kernels& GetKernels();
+
+/// Kernels for a specific instruction set or nullptr if the CPU doesn't support it
+const Kernels* GetKernels(Blit::Isa isa);
+
+/// Interleaves planar audio with sample_bytes per sample, dst needs room for frames * channels
+/// samples. Every kernel set gives the same output, the samples are only moved around
+void Interleave(u8* dst, const u8* const* planes, std::size_t channels, std::size_t frames,
+                std::size_t sample_bytes, const Kernels& kernels = GetKernels());
+
+} // namespace Samples
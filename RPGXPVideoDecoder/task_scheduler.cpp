@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <thread>
+
+#include "task_scheduler.h"
+
+void TaskWorkerBootstrap(void* param);
+
+namespace {
+
+std::mutex shared_mutex;
+std::unique_ptr<TaskScheduler> shared_scheduler{};
+// What the game asked for through ViDecSetWorkerCount, 0 for the default
+std::size_t configured_workers{};
+
+std::size_t ResolveWorkerCount(std::size_t worker_count) {
+    if (worker_count != 0) {
+        return std::min<std::size_t>(worker_count, TaskScheduler::MAX_WORKERS);
+    }
+    // The thread calling Run always works on its own job too
+    const auto cores = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    return std::min<std::size_t>(cores - 1, TaskScheduler::MAX_WORKERS);
+}
+
+} // Anonymous namespace
+
+TaskScheduler::TaskScheduler(std::size_t worker_count) {
+    SetWorkerCount(worker_count);
+}
+
+TaskScheduler::~TaskScheduler() {
+    SetWorkerCount(0);
+}
+
+TaskScheduler& TaskScheduler::Get() {
+    std::scoped_lock lock{shared_mutex};
+    if (!shared_scheduler) {
+        shared_scheduler = std::make_unique<TaskScheduler>(ResolveWorkerCount(configured_workers));
+    }
+    return *shared_scheduler;
+}
+
+void TaskScheduler::Shutdown() {
+    std::scoped_lock lock{shared_mutex};
+    shared_scheduler.reset();
+}
+
+void TaskScheduler::Configure(std::size_t worker_count) {
+    std::scoped_lock lock{shared_mutex};
+    configured_workers = worker_count;
+    if (shared_scheduler) {
+        shared_scheduler->SetWorkerCount(ResolveWorkerCount(worker_count));
+    }
+}
+
+void TaskScheduler::SetWorkerCount(std::size_t worker_count) {
+    std::scoped_lock resize_lock{resize_mutex};
+
+    if (worker_count > workers.size()) {
+        {
+            std::scoped_lock lock{mutex};
+            active_workers = worker_count;
+        }
+        while (workers.size() < worker_count) {
+            auto worker = std::make_unique<Worker>();
+            worker->scheduler = this;
+            worker->index = workers.size();
+            if (!worker->thread.Start(TaskWorkerBootstrap, worker.get())) {
+                break;
+            }
+            workers.push_back(std::move(worker));
+        }
+
+        // Run whatever we managed to start with
+        std::scoped_lock lock{mutex};
+        active_workers = workers.size();
+        stream_generation++;
+        return;
+    }
+
+    // Workers past the new count finish the task they're on and leave, their jobs are picked up
+    // by the rest or by the threads waiting on them
+    {
+        std::scoped_lock lock{mutex};
+        active_workers = worker_count;
+        stream_generation++;
+    }
+    work_ready.notify_all();
+
+    while (workers.size() > worker_count) {
+        workers.back()->thread.Join();
+        workers.pop_back();
+    }
+}
+
+std::size_t TaskScheduler::GetWorkerCount() const {
+    std::scoped_lock lock{mutex};
+    return active_workers;
+}
+
+void TaskScheduler::AddStream() {
+    std::scoped_lock lock{mutex};
+    stream_count++;
+    stream_generation++;
+}
+
+void TaskScheduler::RemoveStream() {
+    std::scoped_lock lock{mutex};
+    if (stream_count > 0) {
+        stream_count--;
+        stream_generation++;
+    }
+}
+
+std::size_t TaskScheduler::GetStreamCount() const {
+    std::scoped_lock lock{mutex};
+    return stream_count;
+}
+
+std::size_t TaskScheduler::GetStreamThreadShare() const {
+    std::scoped_lock lock{mutex};
+    const auto budget = active_workers + 1;
+    return std::max<std::size_t>(budget / std::max<std::size_t>(stream_count, 1), 1);
+}
+
+u32 TaskScheduler::GetStreamGeneration() const {
+    std::scoped_lock lock{mutex};
+    return stream_generation;
+}
+
+void TaskScheduler::ClaimStreamThreads(std::size_t count) {
+    std::scoped_lock lock{mutex};
+    stream_threads += count;
+}
+
+void TaskScheduler::ReleaseStreamThreads(std::size_t count) {
+    {
+        std::scoped_lock lock{mutex};
+        stream_threads -= std::min<std::size_t>(count, stream_threads);
+    }
+    // Workers that were held back can help with whatever is queued now
+    work_ready.notify_all();
+}
+
+std::size_t TaskScheduler::GetAvailableWorkers() const {
+    return active_workers - std::min<std::size_t>(stream_threads, active_workers);
+}
+
+void TaskScheduler::Run(std::size_t task_count, double deadline,
+                        const std::function<void(std::size_t)>& task) {
+    if (task_count == 0) {
+        return;
+    }
+
+    Job job{};
+    job.task = &task;
+    job.deadline = deadline;
+    job.task_count = task_count;
+    job.tasks_remaining = task_count;
+
+    std::unique_lock lock{mutex};
+    std::size_t wake_count{};
+    const auto available_workers = GetAvailableWorkers();
+    if (task_count > 1 && available_workers > 0) {
+        // Jobs with the same deadline are served in the order they came in
+        const auto position = std::upper_bound(
+            jobs.begin(), jobs.end(), deadline,
+            [](double value, const Job* queued) { return value < queued->deadline; });
+        jobs.insert(position, &job);
+        wake_count = std::min<std::size_t>(task_count - 1, available_workers);
+    }
+    // A held back worker would swallow a single wakeup and go straight back to sleep
+    const bool wake_all = wake_count != 0 && available_workers < active_workers;
+    lock.unlock();
+    if (wake_all) {
+        work_ready.notify_all();
+    } else {
+        for (std::size_t i = 0; i < wake_count; i++) {
+            work_ready.notify_one();
+        }
+    }
+
+    // Work through our own job instead of sitting idle, never anyone elses so a busy scheduler
+    // can't hold us up past our own tasks
+    lock.lock();
+    while (job.next_task < job.task_count) {
+        const std::size_t index = ClaimTask(job);
+        lock.unlock();
+        task(index);
+        lock.lock();
+        FinishTask(job);
+    }
+    job.done.wait(lock, [&job] { return job.tasks_remaining == 0; });
+}
+
+void TaskScheduler::WorkerLoop(std::size_t index) {
+    std::unique_lock lock{mutex};
+    while (true) {
+        // Workers past what stream threads leave of the budget sleep until they're released
+        work_ready.wait(lock, [&] {
+            return index >= active_workers || (index < GetAvailableWorkers() && !jobs.empty());
+        });
+        if (index >= active_workers) {
+            return;
+        }
+
+        // Always help out whoever is closest to missing their deadline
+        Job& job = *jobs.front();
+        const auto* task = job.task;
+        const std::size_t task_index = ClaimTask(job);
+        lock.unlock();
+        (*task)(task_index);
+        lock.lock();
+        FinishTask(job);
+    }
+}
+
+std::size_t TaskScheduler::ClaimTask(Job& job) {
+    const std::size_t index = job.next_task++;
+    if (job.next_task >= job.task_count) {
+        const auto it = std::find(jobs.begin(), jobs.end(), &job);
+        if (it != jobs.end()) {
+            jobs.erase(it);
+        }
+    }
+    return index;
+}
+
+void TaskScheduler::FinishTask(Job& job) {
+    // The job lives on the stack of the thread waiting on it, it can't go anywhere until we
+    // release the lock
+    if (--job.tasks_remaining == 0) {
+        job.done.notify_all();
+    }
+}
+
+/* Bootstrap for the scheduler worker threads */
+void TaskWorkerBootstrap(void* param) {
+    auto* worker = static_cast<TaskScheduler::Worker*>(param);
+    worker->scheduler->WorkerLoop(worker->index);
+}
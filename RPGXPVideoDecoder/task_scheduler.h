@@ -0,0 +1,110 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "common_types.h"
+#include "platform.h"
+
+/// Process wide pool of threads shared by every decoder context, so playing several videos at
+/// once doesn't start a set of threads per video. Work is handed over as jobs split into
+/// independent tasks, such as converting horizontal bands of a frame. Each job carries the
+/// deadline it has to be done by and idle workers always take their next task from the most
+/// urgent job, so a video that's falling behind gets help first and one that has stalled holds
+/// nothing up. The thread calling Run works through its own job as well, a scheduler with no
+/// workers simply runs everything inline.
+class TaskScheduler {
+public:
+    explicit TaskScheduler(std::size_t worker_count);
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    /// The scheduler every context shares, created on first use
+    static TaskScheduler& Get();
+
+    /// Stops the shared scheduler, it's only meant to be called while unloading
+    static void Shutdown();
+
+    /// Changes how many workers the shared scheduler runs, 0 goes back to the default of one per
+    /// logical core minus the callers own thread. Capped at MAX_WORKERS. Safe to call while jobs
+    /// are running
+    static void Configure(std::size_t worker_count);
+
+    /// Starts or retires workers until there are worker_count of them
+    void SetWorkerCount(std::size_t worker_count);
+    std::size_t GetWorkerCount() const;
+
+    /// Streams currently sharing the scheduler, used to split the rest of the CPU between them
+    void AddStream();
+    void RemoveStream();
+    std::size_t GetStreamCount() const;
+
+    /// The scheduler's budget is one thread per worker plus one for the caller, and streams that
+    /// run threads of their own, such as a threaded codec, take them out of the same budget.
+    /// Every stream gets an even share, at least one
+    std::size_t GetStreamThreadShare() const;
+
+    /// Changes whenever a stream comes or goes or the worker count changes, so streams know when
+    /// to take up their new share
+    u32 GetStreamGeneration() const;
+
+    /// Threads streams are running beyond the first one each. Workers only take on tasks with
+    /// whatever is left of the budget, the threads calling Run always work through their own
+    void ClaimStreamThreads(std::size_t count);
+    void ReleaseStreamThreads(std::size_t count);
+
+    /// Calls task for every index below task_count and returns once they have all finished.
+    /// deadline is on the GetMonotonicSeconds clock, jobs with earlier deadlines are worked on
+    /// first. Any number of threads may call Run at once
+    void Run(std::size_t task_count, double deadline,
+             const std::function<void(std::size_t)>& task);
+
+    /// Entry point for the worker threads
+    void WorkerLoop(std::size_t index);
+
+    /// Handed to each worker thread on start
+    struct Worker {
+        TaskScheduler* scheduler{nullptr};
+        std::size_t index{};
+        Platform::Thread thread{};
+    };
+
+    static constexpr std::size_t MAX_WORKERS = 64;
+
+private:
+    struct Job {
+        const std::function<void(std::size_t)>* task{nullptr};
+        double deadline{};
+        std::size_t task_count{};
+        std::size_t next_task{};
+        std::size_t tasks_remaining{};
+        std::condition_variable done;
+    };
+
+    /// Claims the next task of job, removing it from the queue once every task is claimed. Must be
+    /// called with mutex held
+    std::size_t ClaimTask(Job& job);
+    void FinishTask(Job& job);
+
+    /// Workers allowed to take tasks once stream threads are accounted for. Must be called with
+    /// mutex held
+    std::size_t GetAvailableWorkers() const;
+
+    // Serialises SetWorkerCount so workers are never started and retired at the same time
+    std::mutex resize_mutex;
+    std::vector<std::unique_ptr<Worker>> workers{};
+
+    mutable std::mutex mutex;
+    std::condition_variable work_ready;
+    // Jobs with tasks left to claim, ordered by deadline
+    std::vector<Job*> jobs{};
+    std::size_t active_workers{};
+    std::size_t stream_count{};
+    std::size_t stream_threads{};
+    u32 stream_generation{};
+};
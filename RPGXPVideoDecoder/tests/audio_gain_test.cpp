@@ -0,0 +1,163 @@
+// Checks every gain kernel set the CPU supports against a plain reference loop. Random samples
+// in each format the device can be opened with are scaled with constant gains, fades in and out
+// and partial ramps, at every length up to a few vectors and some odd longer ones so the tails
+// are covered too, and the output has to match the reference bit for bit. Signed samples right
+// at the edges of their range are mixed in so the clamping is checked as well. Returns non-zero
+// on any failure.
+//
+//   audio_gain_test
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <SDL_audio.h>
+
+#include "audio_gain.h"
+
+namespace {
+
+constexpr Blit::Isa ISAS[] = {Blit::Isa::Scalar, Blit::Isa::SSE2, Blit::Isa::AVX2};
+
+struct Format {
+    SDL_AudioFormat format;
+    const char* name;
+};
+
+constexpr Format FORMATS[] = {
+    {AUDIO_U8, "u8"},
+    {AUDIO_S16, "s16"},
+    {AUDIO_S32, "s32"},
+    {AUDIO_F32, "f32"},
+};
+
+struct Ramp {
+    f32 start;
+    f32 end;
+};
+
+constexpr Ramp RAMPS[] = {
+    {1.0f, 1.0f}, {0.5f, 0.5f}, {0.0f, 1.0f}, {1.0f, 0.0f}, {0.25f, 0.9f}, {1.0f, 0.999f},
+};
+
+constexpr std::size_t LONG_LENGTHS[] = {127, 1001, 4095};
+
+/// Scales one sample the way the gain is documented to, rounding to nearest even and clamping to
+/// the format's range
+template <typename T>
+T Reference(T sample, f32 gain, f32 min, f32 max) {
+    f32 value = static_cast<f32>(sample) * gain;
+    value = value < min ? min : value;
+    value = value > max ? max : value;
+    return static_cast<T>(std::lrint(value));
+}
+
+std::vector<u8> ApplyReference(const std::vector<u8>& input, SDL_AudioFormat format,
+                               const Ramp& ramp) {
+    auto output = input;
+    const auto sample_bytes = static_cast<std::size_t>(SDL_AUDIO_BITSIZE(format) / 8);
+    const auto count = input.size() / sample_bytes;
+    if (ramp.start == 1.0f && ramp.end == 1.0f) {
+        return output;
+    }
+    const f32 step = count > 1 ? (ramp.end - ramp.start) / static_cast<f32>(count - 1) : 0.0f;
+    for (std::size_t i = 0; i < count; i++) {
+        const f32 gain = ramp.start + step * static_cast<f32>(i);
+        u8* sample = output.data() + i * sample_bytes;
+        if (format == AUDIO_U8) {
+            const auto centered = static_cast<s32>(*sample) - 128;
+            *sample = static_cast<u8>(Reference<s32>(centered, gain, -128.0f, 127.0f) + 128);
+        } else if (format == AUDIO_S16) {
+            s16 value{};
+            std::memcpy(&value, sample, sizeof(value));
+            value = Reference<s16>(value, gain, -32768.0f, 32767.0f);
+            std::memcpy(sample, &value, sizeof(value));
+        } else if (format == AUDIO_S32) {
+            // Largest float below 2^31, the same limit the kernels clamp to
+            s32 value{};
+            std::memcpy(&value, sample, sizeof(value));
+            value = Reference<s32>(value, gain, -2147483648.0f, 2147483520.0f);
+            std::memcpy(sample, &value, sizeof(value));
+        } else {
+            f32 value{};
+            std::memcpy(&value, sample, sizeof(value));
+            value *= gain;
+            std::memcpy(sample, &value, sizeof(value));
+        }
+    }
+    return output;
+}
+
+/// Random samples with the extremes of the format mixed in. Float samples stay within [-1, 1]
+std::vector<u8> MakeSamples(SDL_AudioFormat format, std::size_t count, std::mt19937& random) {
+    const auto sample_bytes = static_cast<std::size_t>(SDL_AUDIO_BITSIZE(format) / 8);
+    std::vector<u8> samples(count * sample_bytes);
+    for (std::size_t i = 0; i < count; i++) {
+        u8* sample = samples.data() + i * sample_bytes;
+        const bool extreme = random() % 4 == 0;
+        if (format == AUDIO_F32) {
+            const f32 value = extreme ? (random() % 2 == 0 ? -1.0f : 1.0f)
+                                      : static_cast<f32>(random()) / 2147483648.0f - 1.0f;
+            std::memcpy(sample, &value, sizeof(value));
+            continue;
+        }
+        const u32 bits = extreme ? (random() % 2 == 0 ? 0x80000000u : 0x7fffffffu)
+                                 : static_cast<u32>(random());
+        if (format == AUDIO_U8) {
+            *sample = extreme ? (bits >> 31 ? u8{0} : u8{255}) : static_cast<u8>(bits);
+        } else if (format == AUDIO_S16) {
+            const auto value = static_cast<u16>(extreme ? bits >> 16 : bits);
+            std::memcpy(sample, &value, sizeof(value));
+        } else {
+            std::memcpy(sample, &bits, sizeof(bits));
+        }
+    }
+    return samples;
+}
+
+bool Check(const AudioGain::Kernels& kernels, const Format& format, std::size_t count,
+           const Ramp& ramp, std::mt19937& random) {
+    const auto input = MakeSamples(format.format, count, random);
+    const auto expected = ApplyReference(input, format.format, ramp);
+    auto output = input;
+    AudioGain::Apply(output.data(), output.size(), format.format, ramp.start, ramp.end, kernels);
+    if (output != expected) {
+        std::printf("%s doesn't match the reference for %zu %s samples from %.3f to %.3f\n",
+                    kernels.name, count, format.name, ramp.start, ramp.end);
+        return false;
+    }
+    return true;
+}
+
+} // Anonymous namespace
+
+int main() {
+    std::mt19937 random(1);
+    std::printf("dispatch picked %s\n", AudioGain::GetKernels().name);
+
+    int result = 0;
+    std::size_t checks = 0;
+    for (const auto isa : ISAS) {
+        const auto* kernels = AudioGain::GetKernels(isa);
+        if (kernels == nullptr) {
+            continue;
+        }
+        for (const auto& format : FORMATS) {
+            for (const auto& ramp : RAMPS) {
+                for (std::size_t count = 1; count <= 70; count++) {
+                    result |= Check(*kernels, format, count, ramp, random) ? 0 : 1;
+                    checks++;
+                }
+                for (const auto count : LONG_LENGTHS) {
+                    result |= Check(*kernels, format, count, ramp, random) ? 0 : 1;
+                    checks++;
+                }
+            }
+        }
+    }
+
+    std::printf("%zu buffers checked, %s\n", checks, result == 0 ? "ok" : "FAILED");
+    return result;
+}
@@ -0,0 +1,100 @@
+// Checks that converting a frame in parallel bands gives exactly the same bitmap as scaling the
+// whole frame with a single swscale context, which is the reference every banded conversion has
+// to match. Covers the usual video sizes going into a full screen bitmap, ratios that can't be
+// banded exactly and have to fall back to one context, every scaler and both subsampled and full
+// chroma. Returns non-zero on any difference.
+//
+//   frame_converter_test
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+#include <frame.h>
+
+#include "frame_converter.h"
+#include "task_scheduler.h"
+
+namespace {
+
+struct SizePair {
+    int src_width;
+    int src_height;
+    std::size_t dst_width;
+    std::size_t dst_height;
+};
+
+constexpr SizePair SIZES[] = {
+    {1280, 720, 640, 480}, {1920, 1080, 640, 480}, {1920, 1080, 1280, 720},
+    {640, 360, 640, 480},  {320, 240, 640, 480},   {854, 480, 640, 480},
+    {720, 576, 640, 480},  {1280, 720, 544, 416},  {1920, 1088, 640, 480},
+};
+
+constexpr AVPixelFormat FORMATS[] = {AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV444P};
+
+/// Fills every plane with noise, which shows up any difference in filter positions or taps
+av::VideoFrame MakeFrame(AVPixelFormat format, int width, int height) {
+    av::VideoFrame frame(format, width, height, 32);
+    auto* raw = frame.raw();
+    const auto* desc = av_pix_fmt_desc_get(format);
+    for (int plane = 0; plane < 3; plane++) {
+        const int shift_w = plane == 0 ? 0 : desc->log2_chroma_w;
+        const int shift_h = plane == 0 ? 0 : desc->log2_chroma_h;
+        const int plane_width = -((-width) >> shift_w);
+        const int plane_height = -((-height) >> shift_h);
+        for (int y = 0; y < plane_height; y++) {
+            u8* row = raw->data[plane] + static_cast<std::ptrdiff_t>(y) * raw->linesize[plane];
+            for (int x = 0; x < plane_width; x++) {
+                row[x] = static_cast<u8>(std::rand());
+            }
+        }
+    }
+    return frame;
+}
+
+/// Converts into a heap allocated bitmap laid out bottom-up like the engine's
+std::vector<u8> ConvertFrame(FrameConverter& converter, const av::VideoFrame& frame,
+                             std::size_t width, std::size_t height) {
+    std::vector<u8> bitmap(width * height * 4);
+    const auto stride = static_cast<std::ptrdiff_t>(width * 4);
+    if (!converter.Convert(frame, bitmap.data() + (height - 1) * stride, -stride)) {
+        bitmap.clear();
+    }
+    return bitmap;
+}
+
+} // Anonymous namespace
+
+int main() {
+    TaskScheduler scheduler(4);
+    int result = 0;
+    for (const auto& size : SIZES) {
+        for (const auto format : FORMATS) {
+            const auto frame = MakeFrame(format, size.src_width, size.src_height);
+            for (u32 quality = 0; quality < SCALER_QUALITY_COUNT; quality++) {
+                FrameConverter single(size.dst_width, size.dst_height);
+                FrameConverter banded(size.dst_width, size.dst_height, &scheduler, 5);
+                single.SetScaler(static_cast<ScalerQuality>(quality));
+                banded.SetScaler(static_cast<ScalerQuality>(quality));
+
+                const auto reference =
+                    ConvertFrame(single, frame, size.dst_width, size.dst_height);
+                // Twice, so the cached scalers and scratch buffers are reused as well
+                ConvertFrame(banded, frame, size.dst_width, size.dst_height);
+                const auto output = ConvertFrame(banded, frame, size.dst_width, size.dst_height);
+
+                const bool matches = !reference.empty() && output == reference;
+                std::printf("%4dx%-4d %-8s -> %4zux%-4zu scaler %u: %s\n", size.src_width,
+                            size.src_height, av_get_pix_fmt_name(format), size.dst_width,
+                            size.dst_height, quality, matches ? "ok" : "MISMATCH");
+                if (!matches) {
+                    result = 1;
+                }
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,309 @@
+// Plays several synthetic videos at the same time through the regular Decoder, each into its own
+// heap allocated sink, the way the game plays several contexts at once. The streams are written
+// as YUV4MPEG in memory so no clips or encoders are needed, each one a different size and a
+// different solid colour, and together they cover the built-in YUV kernels and banded swscale
+// conversion on the shared scheduler. One more context is closed half way through playback.
+//
+// Checks that every context presents its frames in its own colour, finishes without a bad
+// termination and shuts down cleanly, that the registry hands out separate handles which keep
+// resolving to their own decoder while the others are closed, and that the shared scheduler
+// tracks each open context as a stream. Once every context has warmed up, playing the rest of
+// the stream mustn't allocate anything more. Returns non-zero on any failure.
+//
+//   multi_decoder_test
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <SDL.h>
+#include <av.h>
+
+#include "context_registry.h"
+#include "decoder.h"
+#include "frame_sink.h"
+#include "media_input.h"
+#include "platform.h"
+#include "task_scheduler.h"
+
+namespace {
+
+/// One synthetic video and the sink it plays into
+struct StreamSpec {
+    int width;
+    int height;
+    std::size_t sink_width;
+    std::size_t sink_height;
+    u8 y;
+    u8 u;
+    u8 v;
+    int frames;
+};
+
+constexpr int FRAME_RATE = 30;
+
+constexpr StreamSpec STREAMS[] = {
+    // Bitmap sized and twice the bitmap size go through the YUV kernels
+    {320, 240, 320, 240, 81, 90, 240, 45},
+    {640, 480, 320, 240, 145, 54, 34, 45},
+    // Anything else through swscale, banded on the shared workers when it's big enough
+    {480, 272, 320, 240, 41, 240, 110, 45},
+    {1280, 720, 640, 480, 170, 166, 16, 45},
+};
+
+// Closed while it's still playing, long enough that it can't have finished by then
+constexpr StreamSpec CLOSED_EARLY{640, 360, 320, 240, 106, 202, 222, 300};
+
+constexpr double PLAYBACK_TIMEOUT_SECONDS = 30.0;
+
+/// Writes frames of a solid colour as a 4:2:0 YUV4MPEG stream
+std::vector<u8> MakeStream(const StreamSpec& spec) {
+    const auto header = "YUV4MPEG2 W" + std::to_string(spec.width) + " H" +
+                        std::to_string(spec.height) + " F" + std::to_string(FRAME_RATE) +
+                        ":1 Ip A1:1 C420jpeg\n";
+    const std::string frame_header{"FRAME\n"};
+    const auto luma = static_cast<std::size_t>(spec.width) * static_cast<std::size_t>(spec.height);
+    const auto chroma = static_cast<std::size_t>((spec.width + 1) / 2) *
+                        static_cast<std::size_t>((spec.height + 1) / 2);
+
+    std::vector<u8> stream(header.begin(), header.end());
+    for (int frame = 0; frame < spec.frames; frame++) {
+        stream.insert(stream.end(), frame_header.begin(), frame_header.end());
+        stream.insert(stream.end(), luma, spec.y);
+        stream.insert(stream.end(), chroma, spec.u);
+        stream.insert(stream.end(), chroma, spec.v);
+    }
+    return stream;
+}
+
+/// The BGRA pixel a limited range BT.601 colour should come out as
+std::array<int, 4> ExpectedPixel(const StreamSpec& spec) {
+    const double y = 1.164 * (spec.y - 16);
+    const double u = spec.u - 128;
+    const double v = spec.v - 128;
+    const auto clamp = [](double value) {
+        return std::min<int>(255, std::max<int>(0, static_cast<int>(value + 0.5)));
+    };
+    return {clamp(y + 2.018 * u), clamp(y - 0.813 * v - 0.391 * u), clamp(y + 1.596 * v), 255};
+}
+
+/// Bottom-up like an RGSS bitmap. The pixels are shared with the test so they can still be
+/// checked once the decoder owning the sink is gone
+class HeapSink : public FrameSink {
+public:
+    HeapSink(std::size_t width, std::size_t height, std::shared_ptr<std::vector<u8>> memory)
+        : width(width), height(height), memory(std::move(memory)) {}
+
+    std::size_t GetWidth() const override {
+        return width;
+    }
+
+    std::size_t GetHeight() const override {
+        return height;
+    }
+
+    Blit::Surface GetSurface() const override {
+        const auto stride = static_cast<std::ptrdiff_t>(width * 4);
+        return Blit::Surface{memory->data() + (height - 1) * stride, -stride, width, height};
+    }
+
+private:
+    std::size_t width;
+    std::size_t height;
+    std::shared_ptr<std::vector<u8>> memory;
+};
+
+/// A context under test, the stream has to outlive the decoder reading it
+struct Context {
+    const StreamSpec* spec{};
+    std::vector<u8> stream{};
+    std::shared_ptr<std::vector<u8>> pixels{};
+    std::shared_ptr<Decoder> decoder{};
+    u32 handle{};
+    u64 warm_allocations{};
+};
+
+bool Open(Context& context, const StreamSpec& spec, ContextRegistry& registry) {
+    context.spec = &spec;
+    context.stream = MakeStream(spec);
+    context.pixels = std::make_shared<std::vector<u8>>(spec.sink_width * spec.sink_height * 4);
+    context.decoder = std::make_shared<Decoder>(
+        std::make_unique<HeapSink>(spec.sink_width, spec.sink_height, context.pixels),
+        DecoderSettings{});
+    context.handle = registry.Add(context.decoder);
+
+    const auto result = context.decoder->Setup(
+        std::make_unique<MemoryInput>(context.stream.data(), context.stream.size(), false));
+    if (result != ErrorCode::Success) {
+        std::printf("%dx%d: setup failed with error %d\n", spec.width, spec.height,
+                    static_cast<int>(result));
+        return false;
+    }
+    return true;
+}
+
+/// Every pixel of the sink has to be the stream's colour, anything else means a frame was never
+/// presented or ended up in the wrong sink
+bool CheckPixels(const Context& context) {
+    const auto expected = ExpectedPixel(*context.spec);
+    const auto& pixels = *context.pixels;
+    for (std::size_t i = 0; i < pixels.size(); i += 4) {
+        for (std::size_t channel = 0; channel < 4; channel++) {
+            if (std::abs(pixels[i + channel] - expected[channel]) > 3) {
+                std::printf("%dx%d: pixel %zu is %u,%u,%u,%u, expected %d,%d,%d,%d\n",
+                            context.spec->width, context.spec->height, i / 4, pixels[i],
+                            pixels[i + 1], pixels[i + 2], pixels[i + 3], expected[0],
+                            expected[1], expected[2], expected[3]);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool CheckHandles(const std::vector<Context>& contexts, const ContextRegistry& registry) {
+    for (std::size_t i = 0; i < contexts.size(); i++) {
+        const auto handle = contexts[i].handle;
+        if (handle == 0 || registry.Get(handle) != contexts[i].decoder) {
+            std::printf("handle %u doesn't resolve to its own decoder\n", handle);
+            return false;
+        }
+        for (std::size_t j = 0; j < i; j++) {
+            if (contexts[j].handle == handle) {
+                std::printf("handle %u was handed out twice\n", handle);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool WaitForCompletion(const std::vector<Context>& contexts) {
+    const double start = Platform::GetMonotonicSeconds();
+    while (Platform::GetMonotonicSeconds() - start < PLAYBACK_TIMEOUT_SECONDS) {
+        if (std::all_of(contexts.begin(), contexts.end(),
+                        [](const Context& context) { return context.decoder->IsCompleted(); })) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    std::printf("playback didn't finish within %.0f seconds\n", PLAYBACK_TIMEOUT_SECONDS);
+    return false;
+}
+
+bool Run() {
+    auto& scheduler = TaskScheduler::Get();
+    ContextRegistry registry{};
+
+    // The context closed early goes last so it can simply be popped off
+    std::vector<Context> contexts(std::size(STREAMS) + 1);
+    for (std::size_t i = 0; i < contexts.size(); i++) {
+        const auto& spec = i < std::size(STREAMS) ? STREAMS[i] : CLOSED_EARLY;
+        if (!Open(contexts[i], spec, registry)) {
+            return false;
+        }
+    }
+    if (scheduler.GetStreamCount() != contexts.size()) {
+        std::printf("scheduler has %zu streams with %zu contexts open\n",
+                    scheduler.GetStreamCount(), contexts.size());
+        return false;
+    }
+    if (!CheckHandles(contexts, registry)) {
+        return false;
+    }
+
+    for (auto& context : contexts) {
+        context.decoder->StartRender();
+    }
+
+    // Close one context while everything is playing, the rest must carry on unaffected. The
+    // decoder is still reading the stream, so it has to be stopped before the context goes
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    const auto closed_handle = contexts.back().handle;
+    contexts.back().decoder.reset();
+    const bool closed = registry.Remove(closed_handle);
+    contexts.pop_back();
+    if (!closed || registry.Get(closed_handle) != nullptr || registry.Remove(closed_handle)) {
+        std::printf("handle %u wasn't closed\n", closed_handle);
+        return false;
+    }
+    if (scheduler.GetStreamCount() != contexts.size() || !CheckHandles(contexts, registry)) {
+        std::printf("closing handle %u affected the other contexts\n", closed_handle);
+        return false;
+    }
+
+    // Every context has presented frames by now, so its buffers, scalers and scratch space are
+    // all set up
+    for (auto& context : contexts) {
+        context.warm_allocations = context.decoder->GetPlaybackAllocations();
+    }
+
+    if (!WaitForCompletion(contexts)) {
+        return false;
+    }
+
+    bool ok = true;
+    for (const auto& context : contexts) {
+        PlaybackStats stats{};
+        context.decoder->GetStats(stats);
+        const auto& spec = *context.spec;
+        std::printf("%4dx%-4d into %zux%zu: %u decoded, %u presented, %u dropped, %u skipped\n",
+                    spec.width, spec.height, spec.sink_width, spec.sink_height,
+                    stats.frames_decoded, stats.frames_presented, stats.frames_dropped,
+                    stats.frames_skipped);
+        if (stats.frames_decoded != static_cast<u32>(spec.frames) ||
+            stats.frames_presented == 0 || context.decoder->WasBadTermination()) {
+            std::printf("%dx%d didn't play through cleanly\n", spec.width, spec.height);
+            ok = false;
+        }
+        const auto allocations = context.decoder->GetPlaybackAllocations();
+        if (allocations != context.warm_allocations) {
+            std::printf("%dx%d allocated %llu times after warming up\n", spec.width, spec.height,
+                        static_cast<unsigned long long>(allocations - context.warm_allocations));
+            ok = false;
+        }
+        ok = CheckPixels(context) && ok;
+    }
+
+    // Closing the rest one at a time, every handle still open has to keep its own decoder
+    while (!contexts.empty()) {
+        const auto handle = contexts.front().handle;
+        contexts.front().decoder.reset();
+        const bool closed = registry.Remove(handle);
+        contexts.erase(contexts.begin());
+        if (!closed || registry.Get(handle) != nullptr || !CheckHandles(contexts, registry)) {
+            std::printf("closing handle %u failed\n", handle);
+            ok = false;
+        }
+    }
+    if (scheduler.GetStreamCount() != 0) {
+        std::printf("scheduler still has %zu streams after closing everything\n",
+                    scheduler.GetStreamCount());
+        ok = false;
+    }
+    return ok;
+}
+
+} // Anonymous namespace
+
+int main() {
+    av::init();
+
+    // None of the streams have sound, but the decoder still opens SDL's audio subsystem
+    SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+    SDL_Init(SDL_INIT_AUDIO);
+
+    const bool ok = Run();
+    std::printf("%s\n", ok ? "ok" : "FAILED");
+
+    TaskScheduler::Shutdown();
+    SDL_Quit();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+// Stress test for the task scheduler. Several threads keep calling Run on a private scheduler and
+// on the shared one, the way every context converts its frames, while another thread keeps
+// resizing both of them through SetWorkerCount and Configure, down to no workers at all and up to
+// more than there are cores. Every job checks each of its tasks ran exactly once and Run only
+// returned after all of them had finished.
+//
+// Also checks streams get an even share of the thread budget and that threads they claim only
+// hold workers back. Mostly useful built with -DVIDEC_TSAN=ON, so ThreadSanitizer watches workers
+// being started and retired while jobs are queued. Returns non-zero on any failure.
+//
+//   task_scheduler_test [seconds]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "platform.h"
+#include "task_scheduler.h"
+
+namespace {
+
+constexpr std::size_t CALLERS_PER_SCHEDULER = 3;
+constexpr std::size_t MAX_TASKS = 48;
+
+// Worker counts cycled through while the callers run, 0 on the shared scheduler means the default
+constexpr std::size_t WORKER_COUNTS[] = {0, 1, 4, 2, 9, 0, 3, TaskScheduler::MAX_WORKERS, 1};
+
+struct CallerResult {
+    u64 jobs{};
+    u64 failures{};
+};
+
+/// Keeps running jobs of random sizes and deadlines until told to stop
+void RunJobs(TaskScheduler& scheduler, unsigned seed, const std::atomic<bool>& stop,
+             CallerResult& result) {
+    std::mt19937 random(seed);
+    std::vector<std::atomic<u32>> runs(MAX_TASKS);
+    while (!stop.load()) {
+        const std::size_t task_count = random() % (MAX_TASKS + 1);
+        const double deadline = Platform::GetMonotonicSeconds() + (random() % 50) / 1000.0;
+        for (auto& count : runs) {
+            count.store(0, std::memory_order_relaxed);
+        }
+
+        std::atomic<std::size_t> unfinished{task_count};
+        scheduler.Run(task_count, deadline, [&](std::size_t index) {
+            if (index < runs.size()) {
+                runs[index].fetch_add(1);
+            }
+            // Enough work that the other callers and the resizer get a chance to interleave
+            if (index % 7 == 0) {
+                std::this_thread::yield();
+            }
+            unfinished.fetch_sub(1);
+        });
+
+        bool ok = unfinished.load() == 0;
+        for (std::size_t i = 0; i < runs.size(); i++) {
+            ok = ok && runs[i].load() == (i < task_count ? 1u : 0u);
+        }
+        if (!ok) {
+            std::printf("job of %zu tasks didn't run every task exactly once\n", task_count);
+            result.failures++;
+        }
+        result.jobs++;
+    }
+}
+
+/// Resizes both schedulers until told to stop, returns how many times it did
+u64 Resize(TaskScheduler& scheduler, const std::atomic<bool>& stop) {
+    u64 resizes = 0;
+    while (!stop.load()) {
+        for (const auto worker_count : WORKER_COUNTS) {
+            scheduler.SetWorkerCount(worker_count);
+            TaskScheduler::Configure(worker_count);
+            // Streams claiming threads hold workers back the same way shrinking the pool does
+            scheduler.ClaimStreamThreads(worker_count / 2);
+            resizes++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            scheduler.ReleaseStreamThreads(worker_count / 2);
+        }
+    }
+    return resizes;
+}
+
+/// Streams get an even share of the budget, and threads they claim hold workers back without
+/// stopping jobs from finishing
+bool CheckStreamThreads() {
+    TaskScheduler scheduler(3);
+    const auto generation = scheduler.GetStreamGeneration();
+    scheduler.AddStream();
+    scheduler.AddStream();
+    bool ok = scheduler.GetStreamThreadShare() == 2 &&
+              scheduler.GetStreamGeneration() != generation;
+
+    for (const std::size_t claimed : {std::size_t{1}, std::size_t{3}, std::size_t{5}}) {
+        scheduler.ClaimStreamThreads(claimed);
+        std::atomic<std::size_t> ran{0};
+        scheduler.Run(MAX_TASKS, Platform::GetMonotonicSeconds(),
+                      [&](std::size_t) { ran.fetch_add(1); });
+        ok = ok && ran.load() == MAX_TASKS;
+        scheduler.ReleaseStreamThreads(claimed);
+    }
+
+    scheduler.RemoveStream();
+    ok = ok && scheduler.GetStreamThreadShare() == 4;
+    scheduler.RemoveStream();
+    if (!ok) {
+        std::printf("stream thread shares aren't split or claimed right\n");
+    }
+    return ok;
+}
+
+} // Anonymous namespace
+
+int main(int argc, char** argv) {
+    const double seconds = argc > 1 ? std::strtod(argv[1], nullptr) : 2.0;
+
+    TaskScheduler scheduler(2);
+    std::atomic<bool> stop{false};
+    std::vector<CallerResult> results(CALLERS_PER_SCHEDULER * 2);
+    std::vector<std::thread> callers{};
+    for (std::size_t i = 0; i < results.size(); i++) {
+        auto& target = i < CALLERS_PER_SCHEDULER ? scheduler : TaskScheduler::Get();
+        callers.emplace_back(RunJobs, std::ref(target), static_cast<unsigned>(i + 1),
+                             std::cref(stop), std::ref(results[i]));
+    }
+    u64 resizes = 0;
+    std::thread resizer([&] { resizes = Resize(scheduler, stop); });
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(true);
+    for (auto& caller : callers) {
+        caller.join();
+    }
+    resizer.join();
+
+    // Both have to keep working once they've settled again
+    int result = CheckStreamThreads() ? 0 : 1;
+    for (auto* target : {&scheduler, &TaskScheduler::Get()}) {
+        std::atomic<std::size_t> ran{0};
+        target->Run(MAX_TASKS, Platform::GetMonotonicSeconds(),
+                    [&](std::size_t) { ran.fetch_add(1); });
+        if (ran.load() != MAX_TASKS) {
+            std::printf("scheduler stopped working after being resized\n");
+            result = 1;
+        }
+    }
+
+    u64 jobs = 0;
+    for (const auto& caller : results) {
+        jobs += caller.jobs;
+        if (caller.failures != 0 || caller.jobs == 0) {
+            result = 1;
+        }
+    }
+    std::printf("%llu jobs from %zu callers across %llu resizes, %s\n",
+                static_cast<unsigned long long>(jobs), results.size(),
+                static_cast<unsigned long long>(resizes), result == 0 ? "ok" : "FAILED");
+
+    TaskScheduler::Shutdown();
+    return result;
+}
@@ -0,0 +1,74 @@
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+#include "trace_recorder.h"
+
+namespace {
+
+constexpr const char* THREAD_NAMES[] = {"Demux", "Video decoder", "Audio decoder", "Render"};
+static_assert(sizeof(THREAD_NAMES) / sizeof(THREAD_NAMES[0]) ==
+                  static_cast<std::size_t>(TraceThread::Count),
+              "Every trace thread needs a name");
+
+} // Anonymous namespace
+
+TraceRecorder::TraceRecorder(std::string path, std::size_t events_per_thread)
+    : path(std::move(path)), capacity(events_per_thread),
+      origin(Platform::GetMonotonicSeconds()) {
+    // Allocated up front so recording never has to
+    for (auto& buffer : buffers) {
+        buffer.events = std::make_unique<Event[]>(capacity);
+    }
+}
+
+void TraceRecorder::Record(TraceThread thread, const char* name, double start, double end,
+                           double pts) {
+    auto& buffer = buffers[static_cast<std::size_t>(thread)];
+    const auto index = buffer.count.load(std::memory_order_relaxed);
+    if (index == capacity) {
+        buffer.dropped.store(buffer.dropped.load(std::memory_order_relaxed) + 1,
+                             std::memory_order_relaxed);
+        return;
+    }
+    buffer.events[index] = Event{name, start, end - start, pts};
+    buffer.count.store(index + 1, std::memory_order_release);
+}
+
+bool TraceRecorder::Write() const {
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+
+    // Complete events ("ph":"X") in microseconds from when the recorder was created, with a
+    // thread name metadata event ahead of each timeline
+    std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (std::size_t thread = 0; thread < buffers.size(); thread++) {
+        const auto& buffer = buffers[thread];
+        const auto count = buffer.count.load(std::memory_order_acquire);
+        const auto tid = thread + 1;
+        std::fprintf(file,
+                     "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%zu,"
+                     "\"args\":{\"name\":\"%s\",\"dropped_events\":%llu}}",
+                     first ? "" : ",\n", tid, THREAD_NAMES[thread],
+                     static_cast<unsigned long long>(buffer.dropped.load()));
+        first = false;
+
+        for (std::size_t i = 0; i < count; i++) {
+            const auto& event = buffer.events[i];
+            std::fprintf(file,
+                         ",\n{\"ph\":\"X\",\"name\":\"%s\",\"cat\":\"videc\",\"pid\":1,"
+                         "\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f",
+                         event.name, tid, (event.start - origin) * 1000000.0,
+                         event.duration * 1000000.0);
+            if (!std::isnan(event.pts)) {
+                std::fprintf(file, ",\"args\":{\"pts\":%.6f}", event.pts);
+            }
+            std::fprintf(file, "}");
+        }
+    }
+    std::fprintf(file, "\n]}\n");
+    return std::fclose(file) == 0;
+}
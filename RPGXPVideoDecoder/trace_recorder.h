@@ -0,0 +1,92 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <string>
+
+#include "common_types.h"
+#include "platform.h"
+
+/// Pipeline threads a trace has a timeline for. Baked videos are fed from the demuxer thread,
+/// so their frame and audio events show up on that timeline
+enum class TraceThread : u32 {
+    Demux,
+    VideoDecoder,
+    AudioDecoder,
+    Render,
+    Count,
+};
+
+/// Records what the pipeline threads are doing as trace event JSON, which can be opened in
+/// Perfetto or chrome://tracing. Every thread gets its own preallocated buffer that only it
+/// writes to, so recording takes no locks and never allocates. Events past the capacity of a
+/// buffer are counted and dropped rather than growing it mid playback. Nothing is written until
+/// Write, which must only be called once every recording thread has stopped.
+class TraceRecorder {
+public:
+    /// Events without a frame to go with them
+    static constexpr double NO_PTS = std::numeric_limits<double>::quiet_NaN();
+
+    explicit TraceRecorder(std::string path, std::size_t events_per_thread = 1 << 16);
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    /// Records a slice from start to end on the GetMonotonicSeconds clock. name has to be a
+    /// string literal, only the pointer is kept. pts is in seconds on the playback timeline
+    void Record(TraceThread thread, const char* name, double start, double end,
+                double pts = NO_PTS);
+
+    /// Writes everything recorded to the path given on creation
+    bool Write() const;
+
+private:
+    struct Event {
+        const char* name{};
+        double start{};
+        double duration{};
+        double pts{};
+    };
+
+    struct Buffer {
+        std::unique_ptr<Event[]> events{};
+        std::atomic<std::size_t> count{0};
+        std::atomic<u64> dropped{0};
+    };
+
+    std::string path;
+    std::size_t capacity{};
+    double origin{};
+    std::array<Buffer, static_cast<std::size_t>(TraceThread::Count)> buffers{};
+};
+
+/// Records a slice covering its own lifetime, does nothing if recorder is nullptr
+class TraceScope {
+public:
+    TraceScope(TraceRecorder* recorder, TraceThread thread, const char* name,
+               double pts = TraceRecorder::NO_PTS)
+        : recorder(recorder), thread(thread), name(name), pts(pts),
+          start(recorder != nullptr ? Platform::GetMonotonicSeconds() : 0.0) {}
+
+    ~TraceScope() {
+        if (recorder != nullptr) {
+            recorder->Record(thread, name, start, Platform::GetMonotonicSeconds(), pts);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    /// For slices that only find out which frame they were for once they're done
+    void SetPts(double value) {
+        pts = value;
+    }
+
+private:
+    TraceRecorder* recorder;
+    TraceThread thread;
+    const char* name;
+    double pts;
+    double start;
+};
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <audioresampler.h>
+#include <av.h>
+#include <codeccontext.h>
+#include <formatcontext.h>
+extern "C" {
+#include <libavutil/channel_layout.h>
+}
+
+#include "baked_video.h"
+#include "decoder.h"
+#include "frame_converter.h"
+#include "task_scheduler.h"
+#include "video_baker.h"
+
+ErrorCode VideoBaker::Bake(const char* video_path, const char* baked_path, u32 width, u32 height,
+                           bool compress) {
+    av::init();
+
+    std::error_code err{};
+    av::FormatContext format_ctx{};
+    format_ctx.openInput(video_path, err);
+    if (err) {
+        return ErrorCode::InvalidFile;
+    }
+    format_ctx.findStreamInfo(err);
+    if (err) {
+        return ErrorCode::InvalidFile;
+    }
+
+    // Same stream choice as playback, the first of each kind
+    av::Stream video_stream{};
+    av::Stream audio_stream{};
+    std::size_t video_index{};
+    std::size_t audio_index{};
+    for (std::size_t i = 0; i < format_ctx.streamsCount(); i++) {
+        const auto stream = format_ctx.stream(i);
+        if (stream.isVideo() && video_stream.isNull()) {
+            video_stream = stream;
+            video_index = i;
+        }
+        if (stream.isAudio() && audio_stream.isNull()) {
+            audio_stream = stream;
+            audio_index = i;
+        }
+    }
+    if (video_stream.isNull()) {
+        return ErrorCode::FailedToFindVideoStream;
+    }
+    format_ctx.substractStartTime(true);
+
+    // Nothing is waiting on us, so let the codec have every core
+    av::VideoDecoderContext vdec(video_stream);
+    vdec.setCodec(av::findDecodingCodec(vdec.raw()->codec_id));
+    vdec.setRefCountedFrames(true);
+    const auto cores = std::max<u32>(std::thread::hardware_concurrency(), 1);
+    vdec.raw()->thread_count = static_cast<int>(std::min<u32>(cores, 16));
+    vdec.raw()->thread_type = static_cast<int>(VIDEO_THREAD_FRAME | VIDEO_THREAD_SLICE);
+    vdec.open(av::Codec(), err);
+    if (err) {
+        return ErrorCode::InternalError;
+    }
+
+    BakedVideoWriter writer{};
+    if (!writer.Open(baked_path, width, height, compress)) {
+        return ErrorCode::InternalError;
+    }
+
+    // Audio is stored as 2 channel PCM in the format the device would have been opened with
+    av::AudioDecoderContext adec{};
+    std::unique_ptr<av::AudioResampler> resampler{};
+    std::size_t audio_frame_bytes{};
+    if (!audio_stream.isNull()) {
+        adec = av::AudioDecoderContext(audio_stream);
+        adec.setCodec(av::findDecodingCodec(adec.raw()->codec_id));
+        adec.setRefCountedFrames(true);
+        adec.open(av::Codec(), err);
+        if (err) {
+            return ErrorCode::InternalError;
+        }
+
+        const auto format = Decoder::DecideBestFormat(adec.sampleFormat());
+        resampler = std::make_unique<av::AudioResampler>(
+            AV_CH_LAYOUT_STEREO, adec.sampleRate(), Decoder::DecideBestTarget(adec.sampleFormat()),
+            adec.channelLayout(), adec.sampleRate(), adec.sampleFormat());
+        audio_frame_bytes = static_cast<std::size_t>(SDL_AUDIO_BITSIZE(format) / 8) * 2;
+        writer.SetAudioFormat(static_cast<u32>(adec.sampleRate()), format, 2);
+    }
+    const auto take_audio = [&](bool everything) {
+        av::AudioSamples samples{};
+        std::error_code pop_err{};
+        while (resampler->pop(samples, everything, pop_err) && samples) {
+            writer.AddAudio(samples.data(),
+                            static_cast<std::size_t>(samples.samplesCount()) * audio_frame_bytes);
+        }
+    };
+
+    // Frames are converted bottom-up so they match the bitmaps memory
+    FrameConverter converter(width, height, &TaskScheduler::Get(), cores);
+    std::vector<u8> pixels(static_cast<std::size_t>(width) * height * 4);
+    const auto row_bytes = static_cast<std::ptrdiff_t>(width) * 4;
+    double last_timestamp = -1.0;
+    double frame_duration{};
+    const auto write_frame = [&](const av::VideoFrame& frame) {
+        const auto pts = frame.pts();
+        if (pts.isNoPts() || pts.seconds() <= last_timestamp) {
+            return true;
+        }
+        if (!converter.Convert(frame, pixels.data() + (height - 1) * row_bytes, -row_bytes)) {
+            return false;
+        }
+        if (last_timestamp >= 0.0 && frame_duration == 0.0) {
+            frame_duration = pts.seconds() - last_timestamp;
+        }
+        last_timestamp = pts.seconds();
+        return writer.AddFrame(pixels.data(), last_timestamp);
+    };
+
+    while (true) {
+        auto pkt = format_ctx.readPacket(err);
+        if (err) {
+            return ErrorCode::InternalError;
+        }
+        if (!pkt) {
+            break;
+        }
+
+        if (pkt.streamIndex() == video_index) {
+            auto frame = vdec.decode(pkt, err);
+            if (!err && frame && !write_frame(frame)) {
+                return ErrorCode::InternalError;
+            }
+        } else if (resampler && pkt.streamIndex() == audio_index) {
+            const auto samples = adec.decode(pkt, err);
+            if (!err && samples) {
+                resampler->push(samples, err);
+                take_audio(false);
+            }
+        }
+    }
+
+    // Get back whatever the codec and resampler are still holding on to
+    for (;;) {
+        auto frame = vdec.decode(av::Packet{}, err);
+        if (err || !frame) {
+            break;
+        }
+        if (!write_frame(frame)) {
+            return ErrorCode::InternalError;
+        }
+    }
+    if (resampler) {
+        take_audio(true);
+    }
+
+    // Prefer the nominal frame rate, the gap between the first two frames is a fallback
+    auto frame_rate = video_stream.averageFrameRate();
+    if (frame_rate.getNumerator() > 0 && frame_rate.getDenominator() > 0) {
+        frame_duration = 1.0 / frame_rate.getDouble();
+    }
+    if (frame_duration <= 0.0) {
+        frame_duration = 1.0 / 30.0;
+    }
+    if (!writer.Finish(last_timestamp + frame_duration, frame_duration)) {
+        return ErrorCode::InternalError;
+    }
+    return ErrorCode::Success;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "common_types.h"
+
+/// ViDecBakeVideo flags, LZ4 compresses each frame which usually makes the file a fraction of the
+/// size for a little more work per presented frame
+constexpr u32 BAKE_COMPRESS = 1;
+
+/// Offline step turning a regular video into a baked one (see BakedVideo) for a bitmap of width
+/// by height. Frames and audio go through the same codec setup, frame converter and audio formats
+/// playback uses, just as fast as they decode rather than in time with a clock, so a baked video
+/// looks and sounds exactly like the original would have.
+class VideoBaker {
+public:
+    ErrorCode Bake(const char* video_path, const char* baked_path, u32 width, u32 height,
+                   bool compress);
+};
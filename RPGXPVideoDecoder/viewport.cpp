@@ -0,0 +1,64 @@
+#include <algorithm>
+#include <cmath>
+
+#include "viewport.h"
+
+namespace {
+
+// Opaque black in BGRA
+constexpr u32 BORDER_PIXEL = 0xFF000000;
+
+} // Anonymous namespace
+
+ViewportRect ResolveViewport(ViewportMode mode, const ViewportRect& custom,
+                             std::size_t bitmap_width, std::size_t bitmap_height,
+                             double display_aspect) {
+    const ViewportRect full{0, 0, bitmap_width, bitmap_height};
+    if (mode == ViewportMode::Custom) {
+        return IsViewportInside(custom, bitmap_width, bitmap_height) ? custom : full;
+    }
+    if (mode != ViewportMode::Fit || !(display_aspect > 0.0) || bitmap_height == 0) {
+        return full;
+    }
+
+    // Fill the whole of whichever side is the tighter fit and centre along the other, bars
+    // narrower than a pixel aren't worth having
+    const auto width = static_cast<double>(bitmap_width);
+    const auto height = static_cast<double>(bitmap_height);
+    ViewportRect rect = full;
+    if (display_aspect > width / height) {
+        rect.height = std::min<std::size_t>(
+            bitmap_height, static_cast<std::size_t>(std::lround(width / display_aspect)));
+        rect.y = (bitmap_height - rect.height) / 2;
+    } else {
+        rect.width = std::min<std::size_t>(
+            bitmap_width, static_cast<std::size_t>(std::lround(height * display_aspect)));
+        rect.x = (bitmap_width - rect.width) / 2;
+    }
+    if (rect.width == 0 || rect.height == 0) {
+        return full;
+    }
+    return rect;
+}
+
+bool IsViewportInside(const ViewportRect& rect, std::size_t bitmap_width,
+                      std::size_t bitmap_height) {
+    return rect.width != 0 && rect.height != 0 && rect.x < bitmap_width &&
+           rect.y < bitmap_height && rect.width <= bitmap_width - rect.x &&
+           rect.height <= bitmap_height - rect.y;
+}
+
+void ClearViewportBorder(const Blit::Surface& surface, const ViewportRect& rect) {
+    const auto bottom = rect.y + rect.height;
+    const auto right = rect.x + rect.width;
+    Blit::FillRect(surface, 0, 0, surface.width, rect.y, BORDER_PIXEL);
+    Blit::FillRect(surface, 0, bottom, surface.width, surface.height - bottom, BORDER_PIXEL);
+    Blit::FillRect(surface, 0, rect.y, rect.x, rect.height, BORDER_PIXEL);
+    Blit::FillRect(surface, right, rect.y, surface.width - right, rect.height, BORDER_PIXEL);
+}
+
+Blit::Surface GetViewportSurface(const Blit::Surface& surface, const ViewportRect& rect) {
+    u8* top_line = surface.top_line + static_cast<std::ptrdiff_t>(rect.y) * surface.pitch +
+                   static_cast<std::ptrdiff_t>(rect.x * 4);
+    return Blit::Surface{top_line, surface.pitch, rect.width, rect.height};
+}
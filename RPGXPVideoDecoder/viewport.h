@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+
+#include "blit_kernels.h"
+#include "common_types.h"
+
+/// How frames are placed in the bitmap
+enum class ViewportMode : u32 {
+    // Stretched across the whole bitmap, whatever its aspect ratio
+    Stretch = 0,
+    // As large as fits while keeping the videos display aspect ratio, centred with black bars
+    // above and below (letterbox) or to the sides (pillarbox)
+    Fit = 1,
+    // Stretched across a rectangle picked by the game
+    Custom = 2,
+};
+
+constexpr u32 VIEWPORT_MODE_COUNT = 3;
+
+/// Rectangle in bitmap pixels, measured from the top left
+struct ViewportRect {
+    std::size_t x{};
+    std::size_t y{};
+    std::size_t width{};
+    std::size_t height{};
+
+    bool operator==(const ViewportRect& other) const {
+        return x == other.x && y == other.y && width == other.width && height == other.height;
+    }
+
+    bool operator!=(const ViewportRect& other) const {
+        return !(*this == other);
+    }
+};
+
+/// Where frames go in a bitmap_width x bitmap_height bitmap. display_aspect is the width of the
+/// video over its height once the sample aspect ratio is applied, custom is only used by Custom
+/// and has to fit inside the bitmap
+ViewportRect ResolveViewport(ViewportMode mode, const ViewportRect& custom,
+                             std::size_t bitmap_width, std::size_t bitmap_height,
+                             double display_aspect);
+
+/// Whether rect is non empty and fits inside the bitmap
+bool IsViewportInside(const ViewportRect& rect, std::size_t bitmap_width,
+                      std::size_t bitmap_height);
+
+/// Fills everything in surface outside of rect with opaque black
+void ClearViewportBorder(const Blit::Surface& surface, const ViewportRect& rect);
+
+/// The part of surface covered by rect, with the same pitch
+Blit::Surface GetViewportSurface(const Blit::Surface& surface, const ViewportRect& rect);
@@ -0,0 +1,509 @@
+#include <algorithm>
+#include <cmath>
+#include "cpu_features.h"
+#include "yuv_kernels.h"
+
+#if VIDEC_ARCH_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+namespace Yuv {
+
+namespace {
+
+constexpr std::size_t BYTES_PER_PIXEL = 4;
+
+// Channels carry this many fractional bits until they're packed down to bytes
+constexpr int FRACTION_BITS = 5;
+
+// The coefficients are in units of 1 / 2^13, so the 16 bit high half of a multiply with a value
+// scaled by 256 leaves FRACTION_BITS behind
+constexpr double COEFFICIENT_SCALE = 8192.0;
+
+// The scalar kernels do everything the SIMD ones do in the same order so the output matches bit
+// for bit, they're also what finishes off rows that don't fill a whole vector
+int MulHigh(int a, int b) {
+    return (a * b) >> 16;
+}
+
+struct ChromaTerms {
+    int r{};
+    int g{};
+    int b{};
+};
+
+template <Layout L>
+ChromaTerms GetChromaTerms(const Rows& src, std::size_t sample, const Coefficients& k) {
+    int u{};
+    int v{};
+    if constexpr (L == Layout::NV12) {
+        u = src.chroma[0][sample * 2];
+        v = src.chroma[0][sample * 2 + 1];
+    } else {
+        u = src.chroma[0][sample];
+        v = src.chroma[1][sample];
+    }
+    u = (u - 128) * 256;
+    v = (v - 128) * 256;
+    return ChromaTerms{MulHigh(v, k.vr), MulHigh(u, k.ug) + MulHigh(v, k.vg), MulHigh(u, k.ub)};
+}
+
+int GetLumaTerm(int luma, const Coefficients& k) {
+    return MulHigh(luma * 256, k.y) + k.bias;
+}
+
+/// Matches averaging the two rows and then the two columns with rounding, like pavgb and pavgw
+int AverageBlock(const u8* row0, const u8* row1) {
+    const int left = (row0[0] + row1[0] + 1) >> 1;
+    const int right = (row0[1] + row1[1] + 1) >> 1;
+    return (left + right + 1) >> 1;
+}
+
+u8 ToChannel(int value) {
+    return static_cast<u8>(std::clamp(value >> FRACTION_BITS, 0, 255));
+}
+
+void StorePixel(u8* dst, int luma, const ChromaTerms& chroma) {
+    dst[0] = ToChannel(luma + chroma.b);
+    dst[1] = ToChannel(luma + chroma.g);
+    dst[2] = ToChannel(luma + chroma.r);
+    dst[3] = 255;
+}
+
+template <Layout L>
+void RowTail(u8* dst, const Rows& src, std::size_t first, std::size_t pixels,
+             const Coefficients& k) {
+    for (std::size_t x = first; x < pixels; x++) {
+        StorePixel(dst + x * BYTES_PER_PIXEL, GetLumaTerm(src.luma[0][x], k),
+                   GetChromaTerms<L>(src, x / 2, k));
+    }
+}
+
+template <Layout L>
+void HalfRowTail(u8* dst, const Rows& src, std::size_t first, std::size_t pixels,
+                 const Coefficients& k) {
+    for (std::size_t x = first; x < pixels; x++) {
+        const int luma = AverageBlock(src.luma[0] + x * 2, src.luma[1] + x * 2);
+        StorePixel(dst + x * BYTES_PER_PIXEL, GetLumaTerm(luma, k), GetChromaTerms<L>(src, x, k));
+    }
+}
+
+template <Layout L>
+void RowScalar(u8* dst, const Rows& src, std::size_t pixels, const Coefficients& k) {
+    RowTail<L>(dst, src, 0, pixels, k);
+}
+
+template <Layout L>
+void HalfRowScalar(u8* dst, const Rows& src, std::size_t pixels, const Coefficients& k) {
+    HalfRowTail<L>(dst, src, 0, pixels, k);
+}
+
+#if VIDEC_ARCH_X86
+struct Coefficients128 {
+    __m128i y;
+    __m128i bias;
+    __m128i vr;
+    __m128i ug;
+    __m128i vg;
+    __m128i ub;
+};
+
+struct ChromaTerms128 {
+    __m128i r;
+    __m128i g;
+    __m128i b;
+};
+
+Coefficients128 LoadCoefficients128(const Coefficients& k) {
+    return Coefficients128{_mm_set1_epi16(k.y),  _mm_set1_epi16(k.bias), _mm_set1_epi16(k.vr),
+                           _mm_set1_epi16(k.ug), _mm_set1_epi16(k.vg),   _mm_set1_epi16(k.ub)};
+}
+
+/// Turns chroma sitting in the high byte of each 16 bit lane into (sample - 128) * 256
+__m128i CenterChroma128(__m128i shifted) {
+    return _mm_xor_si128(shifted, _mm_set1_epi16(-32768));
+}
+
+/// Loads 8 chroma samples starting at sample
+template <Layout L>
+void LoadChroma128(const Rows& src, std::size_t sample, __m128i& u, __m128i& v) {
+    if constexpr (L == Layout::NV12) {
+        const __m128i uv =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src.chroma[0] + sample * 2));
+        u = CenterChroma128(_mm_slli_epi16(uv, 8));
+        v = CenterChroma128(_mm_and_si128(uv, _mm_set1_epi16(-256)));
+    } else {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i u_bytes =
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src.chroma[0] + sample));
+        const __m128i v_bytes =
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src.chroma[1] + sample));
+        u = CenterChroma128(_mm_unpacklo_epi8(zero, u_bytes));
+        v = CenterChroma128(_mm_unpacklo_epi8(zero, v_bytes));
+    }
+}
+
+ChromaTerms128 GetChromaTerms128(__m128i u, __m128i v, const Coefficients128& k) {
+    return ChromaTerms128{
+        _mm_mulhi_epi16(v, k.vr),
+        _mm_add_epi16(_mm_mulhi_epi16(u, k.ug), _mm_mulhi_epi16(v, k.vg)),
+        _mm_mulhi_epi16(u, k.ub),
+    };
+}
+
+__m128i PackChannel128(__m128i luma_lo, __m128i luma_hi, __m128i term_lo, __m128i term_hi) {
+    return _mm_packus_epi16(_mm_srai_epi16(_mm_add_epi16(luma_lo, term_lo), FRACTION_BITS),
+                            _mm_srai_epi16(_mm_add_epi16(luma_hi, term_hi), FRACTION_BITS));
+}
+
+/// Writes 16 pixels. luma_lo and luma_hi hold 8 pixels each scaled by 256, the chroma terms line
+/// up with them
+void StorePixels128(u8* dst, __m128i luma_lo, __m128i luma_hi, const ChromaTerms128& lo,
+                    const ChromaTerms128& hi, const Coefficients128& k) {
+    const __m128i y_lo = _mm_add_epi16(_mm_mulhi_epu16(luma_lo, k.y), k.bias);
+    const __m128i y_hi = _mm_add_epi16(_mm_mulhi_epu16(luma_hi, k.y), k.bias);
+    const __m128i b = PackChannel128(y_lo, y_hi, lo.b, hi.b);
+    const __m128i g = PackChannel128(y_lo, y_hi, lo.g, hi.g);
+    const __m128i r = PackChannel128(y_lo, y_hi, lo.r, hi.r);
+    const __m128i alpha = _mm_set1_epi8(-1);
+
+    const __m128i bg_lo = _mm_unpacklo_epi8(b, g);
+    const __m128i bg_hi = _mm_unpackhi_epi8(b, g);
+    const __m128i ra_lo = _mm_unpacklo_epi8(r, alpha);
+    const __m128i ra_hi = _mm_unpackhi_epi8(r, alpha);
+    auto* out = reinterpret_cast<__m128i*>(dst);
+    _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(bg_lo, ra_lo));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(bg_lo, ra_lo));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(bg_hi, ra_hi));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(bg_hi, ra_hi));
+}
+
+/// Averages the 2x2 blocks of 16 luma pixels from two rows into 8 values scaled by 256
+__m128i AverageLuma128(const u8* row0, const u8* row1) {
+    const __m128i rows = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1)));
+    const __m128i columns =
+        _mm_avg_epu16(_mm_and_si128(rows, _mm_set1_epi16(0xFF)), _mm_srli_epi16(rows, 8));
+    return _mm_slli_epi16(columns, 8);
+}
+
+template <Layout L>
+void RowSSE2(u8* dst, const Rows& src, std::size_t pixels, const Coefficients& coefficients) {
+    const auto k = LoadCoefficients128(coefficients);
+    const __m128i zero = _mm_setzero_si128();
+    std::size_t x = 0;
+    for (; x + 16 <= pixels; x += 16) {
+        __m128i u{};
+        __m128i v{};
+        LoadChroma128<L>(src, x / 2, u, v);
+        const auto terms = GetChromaTerms128(u, v, k);
+
+        // Every chroma sample covers two pixels
+        const ChromaTerms128 lo{_mm_unpacklo_epi16(terms.r, terms.r),
+                                _mm_unpacklo_epi16(terms.g, terms.g),
+                                _mm_unpacklo_epi16(terms.b, terms.b)};
+        const ChromaTerms128 hi{_mm_unpackhi_epi16(terms.r, terms.r),
+                                _mm_unpackhi_epi16(terms.g, terms.g),
+                                _mm_unpackhi_epi16(terms.b, terms.b)};
+        const __m128i luma = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src.luma[0] + x));
+        StorePixels128(dst + x * BYTES_PER_PIXEL, _mm_unpacklo_epi8(zero, luma),
+                       _mm_unpackhi_epi8(zero, luma), lo, hi, k);
+    }
+    RowTail<L>(dst, src, x, pixels, coefficients);
+}
+
+template <Layout L>
+void HalfRowSSE2(u8* dst, const Rows& src, std::size_t pixels, const Coefficients& coefficients) {
+    const auto k = LoadCoefficients128(coefficients);
+    std::size_t x = 0;
+    for (; x + 16 <= pixels; x += 16) {
+        const u8* row0 = src.luma[0] + x * 2;
+        const u8* row1 = src.luma[1] + x * 2;
+        __m128i u_lo{};
+        __m128i v_lo{};
+        __m128i u_hi{};
+        __m128i v_hi{};
+        LoadChroma128<L>(src, x, u_lo, v_lo);
+        LoadChroma128<L>(src, x + 8, u_hi, v_hi);
+        StorePixels128(dst + x * BYTES_PER_PIXEL, AverageLuma128(row0, row1),
+                       AverageLuma128(row0 + 16, row1 + 16), GetChromaTerms128(u_lo, v_lo, k),
+                       GetChromaTerms128(u_hi, v_hi, k), k);
+    }
+    HalfRowTail<L>(dst, src, x, pixels, coefficients);
+}
+
+// The AVX2 kernels work on 32 pixels at a time. Unpacks and packs stay within each 128 bit lane,
+// so the pixels are kept as {0-7, 16-23} and {8-15, 24-31} until the final permute puts them back
+// in order
+struct Coefficients256 {
+    __m256i y;
+    __m256i bias;
+    __m256i vr;
+    __m256i ug;
+    __m256i vg;
+    __m256i ub;
+};
+
+struct ChromaTerms256 {
+    __m256i r;
+    __m256i g;
+    __m256i b;
+};
+
+VIDEC_TARGET_AVX2 Coefficients256 LoadCoefficients256(const Coefficients& k) {
+    return Coefficients256{_mm256_set1_epi16(k.y),  _mm256_set1_epi16(k.bias),
+                           _mm256_set1_epi16(k.vr), _mm256_set1_epi16(k.ug),
+                           _mm256_set1_epi16(k.vg), _mm256_set1_epi16(k.ub)};
+}
+
+VIDEC_TARGET_AVX2 __m256i CenterChroma256(__m256i shifted) {
+    return _mm256_xor_si256(shifted, _mm256_set1_epi16(-32768));
+}
+
+/// Loads 16 chroma samples starting at sample, in order across the two lanes
+template <Layout L>
+VIDEC_TARGET_AVX2 void LoadChroma256(const Rows& src, std::size_t sample, __m256i& u,
+                                     __m256i& v) {
+    if constexpr (L == Layout::NV12) {
+        const __m256i uv =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src.chroma[0] + sample * 2));
+        u = CenterChroma256(_mm256_slli_epi16(uv, 8));
+        v = CenterChroma256(_mm256_and_si256(uv, _mm256_set1_epi16(-256)));
+    } else {
+        const __m128i u_bytes =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src.chroma[0] + sample));
+        const __m128i v_bytes =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src.chroma[1] + sample));
+        u = CenterChroma256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(u_bytes), 8));
+        v = CenterChroma256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(v_bytes), 8));
+    }
+}
+
+VIDEC_TARGET_AVX2 ChromaTerms256 GetChromaTerms256(__m256i u, __m256i v,
+                                                   const Coefficients256& k) {
+    return ChromaTerms256{
+        _mm256_mulhi_epi16(v, k.vr),
+        _mm256_add_epi16(_mm256_mulhi_epi16(u, k.ug), _mm256_mulhi_epi16(v, k.vg)),
+        _mm256_mulhi_epi16(u, k.ub),
+    };
+}
+
+VIDEC_TARGET_AVX2 __m256i PackChannel256(__m256i luma_lo, __m256i luma_hi, __m256i term_lo,
+                                         __m256i term_hi) {
+    return _mm256_packus_epi16(
+        _mm256_srai_epi16(_mm256_add_epi16(luma_lo, term_lo), FRACTION_BITS),
+        _mm256_srai_epi16(_mm256_add_epi16(luma_hi, term_hi), FRACTION_BITS));
+}
+
+/// Writes 32 pixels, luma_lo and the lo terms hold pixels 0-7 and 16-23, the hi ones the rest
+VIDEC_TARGET_AVX2 void StorePixels256(u8* dst, __m256i luma_lo, __m256i luma_hi,
+                                      const ChromaTerms256& lo, const ChromaTerms256& hi,
+                                      const Coefficients256& k) {
+    const __m256i y_lo = _mm256_add_epi16(_mm256_mulhi_epu16(luma_lo, k.y), k.bias);
+    const __m256i y_hi = _mm256_add_epi16(_mm256_mulhi_epu16(luma_hi, k.y), k.bias);
+    const __m256i b = PackChannel256(y_lo, y_hi, lo.b, hi.b);
+    const __m256i g = PackChannel256(y_lo, y_hi, lo.g, hi.g);
+    const __m256i r = PackChannel256(y_lo, y_hi, lo.r, hi.r);
+    const __m256i alpha = _mm256_set1_epi8(-1);
+
+    const __m256i bg_lo = _mm256_unpacklo_epi8(b, g);
+    const __m256i bg_hi = _mm256_unpackhi_epi8(b, g);
+    const __m256i ra_lo = _mm256_unpacklo_epi8(r, alpha);
+    const __m256i ra_hi = _mm256_unpackhi_epi8(r, alpha);
+    const __m256i p0 = _mm256_unpacklo_epi16(bg_lo, ra_lo);
+    const __m256i p1 = _mm256_unpackhi_epi16(bg_lo, ra_lo);
+    const __m256i p2 = _mm256_unpacklo_epi16(bg_hi, ra_hi);
+    const __m256i p3 = _mm256_unpackhi_epi16(bg_hi, ra_hi);
+    auto* out = reinterpret_cast<__m256i*>(dst);
+    _mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(p0, p1, 0x20));
+    _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+    _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+    _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+}
+
+/// Averages the 2x2 blocks of 32 luma pixels from two rows into 16 values scaled by 256
+VIDEC_TARGET_AVX2 __m256i AverageLuma256(const u8* row0, const u8* row1) {
+    const __m256i rows =
+        _mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0)),
+                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1)));
+    const __m256i columns = _mm256_avg_epu16(_mm256_and_si256(rows, _mm256_set1_epi16(0xFF)),
+                                             _mm256_srli_epi16(rows, 8));
+    return _mm256_slli_epi16(columns, 8);
+}
+
+template <Layout L>
+VIDEC_TARGET_AVX2 void RowAVX2(u8* dst, const Rows& src, std::size_t pixels,
+                               const Coefficients& coefficients) {
+    const auto k = LoadCoefficients256(coefficients);
+    const __m256i zero = _mm256_setzero_si256();
+    std::size_t x = 0;
+    for (; x + 32 <= pixels; x += 32) {
+        __m256i u{};
+        __m256i v{};
+        LoadChroma256<L>(src, x / 2, u, v);
+        const auto terms = GetChromaTerms256(u, v, k);
+
+        // Doubling up the samples within each lane lands them on pixels 0-7 and 16-23 for lo
+        const ChromaTerms256 lo{_mm256_unpacklo_epi16(terms.r, terms.r),
+                                _mm256_unpacklo_epi16(terms.g, terms.g),
+                                _mm256_unpacklo_epi16(terms.b, terms.b)};
+        const ChromaTerms256 hi{_mm256_unpackhi_epi16(terms.r, terms.r),
+                                _mm256_unpackhi_epi16(terms.g, terms.g),
+                                _mm256_unpackhi_epi16(terms.b, terms.b)};
+        const __m256i luma =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src.luma[0] + x));
+        StorePixels256(dst + x * BYTES_PER_PIXEL, _mm256_unpacklo_epi8(zero, luma),
+                       _mm256_unpackhi_epi8(zero, luma), lo, hi, k);
+    }
+    RowTail<L>(dst, src, x, pixels, coefficients);
+}
+
+template <Layout L>
+VIDEC_TARGET_AVX2 void HalfRowAVX2(u8* dst, const Rows& src, std::size_t pixels,
+                                   const Coefficients& coefficients) {
+    const auto k = LoadCoefficients256(coefficients);
+    std::size_t x = 0;
+    for (; x + 32 <= pixels; x += 32) {
+        const u8* row0 = src.luma[0] + x * 2;
+        const u8* row1 = src.luma[1] + x * 2;
+        const __m256i luma_first = AverageLuma256(row0, row1);
+        const __m256i luma_second = AverageLuma256(row0 + 32, row1 + 32);
+        __m256i u_first{};
+        __m256i v_first{};
+        __m256i u_second{};
+        __m256i v_second{};
+        LoadChroma256<L>(src, x, u_first, v_first);
+        LoadChroma256<L>(src, x + 16, u_second, v_second);
+
+        // Both halves come out in order, swap the middle lanes to match StorePixels256
+        const __m256i u_lo = _mm256_permute2x128_si256(u_first, u_second, 0x20);
+        const __m256i u_hi = _mm256_permute2x128_si256(u_first, u_second, 0x31);
+        const __m256i v_lo = _mm256_permute2x128_si256(v_first, v_second, 0x20);
+        const __m256i v_hi = _mm256_permute2x128_si256(v_first, v_second, 0x31);
+        StorePixels256(dst + x * BYTES_PER_PIXEL,
+                       _mm256_permute2x128_si256(luma_first, luma_second, 0x20),
+                       _mm256_permute2x128_si256(luma_first, luma_second, 0x31),
+                       GetChromaTerms256(u_lo, v_lo, k), GetChromaTerms256(u_hi, v_hi, k), k);
+    }
+    HalfRowTail<L>(dst, src, x, pixels, coefficients);
+}
+#endif
+
+constexpr Kernels SCALAR_KERNELS{
+    Blit::Isa::Scalar,           "scalar",
+    RowScalar<Layout::I420>,     RowScalar<Layout::NV12>,
+    HalfRowScalar<Layout::I420>, HalfRowScalar<Layout::NV12>,
+};
+#if VIDEC_ARCH_X86
+constexpr Kernels SSE2_KERNELS{
+    Blit::Isa::SSE2,           "sse2",
+    RowSSE2<Layout::I420>,     RowSSE2<Layout::NV12>,
+    HalfRowSSE2<Layout::I420>, HalfRowSSE2<Layout::NV12>,
+};
+constexpr Kernels AVX2_KERNELS{
+    Blit::Isa::AVX2,           "avx2",
+    RowAVX2<Layout::I420>,     RowAVX2<Layout::NV12>,
+    HalfRowAVX2<Layout::I420>, HalfRowAVX2<Layout::NV12>,
+};
+#endif
+
+const Kernels& SelectKernels() {
+    if (const auto* kernels = Yuv::GetKernels(Blit::Isa::AVX2)) {
+        return *kernels;
+    }
+    if (const auto* kernels = Yuv::GetKernels(Blit::Isa::SSE2)) {
+        return *kernels;
+    }
+    return SCALAR_KERNELS;
+}
+
+s16 ToFixed(double value) {
+    return static_cast<s16>(std::lround(value * COEFFICIENT_SCALE));
+}
+
+} // Anonymous namespace
+
+Coefficients MakeCoefficients(Matrix matrix, Range range) {
+    const double kr = matrix == Matrix::BT709 ? 0.2126 : 0.299;
+    const double kb = matrix == Matrix::BT709 ? 0.0722 : 0.114;
+    const double kg = 1.0 - kr - kb;
+    const bool full = range == Range::Full;
+    const double luma_scale = full ? 1.0 : 255.0 / 219.0;
+    const double chroma_scale = full ? 1.0 : 255.0 / 224.0;
+    const double luma_offset = full ? 0.0 : 16.0;
+
+    Coefficients k{};
+    k.y = ToFixed(luma_scale);
+    k.vr = ToFixed(2.0 * (1.0 - kr) * chroma_scale);
+    k.ug = ToFixed(-2.0 * (1.0 - kb) * kb / kg * chroma_scale);
+    k.vg = ToFixed(-2.0 * (1.0 - kr) * kr / kg * chroma_scale);
+    k.ub = ToFixed(2.0 * (1.0 - kb) * chroma_scale);
+    k.bias = static_cast<s16>(std::lround(-luma_offset * luma_scale * (1 << FRACTION_BITS)) +
+                              (1 << (FRACTION_BITS - 1)));
+    return k;
+}
+
+const Kernels& GetKernels() {
+    static const Kernels& kernels = SelectKernels();
+    return kernels;
+}
+
+const Kernels* GetKernels(Blit::Isa isa) {
+    switch (isa) {
+    case Blit::Isa::Scalar:
+        return &SCALAR_KERNELS;
+#if VIDEC_ARCH_X86
+    case Blit::Isa::SSE2:
+        return GetCpuFeatures().sse2 ? &SSE2_KERNELS : nullptr;
+    case Blit::Isa::AVX2:
+        return GetCpuFeatures().avx2 ? &AVX2_KERNELS : nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+bool CanConvert(const Image& src, std::size_t dst_width, std::size_t dst_height) {
+    const bool nv12 = src.layout == Layout::NV12;
+    if (src.planes[0] == nullptr || src.planes[1] == nullptr ||
+        (!nv12 && src.planes[2] == nullptr) || dst_width == 0 || dst_height == 0) {
+        return false;
+    }
+    const bool same_size = src.width == dst_width && src.height == dst_height;
+    const bool half_size = src.width == dst_width * 2 && src.height == dst_height * 2;
+    return same_size || half_size;
+}
+
+bool ConvertRows(const Blit::Surface& dst, const Image& src, const Coefficients& coefficients,
+                 std::size_t first_row, std::size_t end_row, const Kernels& kernels) {
+    if (dst.top_line == nullptr || !CanConvert(src, dst.width, dst.height)) {
+        return false;
+    }
+
+    const bool half = src.width != dst.width;
+    const bool nv12 = src.layout == Layout::NV12;
+    RowFunc row_func = nv12 ? kernels.nv12_row : kernels.i420_row;
+    if (half) {
+        row_func = nv12 ? kernels.nv12_half_row : kernels.i420_half_row;
+    }
+
+    end_row = std::min<std::size_t>(end_row, dst.height);
+    u8* dst_row = dst.top_line + static_cast<std::ptrdiff_t>(first_row) * dst.pitch;
+    for (std::size_t row = first_row; row < end_row; row++) {
+        // Chroma has half as many rows as the full size luma, so it's shared by two rows at full
+        // size and lines up one to one when halving
+        const auto luma_row = static_cast<std::ptrdiff_t>(half ? row * 2 : row);
+        const auto chroma_row = static_cast<std::ptrdiff_t>(half ? row : row / 2);
+        Rows rows{};
+        rows.luma[0] = src.planes[0] + luma_row * src.pitches[0];
+        rows.luma[1] = half ? rows.luma[0] + src.pitches[0] : nullptr;
+        rows.chroma[0] = src.planes[1] + chroma_row * src.pitches[1];
+        rows.chroma[1] = nv12 ? nullptr : src.planes[2] + chroma_row * src.pitches[2];
+        row_func(dst_row, rows, dst.width, coefficients);
+        dst_row += dst.pitch;
+    }
+    return true;
+}
+
+} // namespace Yuv
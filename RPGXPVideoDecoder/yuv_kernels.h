@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include "blit_kernels.h"
+#include "common_types.h"
+
+namespace Yuv {
+
+/// 4:2:0 layouts the kernels read, I420 has separate U and V planes, NV12 one interleaved plane
+enum class Layout : u32 {
+    I420 = 0,
+    NV12 = 1,
+};
+
+enum class Matrix : u32 {
+    BT601 = 0,
+    BT709 = 1,
+};
+
+enum class Range : u32 {
+    // Luma from 16 to 235 and chroma from 16 to 240, what nearly every video uses
+    Limited = 0,
+    // Every channel uses all of 0 to 255
+    Full = 1,
+};
+
+/// Fixed point conversion factors. Luma and chroma are scaled by 256 and multiplied by these,
+/// keeping the top 16 bits, which leaves every channel with 5 fractional bits. Every kernel does
+/// exactly the same integer math so they all produce identical output
+struct Coefficients {
+    s16 y{};
+    s16 vr{};
+    s16 ug{};
+    s16 vg{};
+    s16 ub{};
+    // Luma offset and rounding, added before the fractional bits are dropped
+    s16 bias{};
+};
+
+Coefficients MakeCoefficients(Matrix matrix, Range range);
+
+/// Source frame, planes and pitches follow AVFrame::data and AVFrame::linesize. NV12 only uses
+/// the first two planes
+struct Image {
+    Layout layout{};
+    const u8* planes[3]{};
+    std::ptrdiff_t pitches[3]{};
+    std::size_t width{};
+    std::size_t height{};
+};
+
+/// Source rows for a single line of output. luma[1] is the line below luma[0] and only read when
+/// halving, chroma[1] is only read for I420
+struct Rows {
+    const u8* luma[2]{};
+    const u8* chroma[2]{};
+};
+
+using RowFunc = void (*)(u8* dst, const Rows& src, std::size_t pixels,
+                         const Coefficients& coefficients);
+
+/// Row kernels writing opaque BGRA. The full size kernels share every chroma sample between two
+/// neighbouring pixels, the half size kernels average each 2x2 block of luma and use the chroma
+/// sample that sits on it
+struct Kernels {
+    Blit::Isa isa{};
+    const char* name{};
+    RowFunc i420_row{};
+    RowFunc nv12_row{};
+    RowFunc i420_half_row{};
+    RowFunc nv12_half_row{};
+};
+
+/// Best kernels for the running CPU, picked once on first use
+const Kernels& GetKernels();
+
+/// Kernels for a specific instruction set or nullptr if the CPU doesn't support it
+const Kernels* GetKernels(Blit::Isa isa);
+
+/// Whether src can be converted into a dst_width x dst_height image, which is the case when it
+/// is either the same size or exactly twice as large in both directions
+bool CanConvert(const Image& src, std::size_t dst_width, std::size_t dst_height);
+
+/// Converts the rows from first_row up to end_row of dst, so bands of one image can be converted
+/// in parallel. dst can be bottom-up. Returns false without writing anything if CanConvert fails
+bool ConvertRows(const Blit::Surface& dst, const Image& src, const Coefficients& coefficients,
+                 std::size_t first_row, std::size_t end_row,
+                 const Kernels& kernels = GetKernels());
+
+} // namespace Yuv